@@ -0,0 +1,272 @@
+/******************************************************
+ * Description: Batch engine. The shot pass works on
+ *   four games at a time in 256-bit vectors of 64-bit
+ *   words (GCC vector extensions); it is built for
+ *   AVX2, for SSE4.1 as two 128-bit halves and for the
+ *   base instruction set, and the first batch_init()
+ *   picks the best one the CPU runs, unless batch_use()
+ *   named one first. Cells come in and results go out
+ *   as bytes, converted inside the pass.
+ *   Lanes past n only ever see off-board shots, so they
+ *   stay untouched.
+ ******************************************************/
+
+#include <pthread.h>
+#include <string.h>
+
+#include "batch.h"
+
+typedef uint64_t v4u __attribute__((vector_size(32)));
+typedef unsigned char v4b __attribute__((vector_size(4)));
+typedef signed char v4s __attribute__((vector_size(4)));
+typedef int v4i __attribute__((vector_size(16)));
+
+// vectors per word array
+#define VECS (BATCH_LANES / 4)
+
+// one build of the passes
+struct batch_isa {
+  const char* name;
+  int (*supported)();
+  void (*attack)(struct batch_side*, int, const unsigned char*, unsigned char*, signed char*, int*);
+  void (*win)(const struct batch*, unsigned char*);
+};
+
+static void pick_isa();
+static int has_avx2();
+static int has_sse41();
+static int has_base();
+static void attack_avx2(struct batch_side*, int, const unsigned char*, unsigned char*, signed char*, int*);
+static void attack_sse41(struct batch_side*, int, const unsigned char*, unsigned char*, signed char*, int*);
+static void attack_base(struct batch_side*, int, const unsigned char*, unsigned char*, signed char*, int*);
+static void win_avx2(const struct batch*, unsigned char*);
+static void win_sse41(const struct batch*, unsigned char*);
+static void win_base(const struct batch*, unsigned char*);
+
+// best first
+static const struct batch_isa isas[] = {
+  { "avx2", has_avx2, attack_avx2, win_avx2 },
+  { "sse4.1", has_sse41, attack_sse41, win_sse41 },
+  { "plain", has_base, attack_base, win_base },
+};
+
+// names of every build, for batch_use()
+const char* const batch_isas[] = { "avx2", "sse4.1", "plain", 0 };
+
+static pthread_once_t isa_once = PTHREAD_ONCE_INIT;
+static const struct batch_isa* isa;
+
+
+// an empty batch of n games
+void batch_init(struct batch* b, int n)
+{
+  pthread_once(&isa_once, pick_isa);
+  memset(b, 0, sizeof(*b));
+  b->n = n < BATCH_LANES ? n : BATCH_LANES;
+}
+
+// copy both boards of a game into lane i
+void batch_load(struct batch* b, int i, const struct game* g)
+{
+  const struct side* sd;
+  struct batch_side* bs;
+  bitboard id[BATCH_ID_BITS];
+  int mode, s, k;
+  for(mode = P1; mode <= P2; mode++) {
+    sd = &g->side[mode];
+    bs = &b->side[mode];
+    memset(id, 0, sizeof(id));
+    bs->left[i] = 0;
+    for(s = 0; s < SHIP_COUNT; s++) {
+      for(k = 0; k < BATCH_ID_BITS; k++)
+        if(s >> k & 1)
+          id[k] |= sd->ship_mask[s];
+      bs->left[i] |= (uint64_t)bb_count(sd->ship_mask[s] & ~sd->hits) << 4 * s;
+    }
+    for(k = 0; k < BATCH_ID_BITS; k++) {
+      bs->ship_id[k][0][i] = (uint64_t)id[k];
+      bs->ship_id[k][1][i] = (uint64_t)(id[k] >> 64);
+    }
+    bs->occupied[0][i] = (uint64_t)sd->occupied;
+    bs->occupied[1][i] = (uint64_t)(sd->occupied >> 64);
+    bs->hits[0][i] = (uint64_t)sd->hits;
+    bs->hits[1][i] = (uint64_t)(sd->hits >> 64);
+    bs->misses[0][i] = (uint64_t)sd->misses;
+    bs->misses[1][i] = (uint64_t)(sd->misses >> 64);
+    b->shots[mode][i] = g->shots[mode];
+  }
+}
+
+// write the shots of lane i back into a game its fleets came from
+void batch_store(const struct batch* b, int i, struct game* g)
+{
+  const struct batch_side* bs;
+  struct side* sd;
+  int mode, s;
+  for(mode = P1; mode <= P2; mode++) {
+    bs = &b->side[mode];
+    sd = &g->side[mode];
+    sd->hits = (bitboard)bs->hits[1][i] << 64 | bs->hits[0][i];
+    sd->misses = (bitboard)bs->misses[1][i] << 64 | bs->misses[0][i];
+    for(s = 0; s < SHIP_COUNT; s++)
+      sd->ships[s].is_sunk = sd->ship_mask[s] && !(sd->ship_mask[s] & ~sd->hits);
+    g->shots[mode] = b->shots[mode][i];
+  }
+}
+
+// bomb one cell of the target's board in every game; SHOT_* result and the sunk ship or -1
+// per game; all three arrays hold BATCH_LANES entries, those past n are ignored
+void batch_attack(struct batch* b, int mode, const unsigned char* cells, unsigned char* res, signed char* ship)
+{
+  signed char scratch[BATCH_LANES];
+  isa->attack(&b->side[mode], b->n, cells, res, ship ? ship : scratch, b->shots[!mode]);
+}
+
+// engine_win() of every game, win holds BATCH_LANES entries
+void batch_win(const struct batch* b, unsigned char* win)
+{
+  isa->win(b, win);
+}
+
+// run the named build of the passes from now on; return 0, or -1 if there is none
+// by that name or the CPU cannot run it
+int batch_use(const char* name)
+{
+  int i;
+  pthread_once(&isa_once, pick_isa);
+  for(i = 0; i < (int)(sizeof(isas) / sizeof(isas[0])); i++)
+    if(!strcmp(isas[i].name, name) && isas[i].supported()) {
+      isa = &isas[i];
+      return 0;
+    }
+  return -1;
+}
+
+// the build in use
+const char* batch_isa()
+{
+  pthread_once(&isa_once, pick_isa);
+  return isa->name;
+}
+
+static void pick_isa()
+{
+  for(isa = isas; !isa->supported(); isa++)
+    ;
+}
+
+static int has_avx2()
+{
+  return __builtin_cpu_supports("avx2");
+}
+
+static int has_sse41()
+{
+  return __builtin_cpu_supports("sse4.1");
+}
+
+static int has_base()
+{
+  return 1;
+}
+
+// the shot in every lane: cell mask, repeat, hit, the ship under it and whether it sank;
+// inlined into each build below, compiled for its instruction set
+static inline __attribute__((always_inline))
+void attack_pass(struct batch_side* bs, int n, const unsigned char* cells, unsigned char* res,
+                        signed char* ship, int* shots)
+{
+  const v4u one = { 1, 1, 1, 1 }, lane = { 0, 1, 2, 3 };
+  v4u* hits_lo = (v4u*)bs->hits[0], * hits_hi = (v4u*)bs->hits[1];
+  v4u* miss_lo = (v4u*)bs->misses[0], * miss_hi = (v4u*)bs->misses[1];
+  const v4u* occ_lo = (const v4u*)bs->occupied[0], * occ_hi = (const v4u*)bs->occupied[1];
+  v4u* left = (v4u*)bs->left;
+  v4u c, lo, hi, repeat, hit, id, sunk, out;
+  v4b cb;
+  v4s sb;
+  v4i sv;
+  int v, k;
+  for(v = 0; v < VECS; v++) {
+    // the cell as a bitboard; off the board, or in a lane not in use, it is nothing and a repeat
+    memcpy(&cb, cells + 4 * v, sizeof(cb));
+    c = __builtin_convertvector(cb, v4u);
+    c |= (v4u)(lane + 4 * v >= (uint64_t)n) | (v4u)(c >= TOT_ATK_CELL);
+    lo = (v4u)(c < 64) & (one << (c & 63));
+    hi = (v4u)((c >= 64) & (c < TOT_ATK_CELL)) & (one << ((c - 64) & 63));
+    repeat = (v4u)((((hits_lo[v] | miss_lo[v]) & lo) | ((hits_hi[v] | miss_hi[v]) & hi) | ((lo | hi) == 0)) != 0);
+    hit = (v4u)(((occ_lo[v] & lo) | (occ_hi[v] & hi)) != 0) & ~repeat;
+    miss_lo[v] |= lo & ~hit & ~repeat;
+    miss_hi[v] |= hi & ~hit & ~repeat;
+    hits_lo[v] |= lo & hit;
+    hits_hi[v] |= hi & hit;
+    // which ship, bit by bit, then one cell off its counter; it sank if that reached zero
+    id = (v4u){ 0, 0, 0, 0 };
+    for(k = 0; k < BATCH_ID_BITS; k++)
+      id |= (v4u)(((((v4u*)bs->ship_id[k][0])[v] & lo) | (((v4u*)bs->ship_id[k][1])[v] & hi)) != 0) & (1 << k);
+    left[v] -= (hit & one) << 4 * id;
+    sunk = hit & (v4u)((left[v] >> 4 * id & 15) == 0);
+    out = (~repeat & ~hit & SHOT_MISS) | (hit & ~sunk & SHOT_HIT) | (sunk & SHOT_SUNK);
+    cb = __builtin_convertvector(out, v4b);
+    memcpy(res + 4 * v, &cb, sizeof(cb));
+    sb = __builtin_convertvector((id & sunk) | ~sunk, v4s);
+    memcpy(ship + 4 * v, &sb, sizeof(sb));
+    memcpy(&sv, shots + 4 * v, sizeof(sv));
+    sv += __builtin_convertvector(~repeat & 1, v4i);
+    memcpy(shots + 4 * v, &sv, sizeof(sv));
+  }
+}
+
+// engine_win() in every lane from the fleets down and sunk, as engine_fleet_sunk()
+static inline __attribute__((always_inline))
+void win_pass(const struct batch* b, unsigned char* win)
+{
+  const struct batch_side* p1 = &b->side[P1], * p2 = &b->side[P2];
+  v4u d1, d2;
+  v4b wb;
+  int v;
+  for(v = 0; v < VECS; v++) {
+    d1 = (v4u)((((const v4u*)p1->occupied[0])[v] | ((const v4u*)p1->occupied[1])[v]) != 0) &
+         (v4u)(((const v4u*)p1->left)[v] == 0);
+    d2 = (v4u)((((const v4u*)p2->occupied[0])[v] | ((const v4u*)p2->occupied[1])[v]) != 0) &
+         (v4u)(((const v4u*)p2->left)[v] == 0);
+    wb = __builtin_convertvector((d1 & d2 & 1) | (d2 & ~d1 & 2) | (d1 & ~d2 & 3), v4b);
+    memcpy(win + 4 * v, &wb, sizeof(wb));
+  }
+}
+
+__attribute__((target("avx2")))
+static void attack_avx2(struct batch_side* bs, int n, const unsigned char* cells, unsigned char* res,
+                        signed char* ship, int* shots)
+{
+  attack_pass(bs, n, cells, res, ship, shots);
+}
+
+__attribute__((target("sse4.1")))
+static void attack_sse41(struct batch_side* bs, int n, const unsigned char* cells, unsigned char* res,
+                         signed char* ship, int* shots)
+{
+  attack_pass(bs, n, cells, res, ship, shots);
+}
+
+static void attack_base(struct batch_side* bs, int n, const unsigned char* cells, unsigned char* res,
+                        signed char* ship, int* shots)
+{
+  attack_pass(bs, n, cells, res, ship, shots);
+}
+
+__attribute__((target("avx2")))
+static void win_avx2(const struct batch* b, unsigned char* win)
+{
+  win_pass(b, win);
+}
+
+__attribute__((target("sse4.1")))
+static void win_sse41(const struct batch* b, unsigned char* win)
+{
+  win_pass(b, win);
+}
+
+static void win_base(const struct batch* b, unsigned char* win)
+{
+  win_pass(b, win);
+}
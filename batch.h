@@ -0,0 +1,55 @@
+/******************************************************
+ * Description: Batch engine for many classic games
+ *   played in lockstep. The boards of up to BATCH_LANES
+ *   games are kept structure-of-arrays, each bitboard
+ *   split into its low and high words with one array
+ *   slot per game, so one pass of vector instructions
+ *   resolves a shot in every game at once, sink and win
+ *   detection included. Which ship lies on a cell is
+ *   spelled out by three bitboards, one per bit of the
+ *   ship's index, and the cells each ship has left are
+ *   4-bit counters packed in one word per game: a sink
+ *   is a counter reaching zero, a sunk fleet the word.
+ *   The pass is built for AVX2 and SSE4.1 and picked at
+ *   first use, with a plain build for anything else;
+ *   batch_use() forces one, for checks and benchmarks.
+ ******************************************************/
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdint.h>
+
+#include "engine.h"
+
+// games per batch, a multiple of 4
+#define BATCH_LANES 16
+// bits of a ship index, enough for SHIP_COUNT
+#define BATCH_ID_BITS 3
+
+// one player's board in every game: [low/high word][game]
+struct batch_side {
+  uint64_t ship_id[BATCH_ID_BITS][2][BATCH_LANES];  // cells of the ships with that index bit set
+  uint64_t occupied[2][BATCH_LANES];
+  uint64_t hits[2][BATCH_LANES];
+  uint64_t misses[2][BATCH_LANES];
+  uint64_t left[BATCH_LANES];                       // unhit cells of ship i in bits 4i..4i+3
+} __attribute__((aligned(32)));
+
+struct batch {
+  int n;                                // games in use
+  struct batch_side side[2];
+  int shots[2][BATCH_LANES];            // shots fired by each player
+};
+
+void batch_init(struct batch*, int);
+void batch_load(struct batch*, int, const struct game*);
+void batch_store(const struct batch*, int, struct game*);
+void batch_attack(struct batch*, int, const unsigned char*, unsigned char*, signed char*);
+void batch_win(const struct batch*, unsigned char*);
+int batch_use(const char*);
+const char* batch_isa();
+
+extern const char* const batch_isas[];
+
+#endif
@@ -10,104 +10,219 @@
 #include <curses.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <semaphore.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <termios.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "book.h"
+#include "engine.h"
+#include "gamelog.h"
+#include "metrics.h"
+#include "net.h"
+#include "proto.h"
+#include "shm.h"
+#include "snapshot.h"
+#include "strategy.h"
 
-// index for the struct ship arrays
-#define A 0
-#define B 1
-#define F 2
-#define S 3
-#define M 4
-// length of each ship
-#define A_LEN 5
-#define B_LEN 4
-#define F_LEN 3
-#define S_LEN 3
-#define M_LEN 2
-// mode for deploy & attack phase
-#define P1 0
-#define P2 1
-// general consts
-#define TOT_SHIP_CELL 17
-#define TOT_ATK_CELL 100
+
+// screen consts
 #define BOARD_BEG_X 3
 #define BOARD_BEG_Y 2
-#define BOARD_SIZE  10
-#define SHIP_COUNT  5
-#define BUFFER_SIZE 128
-
-// ship struct
-struct ship {
-  char type[25];
-  int length;
-  int y[5];
-  int x[5];
-  int is_sunk;
-  int has_deployed;
-  int num_cell_deployed;
+// side of a board in the game log, which names players absolutely
+#define LOG_SIDE(mode) ((mode) == P1 ? player_id - 1 : 2 - player_id)
+
+// what a board window shows right now, to find the cells that changed
+struct board_view {
+  bitboard ship_mask[SHIP_COUNT];
+  bitboard hits, misses;
+  int drawn;
 };
 
 // functions for each phase
-void init();
+void init(const char*);
 void deploy();
 void attack();
 void wrap_up();
 // helper functions for main phases
 void create_board(int, int);
+void poll_events(void (*)(int));
+void handle_msg(struct msg*);
+void deploy_key(int);
 int do_deploy_ch(int);
 int deploy_ship(char, int, int);
-int deploy_p2();
+int deploy_p2(struct msg*);
+int deploy_fleet(const unsigned char*);
+int load_fleet(const char*, unsigned char*);
+void attack_key(int);
+int attack_over();
 int do_attack_ch(int);
 int attack_cell(int, int);
-int attack_p2();
-int check_ship_align(struct ship*, int, int);
-int win();
+int attack_p2(struct msg*);
+void shot_result(struct msg*);
+int attack_ai();
+void send_p2(int, int, int, int);
+void join_server(const char*);
+void join_shm(char);
+int join_cancelled();
+void on_join_signal(int);
+void* watch_keys(void*);
+int resume_game();
+void resume_at(int);
+void resume_key(int);
+void save_round();
 // print functions
 void print_deploy_help();
 void print_attack_help();
 void print_prompt(char*);
 void print_error(char*, int);
 void print_board();
+void print_cells(int);
+char cell_ch(int, int, int);
 void print_ships_left(int);
+void clear_prompt();
 void move_to_board(int, int, int);
+void restore_cursor();
 // minor helper functions
-struct ship* get_ship_by_ch(int, char);
-struct ship* get_ship_by_coord(int, int, int);
 void wprintw_center(WINDOW*, int, char*);
 void fill_line(WINDOW*, int, char);
-void erase_cell(int, int);
-int check_border(int,int);
-int intcmp (const void*, const void*);
-int row_char2index(char);
-char row_index2char(int);
-int col_num2index(int);
-int col_index2num(int);
+void render_mark();
+void render_report();
+void term_open();
+void term_close();
+void* term_relay(void*);
+long term_drain();
 
 
 // global vars
 WINDOW* p1_board;
 WINDOW* p2_board;
 int infifo, outfifo;  // pipes for output & input
+const char* shm_name; // shared memory in place of the pipes, if set
+struct shm_link shm;
+pthread_t key_thread;
+sem_t keys_taken;     // the event loop read the keys watch_keys() woke it for
+volatile sig_atomic_t join_interrupted;   // ^C while join_shm() waits
+struct channel chan;  // framed messages over the pipes or the shared memory
+int text_proto;       // send text lines instead of binary frames
 int player_id;
+int referee;          // the server resolves shots and keeps the opponent's fleet
+int opp_ready;        // the refereeing server says the opponent's fleet is down
+bitboard pending;     // our shots the referee has not answered yet
+const struct strategy* ai;  // computer opponent, if any
+const struct strategy* ai_pick = &strategy_density;   // the one to play if asked for
+void* ai_state;
+struct rng ai_rng;
+int phase = P1;       // board the cursor is on: P1 to deploy, P2 to attack
+int shots_fired, shots_taken;   // attack phase turn keeping
 int board_h = BOARD_SIZE + 3;
 int board_w = BOARD_SIZE * 2 + 4;
-char board_p1[BOARD_SIZE][BOARD_SIZE];    // player's board
-char board_p2[BOARD_SIZE][BOARD_SIZE];    // p2's board
-char sank_p1[BOARD_SIZE][BOARD_SIZE];     // player's board as shown to p2
-char sank_p2[BOARD_SIZE][BOARD_SIZE];     // p2's board as shown to player
-struct ship ships_p1[SHIP_COUNT], ships_p2[SHIP_COUNT]; // ships info for each player
+struct game game;     // both boards and fleets, P1 is this player
+struct gamelog glog = { -1 };   // optional record of this game
+struct board_view shown[2];     // last drawn state of each board
+int preset;           // whole fleet to deploy at start: 'f' from a file, 'r' random, 0 by hand
+unsigned char preset_fleet[SHIP_COUNT];
+int prompt_shown;     // something is on the prompt line
+// crash recovery
+int snap_fd = -1;     // snapshot file, one record per round
+const char* snap_path;
+struct snapshot snap; // newest snapshot found at start
+int snap_round = -1;  // its round, -1 if none
+int peer_round = -1;  // the opponent's, once its MSG_RESUME is in
+int saved_round = -1; // last round written
+// terminal output accounting
+int render_stats;     // print it on exit
+long term_bytes;      // bytes curses wrote to the terminal
+int term_pipe = -1;   // curses writes here while it is counted, term_relay() passes it on
+struct termios term_saved;      // terminal modes before curses
+pthread_mutex_t term_lock = PTHREAD_MUTEX_INITIALIZER;
+long mark_bytes, mark_moves;    // totals at the last screen update
+long move_bytes, move_frames, move_max;
 
 
 int main(int argc, char** argv)
 {
-  init();
+  const char* server = 0;
+  int opt;
+  while((opt = getopt(argc, argv, "tsl:c:m:f:ra:k:")) != -1) {
+    switch(opt) {
+      case 't':
+        // debug mode, readable messages on the pipes
+        text_proto = 1;
+        break;
+      case 'c':
+        // play through battleship-server instead of the pipes
+        server = optarg;
+        break;
+      case 'm':
+        // meet the other player in a shared memory region by that name instead of the pipes
+        shm_name = optarg;
+        break;
+      case 's':
+        // bytes sent to the terminal per move, printed on exit
+        render_stats = 1;
+        break;
+      case 'l':
+        // append the game to a log for battleship-replay
+        if(gamelog_open(&glog, optarg) < 0) {
+          perror(optarg);
+          return 1;
+        }
+        break;
+      case 'f':
+        // deploy the fleet in a layout file, checked before the screen opens
+        if(load_fleet(optarg, preset_fleet) < 0)
+          return 1;
+        preset = 'f';
+        break;
+      case 'r':
+        // deploy a random fleet
+        preset = 'r';
+        break;
+      case 'a':
+        // how the computer opponent shoots
+        if(!(ai_pick = strategy_find(optarg))) {
+          fprintf(stderr, "unknown strategy: %s\n", optarg);
+          return 1;
+        }
+        break;
+      case 'k':
+        // snapshot every round and pick the game up from there after a crash
+        if((snap_fd = snapshot_open(optarg)) < 0) {
+          perror(optarg);
+          return 1;
+        }
+        snap_path = optarg;
+        snap_round = snapshot_load(snap_fd, -1, &snap);
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-t] [-s] [-l log] [-f layout | -r] [-a strategy] [-k snapshot] "
+                "[-c unix:/path | host:port | -m name]\n", argv[0]);
+        return 1;
+    }
+  }
+  if(server && shm_name) {
+    fprintf(stderr, "-c and -m do not go together\n");
+    return 1;
+  }
+  if(server && snap_fd >= 0) {
+    // the server referees from its own state, which does not survive
+    fprintf(stderr, "games through a server cannot be resumed\n");
+    return 1;
+  }
+  metrics_init("battleship");
+  // a bad BATTLESHIP_BOOK is reported before the screen takes over
+  book_default();
+  init(server);
+  gamelog_begin(&glog);
   deploy();
   attack();
   wrap_up();
@@ -116,14 +231,12 @@ int main(int argc, char** argv)
 }
 
 // initialization of all variables
-void init()
+void init(const char* server)
 {
-  char str[60];
-  int i, j, startx, starty;
+  char str[80];
+  int startx, starty;
   // init screen
-  initscr();
-  crmode();
-  noecho();
+  term_open();
   keypad(stdscr, TRUE);
   clear();
   starty = (LINES - board_h) / 2;
@@ -133,151 +246,190 @@ void init()
   create_board(starty, startx);
   fill_line(stdscr, 0, '=');
   wprintw_center(stdscr, 0, " Welcome to the Battleship game! ");
-  snprintf(str, 60, "**** Requires windows size of %2dx%2d or greater *****", board_w * 2 + 10, board_h + 6);
+  snprintf(str, 80, "**** Requires windows size of %2dx%2d or greater *****", board_w * 2 + 10, board_h + 6);
   wprintw_center(stdscr, 1, str);
   wprintw_center(stdscr, 2, "** Please relaunch the game after resizing window **");
   refresh();
-  // init board array
-  for(i = 0; i < BOARD_SIZE; i++) {
-    for(j = 0; j < BOARD_SIZE; j++) {
-      board_p1[i][j] = '.';
-      board_p2[i][j] = '.';
-      sank_p1[i][j] = '.';
-      sank_p2[i][j] = '.';
-    }
-  }
-  // init ships
-  strcpy(ships_p1[A].type, "Aircraft Carrier");
-  strcpy(ships_p1[B].type, "Battleship");
-  strcpy(ships_p1[F].type, "Frigate");
-  strcpy(ships_p1[S].type, "Submarine");
-  strcpy(ships_p1[M].type, "Minesweeper");
-  strcpy(ships_p2[A].type, "Aircraft Carrier");
-  strcpy(ships_p2[B].type, "Battleship");
-  strcpy(ships_p2[F].type, "Frigate");
-  strcpy(ships_p2[S].type, "Submarine");
-  strcpy(ships_p2[M].type, "Minesweeper");
-  ships_p1[A].length = A_LEN;
-  ships_p1[B].length = B_LEN;
-  ships_p1[F].length = F_LEN;
-  ships_p1[S].length = S_LEN;
-  ships_p1[M].length = M_LEN;
-  ships_p2[A].length = A_LEN;
-  ships_p2[B].length = B_LEN;
-  ships_p2[F].length = F_LEN;
-  ships_p2[S].length = S_LEN;
-  ships_p2[M].length = M_LEN;
-  for(i = 0; i < SHIP_COUNT; i++) {
-    ships_p1[i].is_sunk = 0;
-    ships_p1[i].has_deployed = 0;
-    ships_p1[i].num_cell_deployed = 0;
-    ships_p2[i].is_sunk = 0;
-    ships_p2[i].has_deployed = 0;
-    ships_p2[i].num_cell_deployed = 0;
-    for(i = 0; i < SHIP_COUNT; i++) {
-      ships_p1[i].x[j] = -1;
-      ships_p1[i].y[j] = -1;
-      ships_p2[i].x[j] = -1;
-      ships_p2[i].y[j] = -1;
-    }
+  // init boards and ships
+  engine_init(&game);
+  if(server) {
+    join_server(server);
+    return;
   }
   // open fifo for output/input
-  print_prompt("Are you player 1 or player 2? ");
-  char ch = getch();
+  char ch;
+  if(snap_round >= 0) {
+    // a snapshot already says who we were
+    ch = snap.ai ? 'c' : '0' + snap.player_id;
+    if(snap.ai)
+      ai_pick = strategies[snap.ai - 1];
+  }
+  else {
+    print_prompt("Are you player 1 or player 2? (c to play the computer) ");
+    doupdate();
+    ch = getch();
+  }
+  if(ch == 'c' || ch == 'C') {
+    // computer opponent deploys its whole fleet up front
+    player_id = 1;
+    ai = ai_pick;
+    rng_seed(&ai_rng, time(0) ^ getpid());
+    if(!(ai_state = malloc(ai->size)))
+      print_error("malloc", errno);
+    ai->reset(ai_state, &ai_rng);
+    engine_random_fleet(&game, P2, &ai_rng);
+    infifo = outfifo = -1;
+    return;
+  }
+  if(shm_name) {
+    join_shm(ch);
+    return;
+  }
   if((mkfifo("fifo1", 0666) < 0 || mkfifo("fifo2", 0666) < 0) && errno != EEXIST)
     print_error("mkfifo", errno);
   if(ch == '1') {
     player_id = 1;
     print_prompt("Waiting for player 2 to join...");
+    doupdate();
     infifo = open("./fifo2", O_RDONLY);
     outfifo = open("./fifo1", O_WRONLY);
   }
   else if(ch == '2') {
     player_id = 2;
     print_prompt("Waiting for player 1 to join...");
+    doupdate();
     outfifo = open("./fifo2", O_WRONLY);
     infifo = open("./fifo1", O_RDONLY);
   }
   else {
     print_prompt("Unrecognized input. Game will now exit.");
+    doupdate();
     getch();
     wrap_up();
   }
   if(outfifo < 0 || infifo < 0)
     print_error("open", errno);
+  // the event loop only reads what poll says is there
+  if(fcntl(infifo, F_SETFL, fcntl(infifo, F_GETFL) | O_NONBLOCK) < 0)
+    print_error("fcntl", errno);
+  chan_init(&chan, infifo, outfifo, text_proto);
 }
 
 // deploy phase 
 void deploy()
 {
-  int i, ch, p1_counter = 0, p2_counter = 0, status;
+  int waiting = 0;
+  nodelay(stdscr, TRUE);
   fill_line(stdscr, LINES-1, '=');
   wprintw_center(stdscr, LINES-1, " Ship deployment phase ");
   print_board();
   print_ships_left(P1);
   move_to_board(P1, BOARD_BEG_Y, BOARD_BEG_X);
   wmove(p1_board, BOARD_BEG_Y, BOARD_BEG_X);
+  if(resume_game())
+    // both fleets came back from the snapshot
+    ;
+  else if(preset == 'r')
+    do_deploy_ch('r');
+  else if(preset == 'f')
+    deploy_fleet(preset_fleet);
 
-  // loop for deploy phase
-  while(p1_counter < TOT_SHIP_CELL) {
-    ch = getch();
-    if((status = do_deploy_ch(ch)) == -2)
-      wrap_up();
-    else if(status == 0)
-      continue;
-    else if(status < 2)
-      p1_counter += status;
-    print_prompt("Please wait for opponent move.");
-    p2_counter += deploy_p2();
-    move_to_board(P1, BOARD_BEG_Y, BOARD_BEG_X);
-  }
-  // sort ship coordinates for later use
-  for(i = 0; i < SHIP_COUNT; i++) {
-    qsort(ships_p1[i].y, ships_p1[i].length, sizeof(int), intcmp);
-    qsort(ships_p1[i].x, ships_p1[i].length, sizeof(int), intcmp);
-    qsort(ships_p2[i].y, ships_p2[i].length, sizeof(int), intcmp);
-    qsort(ships_p2[i].x, ships_p2[i].length, sizeof(int), intcmp);
+  // loop for deploy phase, both sides deploy at their own pace
+  while(!engine_fleet_deployed(&game, P1) || !(referee ? opp_ready : engine_fleet_deployed(&game, P2))) {
+    if(!waiting && engine_fleet_deployed(&game, P1)) {
+      print_prompt("Please wait for opponent move.");
+      waiting = 1;
+    }
+    poll_events(deploy_key);
   }
+  gamelog_fleet(&glog, &game, P1, LOG_SIDE(P1));
+  gamelog_fleet(&glog, &game, P2, LOG_SIDE(P2));
   print_board();
   move_to_board(P1, BOARD_BEG_Y, BOARD_BEG_X);
-  fill_line(stdscr, LINES-3, ' ');
+  clear_prompt();
 }
 
-// read from pipe and deploy on opponent's board
-int deploy_p2()
+// wait for keyboard or opponent input and handle whatever arrived
+void poll_events(void (*on_key)(int))
 {
-  int x, x_i, y_i, i;
-  int err;
-  struct ship* s = 0;
-  char oldval, t, y;
-  char buffer[BUFFER_SIZE];
-  int ret_val = 1;
-  // read from pipe
-  if(read(infifo, buffer, BUFFER_SIZE) < 0)
-    print_error("read", errno);
-  // parse into variables
-  i = sscanf(buffer, "%c (%c,%d)", &t, &y, &x);
-  if(i != 3)
-    return 0;
-  s = get_ship_by_ch(P2, t);
-  x_i = col_num2index(x);
-  y_i = row_char2index(y);
-
-  // check if read values are valid
-  if((oldval = board_p2[y_i][x_i]) != '.')
-    ret_val = 0;
-  if ((err = check_ship_align(s, y_i + BOARD_BEG_Y, x_i * 2 + BOARD_BEG_X)) < 0)
-    return 0;
-  else if(!err)
-    return 0;
-  // change corresponding ship information
-  board_p2[y_i][x_i] = t;
-  s->x[s->num_cell_deployed] = x_i;
-  s->y[s->num_cell_deployed] = y_i;
-  s->num_cell_deployed++;
-  if(s->num_cell_deployed == s->length)
-    s->has_deployed = 1;
-  return ret_val;
+  struct pollfd fds[2] = { { 0, POLLIN, 0 }, { chan.rfd, POLLIN, 0 } };
+  struct msg m;
+  uint64_t t;
+  int r, ch, peer;
+  metrics_check();
+  // one screen update for everything since the last wait
+  restore_cursor();
+  t = metrics_start();
+  metrics_count(MC_POLLS, 1);
+  if(!ai && chan.shm) {
+    // the futex wakes for a message, or for a key from watch_keys()
+    while(!(r = poll(fds, 1, 0)) && !shm_ready(&shm))
+      shm_wait(&shm, -1);
+  }
+  else
+    r = poll(fds, ai ? 1 : 2, -1);
+  if(r < 0) {
+    if(errno == EINTR)
+      return;
+    print_error("poll", errno);
+  }
+  metrics_stop(MT_WAIT, t);
+  peer = !ai && (chan.shm ? shm_ready(&shm) : fds[1].revents);
+  // opponent channel: take every whole message the read brought in
+  if(peer) {
+    if((r = chan_fill(&chan)) == 0)
+      print_error("read", EPIPE);
+    else if(r < 0 && errno != EAGAIN && errno != EINTR && errno != EPROTO)
+      print_error("read", errno);
+    while((r = chan_next(&chan, &m)) != 0)
+      if(r > 0)
+        handle_msg(&m);
+  }
+  // keyboard: drain everything curses has
+  if(fds[0].revents) {
+    while((ch = getch()) != ERR) {
+      metrics_count(MC_KEYS, 1);
+      on_key(ch);
+    }
+    if(!ai && chan.shm)
+      sem_post(&keys_taken);
+  }
+}
+
+// apply one message from the opponent
+void handle_msg(struct msg* m)
+{
+  if(m->type == MSG_RESUME)
+    resume_at(m->ship);
+  else if(m->type == MSG_DEPLOY || m->type == MSG_ERASE || m->type == MSG_FLEET)
+    deploy_p2(m);
+  else if(m->type == MSG_READY)
+    opp_ready = 1;
+  else if(m->type == MSG_RESULT)
+    shot_result(m);
+  else if((m->type == MSG_ATTACK || m->type == MSG_INCOMING) && engine_fleet_deployed(&game, P1) &&
+          attack_p2(m) > 0)
+    shots_taken++;
+}
+
+// deploy on opponent's board
+int deploy_p2(struct msg* m)
+{
+  uint64_t t = metrics_start();
+  int ok;
+  // the engine rejects cells that are taken or not aligned
+  ok = proto_deploy(&game, P2, m);
+  metrics_stop(MT_RULES, t);
+  return ok;
+}
+
+// keyboard during deploy phase
+void deploy_key(int ch)
+{
+  if(engine_fleet_deployed(&game, P1) && ch != 'q' && ch != 'Q')
+    return;
+  if(do_deploy_ch(ch) == -2)
+    wrap_up();
 }
 
 // player control placement
@@ -295,7 +447,7 @@ int do_deploy_ch(int ch)
     case 'H':
     case 'h':
       // help message
-      print_attack_help();
+      print_deploy_help();
       return 0;
     case 'A':
     case 'B':
@@ -308,13 +460,36 @@ int do_deploy_ch(int ch)
     case 's':
     case 'm':
       // place ship
-      fill_line(stdscr, LINES-3, ' ');
+      clear_prompt();
       return deploy_ship(toupper((char)ch), y, x);
+    case 'R':
+    case 'r':
+      // a random fleet, in one message
+      {
+        struct game g;
+        struct rng r;
+        unsigned char fleet[SHIP_COUNT];
+        if(game.side[P1].cells_deployed) {
+          print_prompt("A random fleet only goes on an empty board.");
+          move_to_board(P1, y, x);
+          return 0;
+        }
+        rng_seed(&r, time(0) ^ getpid());
+        engine_init(&g);
+        engine_random_fleet(&g, P1, &r);
+        engine_fleet_layout(&g, P1, fleet);
+        clear_prompt();
+        deploy_fleet(fleet);
+        wmove(p1_board, y, x);
+        move_to_board(P1, y, x);
+        return 1;
+      }
     case 'C':
     case 'c':
-      // clear current cell. not working very well.
-      fill_line(stdscr, LINES-3, ' ');
-      erase_cell(y, x);
+      // clear current cell, on the opponent's copy too
+      clear_prompt();
+      if(engine_erase_cell(&game, P1, y - BOARD_BEG_Y, (x - BOARD_BEG_X) / 2))
+        send_p2(MSG_ERASE, NO_SHIP, y - BOARD_BEG_Y, (x - BOARD_BEG_X) / 2);
       print_board();
       print_ships_left(P1);
       wmove(p1_board, y, x);
@@ -327,7 +502,7 @@ int do_deploy_ch(int ch)
         move_to_board(P1, y, x);
         return 0;
       }
-      fill_line(stdscr, LINES-3, ' ');
+      clear_prompt();
       move_to_board(P1, y, x - 2);
       wmove(p1_board, y, x - 2);
       return 0;
@@ -338,7 +513,7 @@ int do_deploy_ch(int ch)
         move_to_board(P1, y, x);
         return 0;
       }
-      fill_line(stdscr, LINES-3, ' ');
+      clear_prompt();
       move_to_board(P1, y, x + 2);
       wmove(p1_board, y, x + 2);
       return 0;
@@ -349,7 +524,7 @@ int do_deploy_ch(int ch)
         move_to_board(P1, y, x);
         return 0;
       }
-      fill_line(stdscr, LINES-3, ' ');
+      clear_prompt();
       move_to_board(P1, y - 1, x);
       wmove(p1_board, y - 1, x);
       return 0;
@@ -360,7 +535,7 @@ int do_deploy_ch(int ch)
         move_to_board(P1, y, x);
         return 0;
       }
-      fill_line(stdscr, LINES-3, ' ');
+      clear_prompt();
       move_to_board(P1, y + 1, x);
       wmove(p1_board, y + 1, x);
       return 0;
@@ -373,39 +548,38 @@ int do_deploy_ch(int ch)
 int deploy_ship(char ch, int y, int x)
 {
   int x_i = (x - BOARD_BEG_X) / 2, y_i = y - BOARD_BEG_Y;
-  int err;
-  struct ship* s = get_ship_by_ch(P1, ch);
-  char oldval = board_p1[y_i][x_i];
-  char buffer[BUFFER_SIZE];
+  int err, i, n, cells[MAX_SHIP_LEN];
   int ret_val = 1;
+  uint64_t t;
+  struct ship* s = engine_ship_at(&game, P1, y_i, x_i);
+  // the ship is already there, possibly laid down for the player
+  if(s && s->type[0] == ch)
+    return 0;
   // check cell validity
-  if(oldval != '.') {
-    erase_cell(y, x);
+  t = metrics_start();
+  // the opponent has the old cell, it has to go there too before the new one comes
+  if(engine_erase_cell(&game, P1, y_i, x_i)) {
+    send_p2(MSG_ERASE, NO_SHIP, y_i, x_i);
     ret_val = 2;
   }
-  if ((err = check_ship_align(s, y, x)) < 0) {
+  err = engine_deploy_cell(&game, P1, ch, y_i, x_i);
+  metrics_stop(MT_RULES, t);
+  if(err == DEPLOY_DONE) {
     print_prompt("This ship has already been deployed on gameboard.");
     move_to_board(P1, y, x);
     return 0;
   }
-  else if(!err) {
-    print_prompt("You must place ships on a straight line!");
+  else if(err == DEPLOY_BAD) {
+    print_prompt("Ships go on a straight line with room to finish them!");
     move_to_board(P1, y, x);
     return 0;
   }
-  // change ship information
-  board_p1[y_i][x_i] = (char)ch;
-  s->x[s->num_cell_deployed] = x_i;
-  s->y[s->num_cell_deployed] = y_i;
-  s->num_cell_deployed++;
-  if(s->num_cell_deployed == s->length) {
-    s->has_deployed = 1;
-    print_ships_left(P1);
-  }
   // write to pipe
-  snprintf(buffer, BUFFER_SIZE, "%c (%c,%d)\n", ch, row_index2char(y_i), col_index2num(x_i));
-  if(write(outfifo, buffer, strlen(buffer) + 1) < 0)
-    print_error("write", errno);
+  send_p2(MSG_DEPLOY, engine_ship_index(ch), y_i, x_i);
+  // only one way left to finish the ship, lay down the rest of it
+  n = engine_complete_ship(&game, P1, engine_ship_index(ch), cells);
+  for(i = 0; i < n; i++)
+    send_p2(MSG_DEPLOY, engine_ship_index(ch), cells[i] / BOARD_SIZE, cells[i] % BOARD_SIZE);
   print_board();
   print_ships_left(P1);
   wmove(p1_board, y, x);
@@ -413,10 +587,56 @@ int deploy_ship(char ch, int y, int x)
   return ret_val;
 }
 
+// deploy a whole fleet and send it as one message
+int deploy_fleet(const unsigned char* fleet)
+{
+  struct msg m = { MSG_FLEET, NO_SHIP, 0, 0, 0 };
+  if(!engine_place_fleet(&game, P1, fleet)) {
+    print_prompt("That fleet does not fit on the board.");
+    return 0;
+  }
+  memcpy(m.fleet, fleet, SHIP_COUNT);
+  if(!ai && chan_send(&chan, &m) < 0)
+    print_error("write", errno);
+  print_board();
+  print_ships_left(P1);
+  return 1;
+}
+
+// read a fleet layout file ("A A1 h" per ship, # comments), 0 or -1 after saying why
+int load_fleet(const char* path, unsigned char* fleet)
+{
+  char text[1024] = "", line[256];
+  struct game g;
+  FILE* f;
+  int n = 0;
+  if(!(f = fopen(path, "r"))) {
+    perror(path);
+    return -1;
+  }
+  while(fgets(line, sizeof(line), f)) {
+    line[strcspn(line, "#")] = '\0';
+    n += snprintf(text + n, sizeof(text) - n, "%s ", line);
+    if(n >= sizeof(text)) {
+      n = sizeof(text) - 1;
+      break;
+    }
+  }
+  fclose(f);
+  // legal on its own, so the opponent will take it too
+  engine_init(&g);
+  if(engine_parse_fleet(text, fleet) < 0 || !engine_place_fleet(&g, P1, fleet)) {
+    fprintf(stderr, "%s: not a legal fleet (one \"A A1 h\" line per ship, h or v, no overlaps)\n", path);
+    return -1;
+  }
+  return 0;
+}
+
 // attack phase
 void attack()
 {
-  int ch, counter = 0, status, w = 0;
+  int w = 0;
+  phase = P2;
   fill_line(stdscr, LINES-1, '=');
   wprintw_center(stdscr, LINES-1, " Attack phase ");
   print_board();
@@ -424,13 +644,16 @@ void attack()
   move_to_board(P2, BOARD_BEG_Y, BOARD_BEG_X);
   wmove(p2_board, BOARD_BEG_Y, BOARD_BEG_X);
   // mail loop for attack phase
-  while(((w = win()) == 0) && counter < TOT_ATK_CELL) {
-    ch = getch();
-    if((status = do_attack_ch(ch)) == -2)
-      wrap_up();
-    else if(status && attack_p2())
-      counter ++;
+  while((w = attack_over()) == 0) {
+    save_round();
+    poll_events(attack_key);
   }
+  nodelay(stdscr, FALSE);
+  // nothing left to resume
+  if(snap_path)
+    unlink(snap_path);
+  // the log names the winner by player number, not by board
+  gamelog_end(&glog, (w == 2 || w == 3) && player_id == 2 ? 5 - w : w);
   print_board();
   fill_line(stdscr, LINES-2, ' ');
   // find a winner
@@ -446,6 +669,7 @@ void attack()
       print_prompt("We have a tie here... Good luck next time!");
       break;
   }
+  restore_cursor();
   getch();
 }
 
@@ -468,7 +692,7 @@ int do_attack_ch(int ch)
       return 0;
     case ' ':
       // place bomb
-      fill_line(stdscr, LINES-3, ' ');
+      clear_prompt();
       return attack_cell(y, x);
     case KEY_LEFT:
       // left movement
@@ -477,7 +701,7 @@ int do_attack_ch(int ch)
         move_to_board(P2, y, x);
         return 0;
       }
-      fill_line(stdscr, LINES-3, ' ');
+      clear_prompt();
       move_to_board(P2, y, x - 2);
       wmove(p2_board, y, x - 2);
       return 0;
@@ -488,7 +712,7 @@ int do_attack_ch(int ch)
         move_to_board(P2, y, x);
         return 0;
       }
-      fill_line(stdscr, LINES-3, ' ');
+      clear_prompt();
       move_to_board(P2, y, x + 2);
       wmove(p2_board, y, x + 2);
       return 0;
@@ -499,7 +723,7 @@ int do_attack_ch(int ch)
         move_to_board(P2, y, x);
         return 0;
       }
-      fill_line(stdscr, LINES-3, ' ');
+      clear_prompt();
       move_to_board(P2, y - 1, x);
       wmove(p2_board, y - 1, x);
       return 0;
@@ -510,7 +734,7 @@ int do_attack_ch(int ch)
         move_to_board(P2, y, x);
         return 0;
       }
-      fill_line(stdscr, LINES-3, ' ');
+      clear_prompt();
       move_to_board(P2, y + 1, x);
       wmove(p2_board, y + 1, x);
       return 0;
@@ -519,129 +743,317 @@ int do_attack_ch(int ch)
   }
 }
 
-// read from pipe and place p2 attack
-int attack_p2()
+// keyboard during attack phase, one shot ahead of the opponent at most
+void attack_key(int ch)
 {
-  struct ship* s = 0;
-  char buffer[BUFFER_SIZE];
-  int i, x, x_i, y_i;
-  char y;
-  // read from pipe and parse into variables
-  if(read(infifo, buffer, BUFFER_SIZE) < 0)
-    print_error("read", errno);
-  while(buffer[0] == '#')
-    if(read(infifo, buffer, BUFFER_SIZE) < 0)
-      print_error("read", errno);
-  i = sscanf(buffer, "(%c,%d)",&y,&x);
-  if(i != 2) {
-    return -1;
+  int status;
+  if(ch == ' ' && shots_fired > shots_taken) {
+    print_prompt("Please wait for opponent move.");
+    restore_cursor();
+    return;
   }
-  x_i = col_num2index(x);
-  y_i = row_char2index(y);
-  // check validity
-  if(sank_p1[y_i][x_i] != '.') {
-    return 0;
+  if((status = do_attack_ch(ch)) == -2)
+    wrap_up();
+  else if(status > 0) {
+    shots_fired++;
+    if(ai && attack_ai() > 0)
+      shots_taken++;
   }
-  // miss
-  else if(board_p1[y_i][x_i] == '.') {
-    sank_p1[y_i][x_i] = 'O';
-    print_board();
-    move_to_board(P1, y_i + 2, x_i * 2 + 3);
+}
+
+// game result once both sides fired the same number of shots, 0 while it goes on
+int attack_over()
+{
+  int w;
+  // a refereed shot counts once its result is in
+  if(shots_fired != shots_taken || game.shots[P1] != shots_fired)
+    return 0;
+  if((w = engine_win(&game)) != 0)
+    return w;
+  return shots_fired >= TOT_ATK_CELL ? 1 : 0;
+}
+
+// place p2 attack
+int attack_p2(struct msg* m)
+{
+  int x_i, y_i, res;
+  uint64_t t = metrics_start();
+  x_i = m->col;
+  y_i = m->row;
+  // check validity, or take the referee's word for it
+  if(m->type == MSG_INCOMING)
+    res = engine_record(&game, P1, y_i, x_i, m->result, m->ship == NO_SHIP ? -1 : m->ship) ? m->result : SHOT_REPEAT;
+  else
+    res = engine_attack(&game, P1, y_i, x_i);
+  metrics_stop(MT_RULES, t);
+  if(res == SHOT_REPEAT)
+    return 0;
+  gamelog_shot(&glog, LOG_SIDE(P2), CELL(y_i, x_i), res);
+  // if a ship is sunk give output
+  if(res == SHOT_SUNK) {
+    char str[60];
+    strcpy(str, "The opponent sank our ");
+    strcat(str, engine_ship_at(&game, P1, y_i, x_i)->type);
+    print_prompt(str);
   }
-  // hit
+  print_board();
+  return 1;
+}
+
+// the referee's answer to one of our shots
+void shot_result(struct msg* m)
+{
+  char str[60];
+  int cell = CELL(m->row, m->col);
+  if(!(pending & bb_cell(cell)))
+    return;
+  pending &= ~bb_cell(cell);
+  engine_record(&game, P2, m->row, m->col, m->result, m->ship == NO_SHIP ? -1 : m->ship);
+  if(m->result == SHOT_MISS)
+    print_prompt("You did not hit anything.");
+  else if(m->result == SHOT_HIT)
+    print_prompt("You just hit an enemy's ship!");
   else {
-    s = get_ship_by_coord(P1,y_i,x_i);
-    int len = s->length;
-    int sunk = 1;
-    sank_p1[y_i][x_i] = 'X';
-    // sank any ship?
-    if(s->x[0] == s->x[len-1]) {
-      for(i = s->y[0]; i <= s->y[len-1]; i++) {
-        if(sank_p1[i][s->x[0]] != 'X')
-          sunk = 0;
-      }
-    }
-    else {
-      for(i = s->x[0]; i <= s->x[len-1]; i++) {
-        if(sank_p1[s->y[0]][i] != 'X')
-          sunk = 0;
-      }
-    }
-    // if a ship is sunk give output and change corresponding ship state
-    if(sunk) {
-      char str[60];
-      strcpy(str, "The opponent sank our ");
-      strcat(str, s->type);
-      print_prompt(str);
-      s->is_sunk = 1;
-    }
-    print_board();
-    move_to_board(P1, y_i + 2, x_i * 2 + 3);
+    strcpy(str, "You sank opponent's ");
+    strcat(str, ship_types[m->ship]);
+    print_prompt(str);
   }
-  
+  gamelog_shot(&glog, LOG_SIDE(P1), cell, m->result);
+  print_board();
+  print_ships_left(P2);
+}
+
+// computer opponent bombs the player's board
+int attack_ai()
+{
+  int cell, res;
+  if((res = strategy_fire(ai, ai_state, &game, P1, &cell)) == SHOT_REPEAT)
+    return 0;
+  gamelog_shot(&glog, LOG_SIDE(P2), cell, res);
+  // if a ship is sunk give output
+  if(res == SHOT_SUNK) {
+    char str[60];
+    strcpy(str, "The computer sank our ");
+    strcat(str, engine_ship_at(&game, P1, cell / BOARD_SIZE, cell % BOARD_SIZE)->type);
+    print_prompt(str);
+  }
+  print_board();
   return 1;
 }
 
+// send a move to the opponent, unless it is the computer
+void send_p2(int type, int ship, int y_i, int x_i)
+{
+  struct msg m = { type, ship, y_i, x_i, 0 };
+  if(ai)
+    return;
+  if(chan_send(&chan, &m) < 0)
+    print_error("write", errno);
+}
+
+// pick up the snapshotted game if both sides have it, return 0 to play a new one
+int resume_game()
+{
+  struct msg m = { MSG_RESUME, SNAP_NONE, 0, 0, 0 };
+  if(snap_fd < 0)
+    return 0;
+  if(ai) {
+    resume_at(snap_round < 0 ? SNAP_NONE : snap_round);
+    return snap_round >= 0;
+  }
+  // both sides say where they are, even with nothing to resume
+  if(snap_round >= 0)
+    m.ship = snap_round;
+  if(chan_send(&chan, &m) < 0)
+    print_error("write", errno);
+  if(snap_round < 0) {
+    resume_at(SNAP_NONE);
+    return 0;
+  }
+  print_prompt("Waiting for the opponent to resume the game...");
+  while(peer_round < 0)
+    poll_events(resume_key);
+  clear_prompt();
+  return snap_round >= 0;
+}
+
+// restore the round both sides have, or start afresh if the opponent has none
+void resume_at(int round)
+{
+  struct snapshot s;
+  // only the first one counts, a fresh opponent can see ours during deploy
+  if(snap_fd < 0 || peer_round >= 0)
+    return;
+  peer_round = round;
+  if(round == SNAP_NONE || snap_round < 0) {
+    snap_round = -1;
+    if(ftruncate(snap_fd, 0) < 0)
+      print_error("ftruncate", errno);
+    return;
+  }
+  // at most a round apart: the side ahead steps back to its other slot
+  if(round > snap_round)
+    round = snap_round;
+  if(snapshot_load(snap_fd, round, &s) < 0 || !snapshot_restore(&s, &game))
+    print_error("snapshot", EINVAL);
+  snap_round = saved_round = shots_fired = shots_taken = round;
+  if(ai) {
+    ai->reset(ai_state, &ai_rng);
+    strategy_replay(ai, ai_state, &game, P1);
+  }
+}
+
+// keyboard while waiting for the opponent to resume
+void resume_key(int ch)
+{
+  if(ch == 'q' || ch == 'Q')
+    wrap_up();
+}
+
+// snapshot the game when a round is complete
+void save_round()
+{
+  struct snapshot s;
+  int i;
+  if(snap_fd < 0 || shots_fired != shots_taken || shots_fired == saved_round)
+    return;
+  for(i = 0; ai && strategies[i] != ai; i++)
+    ;
+  if(snapshot_take(&s, &game, player_id, ai ? i + 1 : 0) && snapshot_save(snap_fd, &s) < 0)
+    print_error("snapshot", errno);
+  saved_round = shots_fired;
+}
+
+// meet the other player in the shared memory region, player 1 makes it
+void join_shm(char ch)
+{
+  struct sigaction sa, old;
+  int r;
+  infifo = outfifo = -1;
+  if(ch != '1' && ch != '2') {
+    print_prompt("Unrecognized input. Game will now exit.");
+    doupdate();
+    getch();
+    wrap_up();
+  }
+  player_id = ch - '0';
+  print_prompt(player_id == 1 ? "Waiting for player 2 to join... (q to quit)" :
+                                 "Waiting for player 1 to join... (q to quit)");
+  doupdate();
+  // q or ^C gives up the wait, and player 1's region with it
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_join_signal;
+  sigaction(SIGINT, &sa, &old);
+  nodelay(stdscr, TRUE);
+  r = shm_link_open(&shm, shm_name, player_id - 1, join_cancelled);
+  nodelay(stdscr, FALSE);
+  sigaction(SIGINT, &old, 0);
+  if(r < 0 && errno == ECANCELED)
+    wrap_up();
+  if(r < 0)
+    print_error("shm_open", errno);
+  chan_init_shm(&chan, &shm, text_proto);
+  // poll() cannot watch the futex, so keys get a thread of their own
+  if(sem_init(&keys_taken, 0, 0) < 0)
+    print_error("sem_init", errno);
+  if((errno = pthread_create(&key_thread, 0, watch_keys, 0)))
+    print_error("pthread_create", errno);
+}
+
+// asked by shm_link_open() while it waits for the other player
+int join_cancelled()
+{
+  int ch;
+  while((ch = getch()) != ERR)
+    if(ch == 'q' || ch == 'Q')
+      return 1;
+  return join_interrupted;
+}
+
+void on_join_signal(int sig)
+{
+  join_interrupted = 1;
+}
+
+// wake the event loop out of shm_wait() whenever keys come in, then wait until it read them
+void* watch_keys(void* arg)
+{
+  struct pollfd pfd = { 0, POLLIN, 0 };
+  for(;;) {
+    if(poll(&pfd, 1, -1) <= 0)
+      continue;
+    shm_kick(&shm);
+    while(sem_wait(&keys_taken) < 0)
+      ;
+  }
+  return 0;
+}
+
+// connect to battleship-server and wait until it finds an opponent
+void join_server(const char* server)
+{
+  struct msg m = { 0 };
+  int fd, r;
+  print_prompt("Waiting for an opponent...");
+  doupdate();
+  if((fd = net_connect(server)) < 0)
+    print_error("connect", errno);
+  // a closed connection shows up as EOF on read, not as a signal
+  signal(SIGPIPE, SIG_IGN);
+  chan_init(&chan, fd, fd, text_proto);
+  while((r = chan_recv(&chan, &m)) < 0 || m.type != MSG_START)
+    if(r == 0 || (r < 0 && errno != EPROTO))
+      print_error("read", r ? errno : EPIPE);
+  player_id = m.ship;
+  referee = m.row == START_REFEREE;
+  infifo = outfifo = fd;
+  if(net_nonblock(fd) < 0)
+    print_error("fcntl", errno);
+}
+
 // player place attak
 int attack_cell(int y, int x)
 {
-  int i;
   int x_i = (x - BOARD_BEG_X) / 2, y_i = y - BOARD_BEG_Y;
-  struct ship* s = get_ship_by_coord(P2, y, x);
-  char buffer[BUFFER_SIZE];
-  // check validity
-  if(sank_p2[y_i][x_i] != '.') {
+  int res;
+  uint64_t t = metrics_start();
+  // check validity; the referee resolves it and answers with a MSG_RESULT
+  if(referee)
+    res = (engine_unshot(&game, P2) & ~pending & bb_cell(CELL(y_i, x_i))) ? SHOT_MISS : SHOT_REPEAT;
+  else
+    res = engine_attack(&game, P2, y_i, x_i);
+  metrics_stop(MT_RULES, t);
+  if(res == SHOT_REPEAT) {
     print_prompt("This cell has already been bombarded.");
     move_to_board(P2, y, x);
     wmove(p1_board, y, x);
     return 0;
   }
+  if(referee) {
+    pending |= bb_cell(CELL(y_i, x_i));
+    send_p2(MSG_ATTACK, NO_SHIP, y_i, x_i);
+    return 1;
+  }
   // miss
-  else if(board_p2[y_i][x_i] == '.') {
+  else if(res == SHOT_MISS)
     print_prompt("You did not hit anything.");
-    sank_p2[y_i][x_i] = 'O';
-    print_board();
-    print_ships_left(P2);
-    move_to_board(P2, y, x);
-    wmove(p1_board, y, x);
-  }
   // hit
-  else {
-    s = get_ship_by_coord(P2,y_i,x_i);
-    int len = s->length;
+  else if(res == SHOT_HIT)
     print_prompt("You just hit an enemy's ship!");
-    int sunk = 1;
-    sank_p2[y_i][x_i] = 'X';
-    // sank any ship?
-    if(s->x[0] == s->x[len-1]) {
-      for(i = s->y[0]; i <= s->y[len-1]; i++) {
-        if(sank_p2[i][x_i] != 'X')
-          sunk = 0;
-      }
-    }
-    else {
-      for(i = s->x[0]; i <= s->x[len-1]; i++) {
-        if(sank_p2[y_i][i] != 'X')
-          sunk = 0;
-      }
-    }
-    // if a ship is sunk give output and change state
-    if(sunk) {
-      char str[60];
-      strcpy(str, "You sank opponent's ");
-      strcat(str, s->type);
-      print_prompt(str);
-      s->is_sunk = 1;
-    }
-    print_board();
-    print_ships_left(P2);
-    move_to_board(P2, y, x);
-    wmove(p1_board, y, x);
+  // if a ship is sunk give output
+  else {
+    char str[60];
+    strcpy(str, "You sank opponent's ");
+    strcat(str, engine_ship_at(&game, P2, y_i, x_i)->type);
+    print_prompt(str);
   }
+  gamelog_shot(&glog, LOG_SIDE(P1), CELL(y_i, x_i), res);
+  print_board();
+  print_ships_left(P2);
+  move_to_board(P2, y, x);
+  wmove(p1_board, y, x);
   // write to pipe
-  snprintf(buffer, BUFFER_SIZE, "(%c,%d)\n", row_index2char(y_i), col_index2num(x_i));
-  if(write(outfifo, buffer, strlen(buffer) + 1) < 0)
-    print_error("write", errno);
+  send_p2(MSG_ATTACK, NO_SHIP, y_i, x_i);
   return 1;
 }
 
@@ -649,34 +1061,19 @@ int attack_cell(int y, int x)
 // program closing
 void wrap_up()
 {
+  gamelog_close(&glog);
   close(infifo);
   close(outfifo);
+  shm_link_close(&shm);
   erase();
   refresh();
-  endwin();
+  term_close();
+  render_report();
+  metrics_dump("exit");
 
   exit(0);
 }
 
-// determine if anyone wins
-int win()
-{
-  int i, p1_all_sunk = 1, p2_all_sunk = 1;
-  for(i = 0; i < SHIP_COUNT; i++) {
-    if(ships_p1[i].is_sunk <= 0)
-      p1_all_sunk = 0;
-    if(ships_p2[i].is_sunk <= 0)
-      p2_all_sunk = 0;
-  }
-  if(p1_all_sunk && p2_all_sunk)
-    return 1;
-  else if(p2_all_sunk)
-    return 2;
-  else if(p1_all_sunk)
-    return 3;
-  return 0;
-}
-
 // move cursor to somewhere on a player's board
 void move_to_board(int mode, int y, int x)
 {
@@ -685,10 +1082,25 @@ void move_to_board(int mode, int y, int x)
   move(begy + y, begx + x);
 }
 
+// put the screen cursor back on the board being played
+void restore_cursor()
+{
+  int y, x;
+  getyx(phase == P1 ? p1_board : p2_board, y, x);
+  uint64_t t;
+  move_to_board(phase, y, x);
+  wnoutrefresh(stdscr);
+  t = metrics_start();
+  doupdate();
+  metrics_stop(MT_DRAW, t);
+  metrics_count(MC_REDRAWS, 1);
+  render_mark();
+}
+
 // print a help message
 void print_deploy_help()
 {
-  print_prompt("Press corresponding key to deploy, q to quit game");
+  print_prompt("Press corresponding key to deploy, r for a random fleet, q to quit game");
 }
 
 // print a help message
@@ -702,32 +1114,66 @@ void print_prompt(char* msg)
 {
   fill_line(stdscr, LINES-3, ' ');
   wprintw_center(stdscr, LINES-3, msg);
-  refresh();
+  prompt_shown = 1;
+}
+
+// blank the prompt line, unless it already is
+void clear_prompt()
+{
+  if(!prompt_shown)
+    return;
+  fill_line(stdscr, LINES-3, ' ');
+  prompt_shown = 0;
 }
 
-// print game board
+// print game board, only the cells that changed since the last call
 void print_board() {
-  int i, j;
-  mvwprintw(p1_board, 1, 1, "  1 2 3 4 5 6 7 8 9 0");
-  for(i = 0; i < BOARD_SIZE; i++) {
-    wmove(p1_board, 2 + i, 1);
-    wprintw(p1_board, "%c ", row_index2char(i));
-    for(j = 0; j < BOARD_SIZE; j++) {
-      wprintw(p1_board, "%c ", (sank_p1[i][j] == '.') ? board_p1[i][j] : sank_p1[i][j]);
-    }
+  print_cells(P1);
+  print_cells(P2);
+}
+
+// repaint the changed cells of one board window
+void print_cells(int mode)
+{
+  WINDOW* w = (mode == P1) ? p1_board : p2_board;
+  struct side* sd = &game.side[mode];
+  struct board_view* v = &shown[mode];
+  bitboard dirty = (sd->hits ^ v->hits) | (sd->misses ^ v->misses);
+  int i, cell, y, x;
+  if(mode == P1)
+    for(i = 0; i < SHIP_COUNT; i++)
+      dirty |= sd->ship_mask[i] ^ v->ship_mask[i];
+  // the window cursor is the player's cursor, keep it where it was
+  getyx(w, y, x);
+  if(!v->drawn) {
+    mvwprintw(w, 1, 1, "  1 2 3 4 5 6 7 8 9 0");
+    for(i = 0; i < BOARD_SIZE; i++)
+      mvwaddch(w, BOARD_BEG_Y + i, 1, row_index2char(i));
+    dirty = BB_BOARD;
+    v->drawn = 1;
   }
-  wrefresh(p1_board);
-  mvwprintw(p2_board, 1, 1, "  1 2 3 4 5 6 7 8 9 0");
-  for(i = 0; i < BOARD_SIZE; i++) {
-    wmove(p2_board, 2 + i, 1);
-    wprintw(p2_board, "%c ", row_index2char(i));
-    for(j = 0; j < BOARD_SIZE; j++) {
-//      switch in this line to see opponent's board
-//      wprintw(p2_board, "%c ", (sank_p2[i][j] == '.') ? board_p2[i][j] : sank_p2[i][j]);
-       wprintw(p2_board, "%c ", sank_p2[i][j]);
-    }
+  if(!dirty)
+    return;
+  while(dirty) {
+    cell = bb_pop(&dirty);
+    mvwaddch(w, BOARD_BEG_Y + cell / BOARD_SIZE, BOARD_BEG_X + 2 * (cell % BOARD_SIZE),
+             cell_ch(mode, cell / BOARD_SIZE, cell % BOARD_SIZE));
   }
-  wrefresh(p2_board);
+  memcpy(v->ship_mask, sd->ship_mask, sizeof(v->ship_mask));
+  v->hits = sd->hits;
+  v->misses = sd->misses;
+  wmove(w, y, x);
+  wnoutrefresh(w);
+}
+
+// character shown for a cell of a board
+char cell_ch(int mode, int y_i, int x_i)
+{
+  char shot = engine_shot_ch(&game, mode, y_i, x_i);
+  // drop the mode check to see opponent's board
+  if(shot == '.' && mode == P1)
+    return engine_board_ch(&game, mode, y_i, x_i);
+  return shot;
 }
 
 // helper method to print which ships are left
@@ -738,8 +1184,8 @@ void print_ships_left(int mode)
   if(mode == P1) {
     strcpy(str, "Ships left for deployment:");
     for(i = 0; i < SHIP_COUNT; i++) {
-      if(!ships_p1[i].has_deployed) {
-        char t[3] = {' ', ships_p1[i].type[0], '\0'};
+      if(!game.side[P1].ships[i].has_deployed) {
+        char t[3] = {' ', game.side[P1].ships[i].type[0], '\0'};
         strcat(str, t);
       }
     }
@@ -747,92 +1193,30 @@ void print_ships_left(int mode)
   else {
     strcpy(str, "Opponent's ships left:");
     for(i = 0; i < SHIP_COUNT; i++) {
-      if(ships_p2[i].is_sunk <= 0) {
-        char t[3] = {' ', ships_p2[i].type[0], '\0'};
+      if(game.side[P2].ships[i].is_sunk <= 0) {
+        char t[3] = {' ', game.side[P2].ships[i].type[0], '\0'};
         strcat(str, t);
       }
     }
   }
   fill_line(stdscr, LINES-2, ' ');
   wprintw_center(stdscr, LINES-2, str);
-  refresh();
 }
 
 // bug out with error message
 void print_error(char* error_func, int error_num) {
+  gamelog_close(&glog);
   close(infifo);
   close(outfifo);
+  shm_link_close(&shm);
   erase();
   refresh();
-  endwin();
+  term_close();
+  metrics_dump(error_func);
   printf("%s error: %s\n", error_func, strerror(error_num));
   exit(-1);
 }
 
-// return reference to a ship with given char
-struct ship* get_ship_by_ch(int mode, char ch)
-{
-  struct ship* s = 0;
-  switch(ch) {
-    case 'A':
-      if(mode == P1)
-        s = &ships_p1[A];
-      else
-        s = &ships_p2[A];
-      break;
-    case 'B':
-      if(mode == P1)
-        s = &ships_p1[B];
-      else
-        s = &ships_p2[B];
-      break;
-    case 'F':
-      if(mode == P1)
-        s = &ships_p1[F];
-      else
-        s = &ships_p2[F];
-      break;
-    case 'S':
-      if(mode == P1)
-        s = &ships_p1[S];
-      else
-        s = &ships_p2[S];
-      break;
-    case 'M':
-      if(mode == P1)
-        s = &ships_p1[M];
-      else
-        s = &ships_p2[M];
-      break;
-    default:
-      break;
-  }
-  return s;
-}
-
-// return reference to a ship with given mode and coordinate
-struct ship* get_ship_by_coord(int mode, int y_i, int x_i)
-{
-  struct ship* s = 0;
-  if (mode == P1)
-    s = get_ship_by_ch(mode, board_p1[y_i][x_i]);
-  else
-    s = get_ship_by_ch(mode, board_p2[y_i][x_i]);
-  return s;
-}
-
-// erase a cell in deployment phase, ignore for now
-void erase_cell(int y, int x)
-{
-  int y_i = y - BOARD_BEG_Y, x_i = (x - BOARD_BEG_X) / 2;
-  if(board_p1[y_i][x_i] != '.') {
-    struct ship* s = get_ship_by_ch(P1, board_p1[y_i][x_i]);
-    s->num_cell_deployed--;
-    s->has_deployed = 0;
-    board_p1[y_i][x_i] = '.';
-  }
-}
-
 // create window for game board
 void create_board(int starty, int startx)
 {
@@ -842,8 +1226,8 @@ void create_board(int starty, int startx)
   box(p2_board, 0, 0);
   wprintw_center(p1_board, 0, " Player ");
   wprintw_center(p2_board, 0, " Opponent ");
-  wrefresh(p1_board);
-  wrefresh(p2_board);
+  wnoutrefresh(p1_board);
+  wnoutrefresh(p2_board);
 }
 
 // print a centered line
@@ -855,78 +1239,114 @@ void wprintw_center(WINDOW* currw, int wline, char* str)
   getmaxyx(currw, maxy, maxx);
   int startx = (maxx - len) / 2;
   mvwprintw(currw, wline, startx, str);
-  wrefresh(currw);
+  wnoutrefresh(currw);
 }
 
 // fill a line with given char
 void fill_line(WINDOW* currw, int wline, char ch)
 {
-  int i, len, __unused y;
+  int len, y;
+  (void) y;
   getmaxyx(stdscr, y, len);
-  char str[2] = {ch, '\0'};
-  wmove(currw, wline, 0);
-  for(i = 0; i < len; i++)
-    wprintw(currw, str);
-  wrefresh(currw);
+  mvwhline(currw, wline, 0, ch, len);
+  wnoutrefresh(currw);
 }
 
-// compare two ints. used by qsort.
-int intcmp (const void * ptr1, const void * ptr2)
+// charge the output since the last update to the moves made since then
+void render_mark()
 {
-  int i1 = *((int*)ptr1);
-  int i2 = *((int*)ptr2);
-  return (i1 - i2);
+  long moves = game.side[P1].cells_deployed + game.side[P2].cells_deployed +
+               game.shots[P1] + game.shots[P2];
+  long total = term_drain(), bytes = total - mark_bytes;
+  if(moves != mark_moves) {
+    move_bytes += bytes;
+    move_frames += moves > mark_moves ? moves - mark_moves : mark_moves - moves;
+    if(bytes > move_max)
+      move_max = bytes;
+  }
+  mark_bytes = total;
+  mark_moves = moves;
 }
 
-// check if given x&y is aligned and adjacent with deployed cells
-int check_ship_align(struct ship* s, int y, int x)
+// print the terminal output totals if asked for
+void render_report()
 {
-  int y_i = y - BOARD_BEG_Y, x_i = (x - BOARD_BEG_X) / 2;
-  int num = s->num_cell_deployed;
-  int x_lstep = 0, y_lstep = 0, x_rstep = 0, y_rstep = 0;
-  if(s->has_deployed)
-    return -1;
-  if(num < 1)
-    return 1;
-  else if(num < 2) {
-    if(y_i == s->y[0] && (x_i == s->x[0] - 1 || x_i == s->x[0] + 1))
-      return 1;
-    if(x_i == s->x[0] && (y_i == s->y[0] - 1 || y_i == s->y[0] + 1))
-      return 1;
-    return 0;
-  }
-  qsort(s->y, num, sizeof(int), intcmp);
-  qsort(s->x, num, sizeof(int), intcmp);
-  x_lstep = s->x[1] - s->x[0];
-  y_lstep = s->y[1] - s->y[0];
-  x_rstep = s->x[num-2] - s->x[num-1];
-  y_rstep = s->y[num-2] - s->y[num-1];
-  if((s->y[0] - y_i == y_lstep && s->x[0] - x_i == x_lstep) || 
-     (s->y[num-1] - y_i == y_rstep && s->x[num-1] - x_i == x_rstep))
-    return 1;
-  return 0;
+  if(!render_stats)
+    return;
+  printf("terminal bytes:   %ld\n", term_drain());
+  printf("moves:            %ld\n", move_frames);
+  printf("bytes/move:       %.1f\n", move_frames ? (double)move_bytes / move_frames : 0.0);
+  printf("max bytes/update: %ld\n", move_max);
 }
 
-// convert row board letter to array index
-int row_char2index(char c)
+// start curses; to count its bytes, have it write into a pipe that a thread drains
+// to the terminal. The modes are set while curses still has the terminal itself,
+// as it sets them on its output descriptor.
+void term_open()
 {
-  return (int)(c - 'A');
+  pthread_t t;
+  FILE* out;
+  int fd, p[2];
+  if(!render_stats && !metrics_on) {
+    initscr();
+    crmode();
+    noecho();
+    return;
+  }
+  tcgetattr(STDIN_FILENO, &term_saved);
+  if((fd = dup(STDOUT_FILENO)) < 0 || !(out = fdopen(fd, "w")) || !newterm(0, out, stdin) ||
+     pipe(p) < 0) {
+    perror("terminal");
+    exit(-1);
+  }
+  crmode();
+  noecho();
+  dup2(p[1], fd);
+  close(p[1]);
+  fcntl(p[0], F_SETFL, O_NONBLOCK);
+  term_pipe = p[0];
+  pthread_create(&t, 0, term_relay, 0);
+  pthread_detach(t);
 }
 
-// convert row array index to board letter
-char row_index2char(int i)
+// leave curses and, if it went through the pipe, put the terminal modes back by hand
+void term_close()
 {
-  return (char)(i + 'A');
+  endwin();
+  if(term_pipe < 0)
+    return;
+  term_drain();
+  tcsetattr(STDIN_FILENO, TCSADRAIN, &term_saved);
 }
 
-// convert column board number to array index
-int col_num2index(int i)
+// pass curses' output on as it comes
+void* term_relay(void* arg)
 {
-  return (i == 0) ? 9 : i - 1;
+  struct pollfd pfd = { term_pipe, POLLIN, 0 };
+  for(;;) {
+    if(poll(&pfd, 1, -1) < 0 && errno != EINTR)
+      return 0;
+    term_drain();
+  }
 }
 
-// convert column array index to board number
-int col_index2num(int i)
+// copy whatever curses has written to the terminal; return the bytes so far
+long term_drain()
 {
-  return (i == 9) ? 0 : i + 1;
+  char buf[4096];
+  long total;
+  int n, k, w;
+  if(term_pipe < 0)
+    return term_bytes;
+  pthread_mutex_lock(&term_lock);
+  while((n = read(term_pipe, buf, sizeof(buf))) > 0) {
+    term_bytes += n;
+    metrics_count(MC_TERM_BYTES, n);
+    for(k = 0; k < n; k += w > 0 ? w : 0)
+      if((w = write(STDOUT_FILENO, buf + k, n - k)) < 0 && errno != EINTR)
+        break;
+  }
+  total = term_bytes;
+  pthread_mutex_unlock(&term_lock);
+  return total;
 }
@@ -0,0 +1,703 @@
+/******************************************************
+ * Description: Microbenchmarks for the hot paths:
+ *   shot resolution (one game and a batch of games),
+ *   sink and win detection, placement
+ *   validation, frame encode/decode, message round
+ *   trips to another process over a pipe and over the
+ *   shared-memory rings, snapshots, packed game records,
+ *   endgame solving and whole games.
+ *   Each benchmark runs with a doubling op count until
+ *   it takes long enough to time, then prints one line
+ *   in the Go benchmark format
+ *     BenchmarkName  ops  ns/op  ops/sec  allocs/op  B/op
+ *   so runs from different commits can be compared with
+ *   a diff, a spreadsheet or benchstat.
+ ******************************************************/
+
+// memfd_create
+#define _GNU_SOURCE
+
+#include <regex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "endgame.h"
+#include "engine.h"
+#include "pack.h"
+#include "proto.h"
+#include "rng.h"
+#include "sampler.h"
+#include "shm.h"
+#include "snapshot.h"
+#include "strategy.h"
+#include "timer.h"
+
+// positions prepared for a benchmark, cycled through by the loop
+#define SETUPS 1024
+
+struct bench {
+  const char* name;
+  void (*setup)();
+  void (*run)(long);
+};
+
+void bench_run(const struct bench*, double);
+void setup_game();
+void setup_align();
+void run_attack(long);
+void run_sink(long);
+void setup_batch();
+void run_batch_attack(long);
+void run_win(long);
+void run_align(long);
+void run_deploy(long);
+void run_fleet(long);
+void run_encode(long);
+void setup_snapshot();
+void run_snap_take(long);
+void run_snap_restore(long);
+void run_pack(long);
+void run_unpack(long);
+void run_decode(long);
+void run_decode_text(long);
+void run_round_trip(long, int);
+void run_round_trip_pipe(long);
+void run_round_trip_shm(long);
+void run_games(long, const struct strategy*);
+void run_game_random(long);
+void run_game_density(long);
+void run_game_hunt(long);
+void run_hunt_shoot(long);
+void run_sampler(long);
+void setup_endgame();
+void run_endgame(long);
+void* __libc_malloc(size_t);
+void* __libc_calloc(size_t, size_t);
+void* __libc_realloc(void*, size_t);
+
+
+// global vars
+const struct bench benches[] = {
+  { "Attack", setup_game, run_attack },
+  { "Sink", setup_game, run_sink },
+  { "BatchAttack", setup_batch, run_batch_attack },
+  { "Win", setup_game, run_win },
+  { "CheckAlign", setup_align, run_align },
+  { "DeployCell", setup_game, run_deploy },
+  { "PlaceFleet", setup_game, run_fleet },
+  { "Encode", 0, run_encode },
+  { "Decode", 0, run_decode },
+  { "DecodeText", 0, run_decode_text },
+  { "RoundTripPipe", 0, run_round_trip_pipe },
+  { "RoundTripShm", 0, run_round_trip_shm },
+  { "SnapshotTake", setup_snapshot, run_snap_take },
+  { "SnapshotRestore", setup_snapshot, run_snap_restore },
+  { "PackGame", setup_snapshot, run_pack },
+  { "UnpackGame", setup_snapshot, run_unpack },
+  { "GameRandom", 0, run_game_random },
+  { "GameDensity", 0, run_game_density },
+  { "GameHunt", 0, run_game_hunt },
+  { "HuntShoot", setup_game, run_hunt_shoot },
+  { "SamplerNext", setup_game, run_sampler },
+  { "EndgameSolve", setup_endgame, run_endgame },
+  { 0, 0, 0 }
+};
+struct game games[SETUPS];
+unsigned char fleets[SETUPS][SHIP_COUNT];
+unsigned char cells[SETUPS][TOT_ATK_CELL];     // every cell, shuffled
+struct snapshot snaps[SETUPS];
+struct game_pack packs[SETUPS];
+struct sample_knowledge endgames[SETUPS];
+struct batch batches[SETUPS / BATCH_LANES];
+unsigned char volleys[SETUPS / BATCH_LANES][TOT_ATK_CELL][BATCH_LANES];  // cells[] by batch, shot and lane
+struct rng rng;
+long allocs, alloc_bytes;   // heap use, counted by the malloc wrappers
+volatile long sink;         // results go here so loops are not optimized away
+
+
+int main(int argc, char** argv)
+{
+  const struct bench* b;
+  regex_t re;
+  const char* pattern = ".";
+  double secs = 0.5;
+  int opt;
+
+  while((opt = getopt(argc, argv, "b:t:")) != -1) {
+    switch(opt) {
+      case 'b':
+        // only benchmarks whose name matches
+        pattern = optarg;
+        break;
+      case 't':
+        // minimum time per benchmark
+        secs = atof(optarg);
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-b regex] [-t seconds]\n", argv[0]);
+        return 1;
+    }
+  }
+  if(regcomp(&re, pattern, REG_EXTENDED | REG_NOSUB)) {
+    fprintf(stderr, "bad pattern: %s\n", pattern);
+    return 1;
+  }
+  for(b = benches; b->name; b++)
+    if(!regexec(&re, b->name, 0, 0, 0))
+      bench_run(b, secs);
+  regfree(&re);
+  return 0;
+}
+
+// time one benchmark, doubling the op count until a run lasts secs
+void bench_run(const struct bench* b, double secs)
+{
+  long n, a, ab;
+  double start, t = 0;
+  rng_seed(&rng, 1);
+  if(b->setup)
+    b->setup();
+  for(n = 1; ; n *= 2) {
+    a = allocs;
+    ab = alloc_bytes;
+    start = now();
+    b->run(n);
+    t = now() - start;
+    if(t >= secs || n >= 1L << 40)
+      break;
+  }
+  printf("Benchmark%-14s %12ld %12.1f ns/op %14.0f ops/sec %8.2f allocs/op %8.0f B/op\n", b->name, n,
+         t * 1e9 / n, n / t, (double)(allocs - a) / n, (double)(alloc_bytes - ab) / n);
+  fflush(stdout);
+}
+
+// random fleets on both sides and a random shot order for each
+void setup_game()
+{
+  int i, j, k;
+  unsigned char c;
+  for(i = 0; i < SETUPS; i++) {
+    engine_init(&games[i]);
+    engine_random_fleet(&games[i], P1, &rng);
+    engine_random_fleet(&games[i], P2, &rng);
+    engine_fleet_layout(&games[i], P1, fleets[i]);
+    for(j = 0; j < TOT_ATK_CELL; j++)
+      cells[i][j] = j;
+    for(j = TOT_ATK_CELL - 1; j > 0; j--) {
+      k = rng_range(&rng, j + 1);
+      c = cells[i][j];
+      cells[i][j] = cells[i][k];
+      cells[i][k] = c;
+    }
+  }
+}
+
+// fleets with two cells of every ship down, to ask where the third may go
+void setup_align()
+{
+  struct game full;
+  int i, s, c;
+  for(i = 0; i < SETUPS; i++) {
+    engine_init(&full);
+    engine_random_fleet(&full, P1, &rng);
+    engine_init(&games[i]);
+    for(s = 0; s < SHIP_COUNT; s++) {
+      bitboard m = full.side[P1].ship_mask[s];
+      c = bb_pop(&m);
+      engine_deploy_cell(&games[i], P1, ship_types[s][0], c / BOARD_SIZE, c % BOARD_SIZE);
+      c = bb_pop(&m);
+      engine_deploy_cell(&games[i], P1, ship_types[s][0], c / BOARD_SIZE, c % BOARD_SIZE);
+    }
+  }
+}
+
+// one engine_attack() per op, every cell of a board in turn
+void run_attack(long n)
+{
+  struct game* g;
+  long i, r = 0;
+  int c;
+  for(i = 0; i < n; i++) {
+    g = &games[(i / TOT_ATK_CELL) % SETUPS];
+    if(i % TOT_ATK_CELL == 0)
+      g->side[P2].hits = g->side[P2].misses = 0;
+    c = cells[(i / TOT_ATK_CELL) % SETUPS][i % TOT_ATK_CELL];
+    r += engine_attack(g, P2, c / BOARD_SIZE, c % BOARD_SIZE);
+  }
+  sink = r;
+}
+
+// one engine_attack() per op, only on ship cells so every shot runs the sink check
+void run_sink(long n)
+{
+  struct game* g;
+  bitboard left = 0;
+  long i, r = 0;
+  int c;
+  for(i = 0; i < n; i++) {
+    g = &games[(i / TOT_SHIP_CELL) % SETUPS];
+    if(!left) {
+      g->side[P2].hits = 0;
+      left = g->side[P2].occupied;
+    }
+    c = bb_pop(&left);
+    r += engine_attack(g, P2, c / BOARD_SIZE, c % BOARD_SIZE);
+  }
+  sink = r;
+}
+
+// the games of setup_game() in batches
+void setup_batch()
+{
+  int i, j;
+  setup_game();
+  for(i = 0; i < SETUPS; i++) {
+    if(i % BATCH_LANES == 0)
+      batch_init(&batches[i / BATCH_LANES], BATCH_LANES);
+    batch_load(&batches[i / BATCH_LANES], i % BATCH_LANES, &games[i]);
+    for(j = 0; j < TOT_ATK_CELL; j++)
+      volleys[i / BATCH_LANES][j][i % BATCH_LANES] = cells[i][j];
+  }
+}
+
+// one batch_attack() and batch_win() per op, a shot in each of BATCH_LANES games
+void run_batch_attack(long n)
+{
+  unsigned char res[BATCH_LANES], win[BATCH_LANES];
+  signed char ship[BATCH_LANES];
+  struct batch* b;
+  long i, r = 0;
+  int k;
+  for(i = 0; i < n; i++) {
+    k = (i / TOT_ATK_CELL) % (SETUPS / BATCH_LANES);
+    b = &batches[k];
+    // a fresh board, and the ships' counters back to full
+    if(i % TOT_ATK_CELL == 0)
+      for(b->n = 0; b->n < BATCH_LANES; b->n++)
+        batch_load(b, b->n, &games[k * BATCH_LANES + b->n]);
+    batch_attack(b, P2, volleys[k][i % TOT_ATK_CELL], res, ship);
+    batch_win(b, win);
+    r += res[0] + ship[BATCH_LANES - 1] + win[0];
+  }
+  sink = r;
+}
+
+// one engine_win() per op on half-played boards
+void run_win(long n)
+{
+  long i, r = 0;
+  int j;
+  for(i = 0; i < SETUPS; i++)
+    for(j = 0; j < TOT_ATK_CELL / 2; j++)
+      engine_attack(&games[i], P2, cells[i][j] / BOARD_SIZE, cells[i][j] % BOARD_SIZE);
+  for(i = 0; i < n; i++)
+    r += engine_win(&games[i % SETUPS]);
+  sink = r;
+}
+
+// one engine_check_align() per op: a ship and a cell next to its first cell
+void run_align(long n)
+{
+  static const int step[4] = { -1, 1, -BOARD_SIZE, BOARD_SIZE };
+  struct game* g;
+  long i, r = 0;
+  int s, c;
+  for(i = 0; i < n; i++) {
+    g = &games[i % SETUPS];
+    s = i % SHIP_COUNT;
+    c = bb_first(g->side[P1].ship_mask[s]) + step[(i >> 3) & 3];
+    if(c >= 0 && c < TOT_ATK_CELL)
+      r += engine_check_align(g, P1, s, c / BOARD_SIZE, c % BOARD_SIZE);
+  }
+  sink = r;
+}
+
+// one engine_deploy_cell() per op, whole fleets cell by cell from an empty side
+void run_deploy(long n)
+{
+  struct game g;
+  bitboard m = 0;
+  long i, r = 0;
+  int s = SHIP_COUNT, c, f = 0;
+  engine_init(&g);
+  for(i = 0; i < n; i++) {
+    while(!m) {
+      if(++s >= SHIP_COUNT) {
+        // next fleet on a cleared side
+        memset(g.side[P1].ship_mask, 0, sizeof(g.side[P1].ship_mask));
+        g.side[P1].occupied = 0;
+        g.side[P1].cells_deployed = 0;
+        for(s = 0; s < SHIP_COUNT; s++)
+          g.side[P1].ships[s].num_cell_deployed = g.side[P1].ships[s].has_deployed = 0;
+        s = 0;
+        f = (f + 1) % SETUPS;
+      }
+      m = games[f].side[P1].ship_mask[s];
+    }
+    c = bb_pop(&m);
+    r += engine_deploy_cell(&g, P1, ship_types[s][0], c / BOARD_SIZE, c % BOARD_SIZE);
+  }
+  sink = r;
+}
+
+// one engine_place_fleet() per op on a cleared side
+void run_fleet(long n)
+{
+  struct game g;
+  long i, r = 0;
+  int s;
+  engine_init(&g);
+  for(i = 0; i < n; i++) {
+    memset(g.side[P1].ship_mask, 0, sizeof(g.side[P1].ship_mask));
+    g.side[P1].occupied = 0;
+    g.side[P1].cells_deployed = 0;
+    for(s = 0; s < SHIP_COUNT; s++)
+      g.side[P1].ships[s].num_cell_deployed = 0;
+    r += engine_place_fleet(&g, P1, fleets[i % SETUPS]);
+  }
+  sink = r;
+}
+
+// one binary attack frame encoded per op
+void run_encode(long n)
+{
+  struct msg m = { MSG_ATTACK, NO_SHIP, 0, 0, 0 };
+  char buf[FRAME_MAX];
+  long i, r = 0;
+  for(i = 0; i < n; i++) {
+    m.row = i % BOARD_SIZE;
+    m.col = (i / BOARD_SIZE) % BOARD_SIZE;
+    m.seq = i;
+    r += proto_encode(&m, 0, buf) + buf[4];
+  }
+  sink = r;
+}
+
+// one attack frame sent to a forked echo process and its echo received per op,
+// over a pipe pair (what the FIFOs are) or a memfd holding the shared-memory rings
+void run_round_trip(long n, int use_shm)
+{
+  struct msg m = { MSG_ATTACK, NO_SHIP, 0, 0, 0 };
+  struct channel ch;
+  struct shm_link l, cl;
+  int to[2], from[2], fd = -1;
+  long i, r = 0;
+  pid_t pid;
+  if(use_shm) {
+    if((fd = memfd_create("bench", 0)) < 0 || ftruncate(fd, sizeof(struct shm_region)) < 0 ||
+       shm_link_attach(&l, fd, 0) < 0) {
+      perror("memfd");
+      exit(1);
+    }
+  }
+  else if(pipe(to) < 0 || pipe(from) < 0) {
+    perror("pipe");
+    exit(1);
+  }
+  if((pid = fork()) < 0) {
+    perror("fork");
+    exit(1);
+  }
+  if(!pid) {
+    // echo everything back until the other end hangs up
+    if(use_shm) {
+      if(shm_link_attach(&cl, fd, 1) < 0)
+        _exit(1);
+      chan_init_shm(&ch, &cl, 0);
+    }
+    else {
+      close(to[1]);
+      close(from[0]);
+      chan_init(&ch, to[0], from[1], 0);
+    }
+    while(chan_recv(&ch, &m) > 0)
+      if(chan_send(&ch, &m) < 0)
+        break;
+    _exit(0);
+  }
+  if(use_shm)
+    chan_init_shm(&ch, &l, 0);
+  else {
+    close(to[0]);
+    close(from[1]);
+    chan_init(&ch, from[0], to[1], 0);
+  }
+  for(i = 0; i < n; i++) {
+    m.row = i % BOARD_SIZE;
+    if(chan_send(&ch, &m) < 0 || chan_recv(&ch, &m) <= 0) {
+      perror("round trip");
+      exit(1);
+    }
+    r += m.row;
+  }
+  if(use_shm) {
+    shm_link_close(&l);
+    close(fd);
+  }
+  else {
+    close(to[1]);
+    close(from[0]);
+  }
+  waitpid(pid, 0, 0);
+  sink = r;
+}
+
+void run_round_trip_pipe(long n)
+{
+  run_round_trip(n, 0);
+}
+
+void run_round_trip_shm(long n)
+{
+  run_round_trip(n, 1);
+}
+
+// games 40 rounds in, their snapshots and packed records
+void setup_snapshot()
+{
+  int i, j, c;
+  setup_game();
+  for(i = 0; i < SETUPS; i++) {
+    for(j = 0; j < 40; j++) {
+      c = cells[i][j];
+      engine_attack(&games[i], P1, c / BOARD_SIZE, c % BOARD_SIZE);
+      c = cells[i][TOT_ATK_CELL - 1 - j];
+      engine_attack(&games[i], P2, c / BOARD_SIZE, c % BOARD_SIZE);
+    }
+    snapshot_take(&snaps[i], &games[i], 1, 0);
+    pack_game(&games[i], &packs[i]);
+  }
+}
+
+// one snapshot of a game in progress per op, as written after every round
+void run_snap_take(long n)
+{
+  struct snapshot s;
+  long i, r = 0;
+  for(i = 0; i < n; i++)
+    r += snapshot_take(&s, &games[i % SETUPS], 1, 0) + s.crc;
+  sink = r;
+}
+
+// one game rebuilt from its snapshot per op, as on resume
+void run_snap_restore(long n)
+{
+  struct game g;
+  long i, r = 0;
+  for(i = 0; i < n; i++)
+    r += snapshot_restore(&snaps[i % SETUPS], &g) + g.shots[P1];
+  sink = r;
+}
+
+// one game in progress packed per op, as the server does after every move
+void run_pack(long n)
+{
+  struct game_pack p;
+  long i, r = 0;
+  for(i = 0; i < n; i++) {
+    pack_game(&games[i % SETUPS], &p);
+    r += p.shot[P1][i % PACK_BB_BYTES];
+  }
+  sink = r;
+}
+
+// one packed game rebuilt per op, as the server does before every move
+void run_unpack(long n)
+{
+  struct game g;
+  long i, r = 0;
+  for(i = 0; i < n; i++) {
+    unpack_game(&packs[i % SETUPS], &g);
+    r += g.shots[P1];
+  }
+  sink = r;
+}
+
+// one binary frame decoded per op, out of a buffer of coalesced frames
+void run_decode(long n)
+{
+  struct msg m = { MSG_ATTACK, NO_SHIP, 0, 0, 0 };
+  struct framer fr;
+  long i, r = 0;
+  int k, per = FRAME_BUF / FRAME_MOVE_LEN;
+  fr.off = fr.len = fr.resync = 0;
+  for(k = 0; k < per; k++) {
+    m.row = k % BOARD_SIZE;
+    m.col = (k / BOARD_SIZE) % BOARD_SIZE;
+    fr.len += proto_encode(&m, 0, (char*)fr.buf + fr.len);
+  }
+  for(i = 0; i < n; i++) {
+    if(fr.off == fr.len) {
+      // refill: the frames are still in the buffer
+      fr.off = 0;
+      fr.len = per * FRAME_MOVE_LEN;
+    }
+    r += proto_decode(&fr, &m) + m.row;
+  }
+  sink = r;
+}
+
+// one text line decoded per op
+void run_decode_text(long n)
+{
+  struct msg m = { MSG_DEPLOY, 0, 0, 0, 0 };
+  struct framer fr;
+  long i, r = 0;
+  int k, len = 0, per;
+  fr.off = fr.len = fr.resync = 0;
+  for(k = 0; fr.len + 16 < FRAME_BUF; k++) {
+    m.row = k % BOARD_SIZE;
+    m.col = (k / BOARD_SIZE) % BOARD_SIZE;
+    fr.len += proto_encode(&m, 1, (char*)fr.buf + fr.len);
+  }
+  per = k;
+  len = fr.len;
+  for(i = 0; i < n; i++) {
+    if(i % per == 0) {
+      fr.off = 0;
+      fr.len = len;
+    }
+    r += proto_decode(&fr, &m) + m.col;
+  }
+  sink = r;
+}
+
+// one whole game per op between two strategies
+void run_games(long n, const struct strategy* st)
+{
+  const struct strategy* both[2] = { st, st };
+  void* state[2] = { malloc(st->size), malloc(st->size) };
+  struct game g;
+  long i, r = 0;
+  for(i = 0; i < n; i++)
+    r += strategy_play(&g, &rng, both, state, 0);
+  free(state[0]);
+  free(state[1]);
+  sink = r;
+}
+
+// random against random
+void run_game_random(long n)
+{
+  run_games(n, &strategy_random);
+}
+
+// density against density
+void run_game_density(long n)
+{
+  run_games(n, &strategy_density);
+}
+
+// hunt against hunt
+void run_game_hunt(long n)
+{
+  run_games(n, &strategy_hunt);
+}
+
+// one hunt/target decision and its result per op, games restarted as they end
+void run_hunt_shoot(long n)
+{
+  void* state = malloc(strategy_hunt.size);
+  struct game* g = &games[0];
+  long i, r = 0;
+  int res, cell, k = 0;
+  strategy_hunt.reset(state, &rng);
+  for(i = 0; i < n; i++) {
+    res = strategy_fire(&strategy_hunt, state, g, P2, &cell);
+    r += cell;
+    if(res == SHOT_REPEAT || engine_fleet_sunk(g, P2)) {
+      g = &games[++k % SETUPS];
+      g->side[P2].hits = g->side[P2].misses = 0;
+      strategy_hunt.reset(state, &rng);
+    }
+  }
+  free(state);
+  sink = r;
+}
+
+// one sampled layout per op, twenty shots into a game
+void run_sampler(long n)
+{
+  static struct sampler s;
+  struct sample_knowledge k;
+  bitboard layout[SHIP_COUNT];
+  struct game g;
+  long i, r = 0;
+  engine_init(&g);
+  engine_random_fleet(&g, P2, &rng);
+  for(i = 0; i < 20; i++)
+    engine_attack(&g, P2, cells[0][i] / BOARD_SIZE, cells[0][i] % BOARD_SIZE);
+  sampler_knowledge(&g, P2, &k);
+  sampler_init(&s, &k, 1);
+  for(i = 0; i < n; i++) {
+    sampler_next(&s, layout);
+    r += bb_first(layout[0]);
+  }
+  sink = r;
+}
+
+// positions where the solver first takes over from the density shooter
+void setup_endgame()
+{
+  static struct endgame e;
+  void* state = malloc(strategy_density.size);
+  struct game g;
+  int i, j, afloat;
+  for(i = 0; i < SETUPS; ) {
+    engine_init(&g);
+    engine_random_fleet(&g, P2, &rng);
+    strategy_density.reset(state, &rng);
+    while(!engine_fleet_sunk(&g, P2)) {
+      strategy_fire(&strategy_density, state, &g, P2, 0);
+      sampler_knowledge(&g, P2, &endgames[i]);
+      for(afloat = j = 0; j < SHIP_COUNT; j++)
+        afloat += !endgames[i].sunk_at[j];
+      if(afloat && afloat <= ENDGAME_SHIPS && endgame_solve(&e, &endgames[i], 0) >= 0) {
+        i++;
+        break;
+      }
+    }
+  }
+  free(state);
+}
+
+// one endgame decision per op, with an empty transposition table
+void run_endgame(long n)
+{
+  static struct endgame e;
+  long i, r = 0;
+  for(i = 0; i < n; i++) {
+    endgame_init(&e);
+    r += endgame_solve(&e, &endgames[i % SETUPS], 0);
+  }
+  sink = r;
+}
+
+// count heap use around glibc's allocator
+void* malloc(size_t size)
+{
+  allocs++;
+  alloc_bytes += size;
+  return __libc_malloc(size);
+}
+
+// count calloc like malloc
+void* calloc(size_t n, size_t size)
+{
+  allocs++;
+  alloc_bytes += n * size;
+  return __libc_calloc(n, size);
+}
+
+// every realloc counts as a new allocation
+void* realloc(void* p, size_t size)
+{
+  allocs++;
+  alloc_bytes += size;
+  return __libc_realloc(p, size);
+}
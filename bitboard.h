@@ -0,0 +1,89 @@
+/******************************************************
+ * Description: 128-bit bitboards for the 10x10 board.
+ *   Cell (y, x) is bit y * BOARD_SIZE + x, so a whole
+ *   board of ships, hits or misses fits in one value and
+ *   hit/sink/win tests are a few AND and POPCNT ops.
+ ******************************************************/
+
+#ifndef BITBOARD_H
+#define BITBOARD_H
+
+#include <stdint.h>
+
+typedef unsigned __int128 bitboard;
+
+#define BB_EMPTY ((bitboard)0)
+// mask of all cells on a board of n cells
+#define BB_FIRST(n) ((((bitboard)1) << (n)) - 1)
+// bytes that hold a board of n cells
+#define BB_BYTES(n) (((n) + 7) / 8)
+
+// single cell mask
+static inline bitboard bb_cell(int cell)
+{
+  return ((bitboard)1) << cell;
+}
+
+// check if a cell is set
+static inline int bb_test(bitboard b, int cell)
+{
+  return (int)((b >> cell) & 1);
+}
+
+// number of set cells
+static inline int bb_count(bitboard b)
+{
+  return __builtin_popcountll((uint64_t)b) + __builtin_popcountll((uint64_t)(b >> 64));
+}
+
+// index of the lowest set cell, b must not be empty
+static inline int bb_first(bitboard b)
+{
+  uint64_t lo = (uint64_t)b;
+  return lo ? __builtin_ctzll(lo) : 64 + __builtin_ctzll((uint64_t)(b >> 64));
+}
+
+// pop the lowest set cell, b must not be empty
+static inline int bb_pop(bitboard* b)
+{
+  int cell = bb_first(*b);
+  *b &= *b - 1;
+  return cell;
+}
+
+// index of the n-th (from 0) set cell, b must have more than n cells
+static inline int bb_select(bitboard b, int n)
+{
+  uint64_t lo = (uint64_t)b;
+  int c = __builtin_popcountll(lo);
+  if(n >= c) {
+    lo = (uint64_t)(b >> 64);
+    n -= c;
+    c = 64;
+  }
+  else
+    c = 0;
+  while(n--)
+    lo &= lo - 1;
+  return c + __builtin_ctzll(lo);
+}
+
+// write a board out as len bytes, lowest cells first, for records kept on disk or in memory
+static inline void bb_store(bitboard b, unsigned char* out, int len)
+{
+  int i;
+  for(i = 0; i < len; i++)
+    out[i] = (unsigned char)(b >> 8 * i);
+}
+
+// read back a board written by bb_store()
+static inline bitboard bb_load(const unsigned char* in, int len)
+{
+  bitboard b = 0;
+  int i;
+  for(i = 0; i < len; i++)
+    b |= (bitboard)in[i] << 8 * i;
+  return b;
+}
+
+#endif
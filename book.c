@@ -0,0 +1,197 @@
+/******************************************************
+ * Description: Opening book: canonical keys, the file
+ *   mapped read-only and searched by bisection, and
+ *   writing it out sorted. The canonical orientation of
+ *   a position is the one whose hits, then misses, are
+ *   the smallest bitboard; a position with symmetries
+ *   of its own has several, and lookups pick one of
+ *   them at random so the shots still vary from game to
+ *   game.
+ ******************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "book.h"
+
+static int sym_cell(int, int);
+static int sym_inverse(int);
+static bitboard sym_bb(int, bitboard);
+static void open_default();
+
+static pthread_once_t default_once = PTHREAD_ONCE_INIT;
+static struct book default_book;
+static const struct book* default_ptr;    // 0 without a usable BATTLESHIP_BOOK
+
+
+// the canonical key of a position; return the set of symmetries (bit t for
+// symmetry t) that take the position to it
+int book_canon(bitboard hits, bitboard misses, int sunk, struct book_entry* key)
+{
+  bitboard best_h = 0, best_m = 0, h, m;
+  int t, syms = 0;
+  for(t = 0; t < BOOK_SYMS; t++) {
+    h = sym_bb(t, hits);
+    m = sym_bb(t, misses);
+    if(!syms || h < best_h || (h == best_h && m < best_m)) {
+      best_h = h;
+      best_m = m;
+      syms = 1 << t;
+    }
+    else if(h == best_h && m == best_m)
+      syms |= 1 << t;
+  }
+  bb_store(best_h, key->hits, BOOK_BB_BYTES);
+  bb_store(best_m, key->misses, BOOK_BB_BYTES);
+  key->sunk = sunk;
+  key->cell = 0;
+  return syms;
+}
+
+// map a book file; return 0 or -1 with errno set
+int book_open(struct book* b, const char* path)
+{
+  struct stat st;
+  void* p;
+  int fd;
+  if((fd = open(path, O_RDONLY)) < 0)
+    return -1;
+  if(fstat(fd, &st) < 0) {
+    close(fd);
+    return -1;
+  }
+  if(st.st_size < (off_t)sizeof(struct book_header)) {
+    close(fd);
+    errno = EINVAL;
+    return -1;
+  }
+  p = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(p == MAP_FAILED)
+    return -1;
+  b->h = p;
+  b->e = (const struct book_entry*)(b->h + 1);
+  b->len = st.st_size;
+  if(memcmp(b->h->magic, BOOK_MAGIC, 4) || b->h->version != BOOK_VERSION ||
+     b->len != sizeof(struct book_header) + (size_t)b->h->count * sizeof(struct book_entry)) {
+    book_close(b);
+    errno = EINVAL;
+    return -1;
+  }
+  return 0;
+}
+
+void book_close(struct book* b)
+{
+  if(b->h)
+    munmap((void*)b->h, b->len);
+  b->h = 0;
+}
+
+// the book's shot for a position, in the position's own orientation, or -1
+int book_lookup(const struct book* b, bitboard hits, bitboard misses, int sunk, struct rng* r)
+{
+  struct book_entry key;
+  int syms, lo = 0, hi = b->h->count, mid = 0, c, t = 0;
+  syms = book_canon(hits, misses, sunk, &key);
+  while(lo < hi) {
+    mid = (lo + hi) / 2;
+    if(!(c = book_key_cmp(&key, &b->e[mid])))
+      break;
+    if(c < 0)
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+  if(lo >= hi)
+    return -1;
+  // any symmetry onto the key will do
+  for(c = rng_range(r, __builtin_popcount(syms)); c >= 0; c--) {
+    t = __builtin_ctz(syms);
+    syms &= syms - 1;
+  }
+  return sym_cell(sym_inverse(t), b->e[mid].cell);
+}
+
+// sort the entries and write them out as a book; return 0 or -1 with errno set
+int book_write(const char* path, struct book_entry* e, int count, int depth, int samples)
+{
+  struct book_header h;
+  FILE* f;
+  int ok;
+  qsort(e, count, sizeof(*e), book_key_cmp);
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, BOOK_MAGIC, 4);
+  h.version = BOOK_VERSION;
+  h.depth = depth;
+  h.count = count;
+  h.samples = samples;
+  if(!(f = fopen(path, "wb")))
+    return -1;
+  ok = fwrite(&h, sizeof(h), 1, f) == 1 && fwrite(e, sizeof(*e), count, f) == (size_t)count;
+  if(fclose(f) || !ok)
+    return -1;
+  return 0;
+}
+
+// order entries by key, the order a book is sorted in
+int book_key_cmp(const void* a, const void* b)
+{
+  return memcmp(a, b, BOOK_KEY_LEN);
+}
+
+// the book named by BATTLESHIP_BOOK, mapped on first use, or 0
+const struct book* book_default()
+{
+  pthread_once(&default_once, open_default);
+  return default_ptr;
+}
+
+static void open_default()
+{
+  const char* path = getenv("BATTLESHIP_BOOK");
+  if(!path || !*path)
+    return;
+  if(book_open(&default_book, path) < 0) {
+    fprintf(stderr, "opening book %s: %s\n", path, strerror(errno));
+    return;
+  }
+  default_ptr = &default_book;
+}
+
+// symmetry t: bit 0 swaps rows and columns, then bit 1 mirrors the columns and bit 2 the rows
+static int sym_cell(int t, int cell)
+{
+  int y = cell / BOARD_SIZE, x = cell % BOARD_SIZE, s;
+  if(t & 1) {
+    s = y;
+    y = x;
+    x = s;
+  }
+  if(t & 2)
+    x = BOARD_SIZE - 1 - x;
+  if(t & 4)
+    y = BOARD_SIZE - 1 - y;
+  return CELL(y, x);
+}
+
+// mirrors undo themselves; after a swap, mirroring the columns undoes mirroring the rows
+static int sym_inverse(int t)
+{
+  return t & 1 ? 1 | (t & 2) << 1 | (t & 4) >> 1 : t;
+}
+
+static bitboard sym_bb(int t, bitboard b)
+{
+  bitboard out = 0;
+  while(b)
+    out |= bb_cell(sym_cell(t, bb_pop(&b)));
+  return out;
+}
@@ -0,0 +1,64 @@
+/******************************************************
+ * Description: Opening book for the density shooter.
+ *   The first shots of a game come from a small set of
+ *   positions, the same in every game, so the shot for
+ *   each of them is worked out once, offline, by
+ *   battleship-book and kept in a file. A position is
+ *   the hits, the misses and the set of ships sunk; it
+ *   is stored in one canonical orientation out of the
+ *   eight the square board has (rotations and mirror
+ *   images), so one entry answers for all of them. The
+ *   file is a header and the entries sorted by key, and
+ *   is searched in place where it is mapped.
+ ******************************************************/
+
+#ifndef BOOK_H
+#define BOOK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "engine.h"
+#include "rng.h"
+
+#define BOOK_MAGIC "bsbk"
+#define BOOK_VERSION 1
+// bytes of a 100-cell bitboard in an entry
+#define BOOK_BB_BYTES BB_BYTES(TOT_ATK_CELL)
+// bytes of an entry that make up its key
+#define BOOK_KEY_LEN offsetof(struct book_entry, cell)
+// symmetries of the board
+#define BOOK_SYMS 8
+
+struct book_header {
+  char magic[4];
+  uint32_t version;
+  uint32_t depth;         // positions up to this many shots in
+  uint32_t count;         // entries that follow
+  uint32_t samples;       // layouts sampled per entry
+};
+
+// one position, in its canonical orientation, and the shot to fire there
+struct book_entry {
+  unsigned char hits[BOOK_BB_BYTES];
+  unsigned char misses[BOOK_BB_BYTES];
+  unsigned char sunk;     // bit i set once ship i is sunk
+  unsigned char cell;
+};
+
+// a book file mapped for reading
+struct book {
+  const struct book_header* h;
+  const struct book_entry* e;
+  size_t len;             // bytes mapped
+};
+
+int book_canon(bitboard, bitboard, int, struct book_entry*);
+int book_open(struct book*, const char*);
+void book_close(struct book*);
+int book_lookup(const struct book*, bitboard, bitboard, int, struct rng*);
+int book_write(const char*, struct book_entry*, int, int, int);
+int book_key_cmp(const void*, const void*);
+const struct book* book_default();
+
+#endif
@@ -0,0 +1,147 @@
+/******************************************************
+ * Description: Opening book generator. Walks every
+ *   position the book's own shots can lead to in the
+ *   first few shots, one shot deeper per pass: for each
+ *   position it samples fleet layouts consistent with
+ *   it, picks the unshot cell most likely to hold a
+ *   ship, and queues what a miss, a hit or each
+ *   possible sinking there would look like. Positions
+ *   are kept in canonical orientation, so the passes
+ *   merge the ones that only differ by a rotation or a
+ *   mirror image, and positions no fleet fits are
+ *   dropped. The book is written sorted, ready for
+ *   BATTLESHIP_BOOK.
+ ******************************************************/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "book.h"
+#include "engine.h"
+#include "rng.h"
+#include "sampler.h"
+#include "timer.h"
+
+int best_cell(const double*, bitboard);
+void queue_child(struct book_entry*, int*, bitboard, bitboard, int);
+
+
+int main(int argc, char** argv)
+{
+  int opt, depth = 8, samples = 10000, d, i, n, nlevel, nnext, nbook = 0, dropped, ship, cell;
+  unsigned long seed = 1;
+  const char* out = "battleship.book";
+  struct book_entry *level, *next, *book = 0;
+  struct sample_knowledge k;
+  struct sampler* s;
+  struct rng r;
+  bitboard bit;
+  double prob[TOT_ATK_CELL], start, pass;
+
+  while((opt = getopt(argc, argv, "d:n:s:o:")) != -1) {
+    switch(opt) {
+      case 'd':
+        depth = atoi(optarg);
+        break;
+      case 'n':
+        samples = atoi(optarg);
+        break;
+      case 's':
+        seed = strtoul(optarg, 0, 10);
+        break;
+      case 'o':
+        out = optarg;
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-d depth] [-n samples] [-s seed] [-o book]\n", argv[0]);
+        return 1;
+    }
+  }
+  if(depth < 1 || depth > TOT_ATK_CELL || samples < 1) {
+    fprintf(stderr, "usage: %s [-d depth] [-n samples] [-s seed] [-o book]\n", argv[0]);
+    return 1;
+  }
+
+  rng_seed(&r, seed);
+  if(!(s = malloc(sizeof(*s))) || !(level = malloc(sizeof(*level))))
+    return 1;
+  // the empty board
+  book_canon(0, 0, 0, level);
+  nlevel = 1;
+  start = now();
+  printf("shots  positions    dropped    seconds\n");
+  for(d = 0; d < depth && nlevel; d++) {
+    pass = now();
+    // the same position reached by different shots, or different orientations, once
+    qsort(level, nlevel, sizeof(*level), book_key_cmp);
+    for(i = n = 0; i < nlevel; i++)
+      if(!n || book_key_cmp(&level[i], &level[n - 1]))
+        level[n++] = level[i];
+    nlevel = n;
+    if(!(book = realloc(book, (nbook + nlevel) * sizeof(*book))) ||
+       !(next = malloc(nlevel * (2 + SHIP_COUNT) * sizeof(*next))))
+      return 1;
+    nnext = dropped = 0;
+    for(i = 0; i < nlevel; i++) {
+      k.hits = bb_load(level[i].hits, BOOK_BB_BYTES);
+      k.misses = bb_load(level[i].misses, BOOK_BB_BYTES);
+      for(ship = 0; ship < SHIP_COUNT; ship++)
+        k.sunk_at[ship] = level[i].sunk >> ship & 1 ? k.hits : 0;
+      if(!sampler_init(s, &k, rng_next(&r))) {
+        dropped++;
+        continue;
+      }
+      sampler_heatmap(s, samples, prob);
+      cell = best_cell(prob, k.hits | k.misses);
+      level[i].cell = cell;
+      book[nbook++] = level[i];
+      if(d + 1 == depth)
+        continue;
+      bit = bb_cell(cell);
+      queue_child(next, &nnext, k.hits, k.misses | bit, level[i].sunk);
+      queue_child(next, &nnext, k.hits | bit, k.misses, level[i].sunk);
+      for(ship = 0; ship < SHIP_COUNT; ship++)
+        if(!(level[i].sunk >> ship & 1) && level[i].sunk != (1 << SHIP_COUNT) - 1 - (1 << ship))
+          queue_child(next, &nnext, k.hits | bit, k.misses, level[i].sunk | 1 << ship);
+    }
+    printf("%5d  %9d  %9d  %9.2f\n", d, nlevel - dropped, dropped, now() - pass);
+    fflush(stdout);
+    free(level);
+    level = next;
+    nlevel = nnext;
+  }
+  free(level);
+
+  if(book_write(out, book, nbook, depth, samples) < 0) {
+    fprintf(stderr, "%s: %s\n", out, strerror(errno));
+    return 1;
+  }
+  printf("\nentries:      %d\n", nbook);
+  printf("bytes:        %zu\n", sizeof(struct book_header) + nbook * sizeof(struct book_entry));
+  printf("seconds:      %.3f\n", now() - start);
+  free(book);
+  free(s);
+  return 0;
+}
+
+// the likeliest unshot cell, the first of equals
+int best_cell(const double* prob, bitboard shot)
+{
+  bitboard left = BB_BOARD & ~shot;
+  int cell, best = bb_first(left);
+  while(left) {
+    cell = bb_pop(&left);
+    if(prob[cell] > prob[best])
+      best = cell;
+  }
+  return best;
+}
+
+// add a position to the next pass, in canonical orientation
+void queue_child(struct book_entry* next, int* n, bitboard hits, bitboard misses, int sunk)
+{
+  book_canon(hits, misses, sunk, &next[(*n)++]);
+}
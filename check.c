@@ -0,0 +1,491 @@
+/******************************************************
+ * Description: Differential checks, run by make check.
+ *   The fast paths that stand in for the rules engine
+ *   are played against it on random games and every
+ *   answer compared: each build of the batch engine the
+ *   CPU can run, shot for shot, and the packed game
+ *   records the server keeps, both packed and unpacked
+ *   and played on directly. The frame reader gets the
+ *   reads the network hands it: frames cut anywhere,
+ *   several at once, and broken ones. A player deploys
+ *   with cells cleared and overwritten over a socket
+ *   pair, and the other side's copy of the fleet has to
+ *   keep up. Prints one line per check and exits
+ *   non-zero on any mismatch.
+ ******************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "engine.h"
+#include "pack.h"
+#include "proto.h"
+#include "rng.h"
+
+// random batches played per build
+#define BATCH_ROUNDS 5000
+// games packed and unpacked, and games played on a record
+#define PACK_ROUNDS 100000
+#define PACK_GAMES 20000
+// messages in the framer's test stream
+#define FRAME_MSGS 9
+// fleets deployed with changes of mind, and the changes before settling down
+#define DEPLOY_ROUNDS 2000
+#define DEPLOY_CHANGES 20
+
+int check_batch(const char*, struct rng*);
+int check_pack(struct rng*);
+void partial_fleet(struct game*, int, struct rng*);
+int same_side(const struct side*, const struct side*);
+int same_game(const struct game*, const struct game*);
+int check_framer(struct rng*);
+int test_msgs(struct msg*, struct rng*);
+void feed(struct framer*, const char*, int);
+int take(struct framer*, struct msg*, int*);
+int same_msg(const struct msg*, const struct msg*);
+int check_deploy(struct rng*);
+int deploy_cell(struct game*, struct channel*, int, int, int);
+int clear_cell(struct game*, struct channel*, int, int);
+
+
+int main(int argc, char** argv)
+{
+  struct rng r;
+  int opt, i, bad = 0;
+  unsigned long seed = 1;
+
+  while((opt = getopt(argc, argv, "s:")) != -1) {
+    switch(opt) {
+      case 's':
+        seed = strtoul(optarg, 0, 10);
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-s seed]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  rng_seed(&r, seed);
+  for(i = 0; batch_isas[i]; i++)
+    bad += check_batch(batch_isas[i], &r);
+  bad += check_pack(&r);
+  bad += check_framer(&r);
+  bad += check_deploy(&r);
+  return bad ? 1 : 0;
+}
+
+// one build of the batch engine against engine_attack() and engine_win(): shots
+// fired by both sides, off the board and repeated ones included, then the lanes
+// written back with batch_store(); return the mismatches
+int check_batch(const char* name, struct rng* r)
+{
+  static struct game ref[BATCH_LANES], start[BATCH_LANES], back;
+  struct batch b;
+  unsigned char cells[BATCH_LANES], res[BATCH_LANES], win[BATCH_LANES];
+  signed char ship[BATCH_LANES];
+  int round, n, i, t, mode, want, want_ship, bad = 0;
+  long shots = 0;
+  if(batch_use(name) < 0) {
+    printf("batch %-7s not run by this CPU, skipped\n", name);
+    return 0;
+  }
+  for(round = 0; round < BATCH_ROUNDS; round++) {
+    n = 1 + rng_range(r, BATCH_LANES);
+    batch_init(&b, n);
+    for(i = 0; i < n; i++) {
+      engine_init(&start[i]);
+      engine_random_fleet(&start[i], P1, r);
+      engine_random_fleet(&start[i], P2, r);
+      ref[i] = start[i];
+      batch_load(&b, i, &ref[i]);
+    }
+    // past TOT_ATK_CELL shots each the boards fill up and everything repeats
+    for(t = 0; t < 2 * TOT_ATK_CELL + 20; t++) {
+      mode = t & 1;
+      for(i = 0; i < BATCH_LANES; i++)
+        cells[i] = rng_range(r, 8) ? rng_range(r, TOT_ATK_CELL) : rng_range(r, 256);
+      batch_attack(&b, mode, cells, res, ship);
+      batch_win(&b, win);
+      for(i = 0; i < n; i++, shots++) {
+        want = engine_attack(&ref[i], mode, cells[i] / BOARD_SIZE, cells[i] % BOARD_SIZE);
+        want_ship = want == SHOT_SUNK ?
+                    engine_ship_at(&ref[i], mode, cells[i] / BOARD_SIZE, cells[i] % BOARD_SIZE) -
+                    ref[i].side[mode].ships : -1;
+        if(res[i] != want || ship[i] != want_ship || win[i] != engine_win(&ref[i])) {
+          if(!bad++)
+            printf("batch %s: lane %d cell %d gave %d/%d/%d, engine %d/%d/%d\n", name, i, cells[i],
+                   res[i], ship[i], win[i], want, want_ship, engine_win(&ref[i]));
+        }
+      }
+    }
+    for(i = 0; i < n; i++) {
+      back = start[i];
+      batch_store(&b, i, &back);
+      if(!same_side(&back.side[P1], &ref[i].side[P1]) || !same_side(&back.side[P2], &ref[i].side[P2]) ||
+         back.shots[P1] != ref[i].shots[P1] || back.shots[P2] != ref[i].shots[P2]) {
+        if(!bad++)
+          printf("batch %s: lane %d stored back differently\n", name, i);
+      }
+    }
+  }
+  printf("batch %-7s %10ld shots, %d mismatches\n", name, shots, bad);
+  return bad;
+}
+
+// packed records against the games they come from: random fleets, whole or partly
+// deployed, through pack_game() and unpack_game(), then whole games played with
+// pack_attack() and pack_win() beside engine_attack() and engine_win(); return the
+// mismatches
+int check_pack(struct rng* r)
+{
+  struct game g, back;
+  struct game_pack p;
+  unsigned char want_fleet[SHIP_COUNT], fleet[SHIP_COUNT];
+  int round, mode, t, cell, got, want, got_ship, want_ship, bad = 0;
+  long shots = 0;
+  for(round = 0; round < PACK_ROUNDS; round++) {
+    engine_init(&g);
+    for(mode = P1; mode <= P2; mode++) {
+      if(rng_range(r, 2))
+        engine_random_fleet(&g, mode, r);
+      else
+        partial_fleet(&g, mode, r);
+    }
+    pack_game(&g, &p);
+    unpack_game(&p, &back);
+    for(mode = P1; mode <= P2; mode++) {
+      want = engine_fleet_layout(&g, mode, want_fleet);
+      got = pack_fleet_layout(&p, mode, fleet);
+      if(pack_fleet_deployed(&p, mode) != engine_fleet_deployed(&g, mode) || got != want ||
+         (want && memcmp(fleet, want_fleet, SHIP_COUNT))) {
+        if(!bad++)
+          printf("pack: game %d side %d fleet packed differently\n", round, mode);
+      }
+    }
+    if(!same_game(&back, &g) && !bad++)
+      printf("pack: game %d unpacked differently\n", round);
+  }
+  for(round = 0; round < PACK_GAMES; round++) {
+    engine_init(&g);
+    engine_random_fleet(&g, P1, r);
+    engine_random_fleet(&g, P2, r);
+    pack_game(&g, &p);
+    for(t = 0; t < 2 * TOT_ATK_CELL + 20 && !engine_win(&g); t++, shots++) {
+      mode = t & 1;
+      cell = rng_range(r, 8) ? rng_range(r, TOT_ATK_CELL) : rng_range(r, 256);
+      want = engine_attack(&g, mode, cell / BOARD_SIZE, cell % BOARD_SIZE);
+      want_ship = want == SHOT_SUNK ?
+                  engine_ship_at(&g, mode, cell / BOARD_SIZE, cell % BOARD_SIZE) - g.side[mode].ships : -1;
+      got_ship = -1;
+      got = pack_attack(&p, mode, cell / BOARD_SIZE, cell % BOARD_SIZE, &got_ship);
+      if(got != want || got_ship != want_ship || pack_win(&p) != engine_win(&g)) {
+        if(!bad++)
+          printf("pack: game %d cell %d gave %d/%d/%d, engine %d/%d/%d\n", round, cell,
+                 got, got_ship, pack_win(&p), want, want_ship, engine_win(&g));
+      }
+    }
+    unpack_game(&p, &back);
+    if(!same_game(&back, &g) && !bad++)
+      printf("pack: game %d unpacked differently after play\n", round);
+  }
+  printf("pack           %10d records, %ld shots, %d mismatches\n", PACK_ROUNDS, shots, bad);
+  return bad;
+}
+
+// some cells of a random fleet, deployed in random order; cells out of line are refused
+void partial_fleet(struct game* g, int mode, struct rng* r)
+{
+  struct game full;
+  int i, k, cells[TOT_SHIP_CELL], ship[TOT_SHIP_CELL], n = 0, j, t;
+  engine_init(&full);
+  engine_random_fleet(&full, mode, r);
+  for(i = 0; i < SHIP_COUNT; i++)
+    for(k = 0; k < ship_lengths[i]; k++) {
+      ship[n] = i;
+      cells[n++] = CELL(full.side[mode].ships[i].y[k], full.side[mode].ships[i].x[k]);
+    }
+  for(i = n - 1; i > 0; i--) {
+    j = rng_range(r, i + 1);
+    t = cells[i], cells[i] = cells[j], cells[j] = t;
+    t = ship[i], ship[i] = ship[j], ship[j] = t;
+  }
+  for(i = rng_range(r, n + 1); i > 0; i--)
+    engine_deploy_cell(g, mode, ship_types[ship[i - 1]][0], cells[i - 1] / BOARD_SIZE,
+                       cells[i - 1] % BOARD_SIZE);
+}
+
+// two games agree on everything but the order their cells were deployed in
+int same_game(const struct game* a, const struct game* b)
+{
+  const struct side* sa, * sb;
+  int mode, i;
+  for(mode = P1; mode <= P2; mode++) {
+    sa = &a->side[mode];
+    sb = &b->side[mode];
+    if(!same_side(sa, sb) || sa->occupied != sb->occupied || sa->cells_deployed != sb->cells_deployed ||
+       a->shots[mode] != b->shots[mode])
+      return 0;
+    for(i = 0; i < SHIP_COUNT; i++)
+      if(sa->ship_mask[i] != sb->ship_mask[i] || sa->ships[i].num_cell_deployed != sb->ships[i].num_cell_deployed ||
+         sa->ships[i].has_deployed != sb->ships[i].has_deployed)
+        return 0;
+  }
+  return 1;
+}
+
+// the frame reader on the frames of one message of each kind: the stream cut in two at
+// every byte, then fed a byte at a time, then frames with a bad magic byte and with
+// lengths no frame has, each followed by a good frame it must not swallow; return the
+// mismatches
+int check_framer(struct rng* r)
+{
+  static struct framer fr;
+  struct msg sent[FRAME_MSGS], got[FRAME_MSGS * 2], m;
+  char stream[FRAME_MSGS * FRAME_MAX], bad_frame[FRAME_MAX * 2];
+  int nsent, len, cut, i, n, ngot, errors, nbad, bad = 0, cases = 0;
+  static const int bad_len[] = { 0, 1, FRAME_SHORTEST - FRAME_HDR - 1, FRAME_LONGEST - FRAME_HDR + 1, 255 };
+  nsent = test_msgs(sent, r);
+  for(i = len = 0; i < nsent; i++)
+    len += proto_encode(&sent[i], 0, stream + len);
+  // whole frames in one read, the rest in the next, split headers included
+  for(cut = 0; cut <= len; cut++, cases++) {
+    memset(&fr, 0, sizeof(fr));
+    errors = 0;
+    feed(&fr, stream, cut);
+    n = take(&fr, got, &errors);
+    feed(&fr, stream + cut, len - cut);
+    n += take(&fr, got + n, &errors);
+    for(i = 0; i < nsent && n == nsent && same_msg(&got[i], &sent[i]); i++)
+      ;
+    if((i < nsent || errors) && !bad++)
+      printf("framer: stream cut at byte %d gave %d messages, %d errors\n", cut, n, errors);
+  }
+  memset(&fr, 0, sizeof(fr));
+  for(i = n = errors = 0; i < len; i++) {
+    feed(&fr, stream + i, 1);
+    n += take(&fr, got + n, &errors);
+  }
+  cases++;
+  for(i = 0; i < nsent && n == nsent && same_msg(&got[i], &sent[i]); i++)
+    ;
+  if((i < nsent || errors) && !bad++)
+    printf("framer: a byte at a time gave %d messages, %d errors\n", n, errors);
+  // a broken frame is an error, the good frame right behind it still comes through,
+  // whether the broken header comes alone or with everything after it
+  nbad = sizeof(bad_len) / sizeof(bad_len[0]);
+  for(i = 0; i <= nbad * 2 + 1; i++, cases++) {
+    // a sequence number in printable bytes, which a reader taking the rest for text
+    // would carry on into the good frame
+    m = sent[0];
+    m.seq = 'B' | ',' << 8 | '3' << 16 | ')' << 24;
+    n = proto_encode(&m, 0, bad_frame);
+    if(i / 2 < nbad)
+      bad_frame[1] = bad_len[i / 2];
+    else
+      bad_frame[0] = FRAME_MAGIC ^ 1;
+    n += proto_encode(&sent[1], 0, bad_frame + n);
+    memset(&fr, 0, sizeof(fr));
+    errors = 0;
+    cut = i & 1 ? FRAME_HDR : n;
+    feed(&fr, bad_frame, cut);
+    ngot = take(&fr, got, &errors);
+    // a length no frame has is refused before the rest arrives
+    if(!errors && !bad++)
+      printf("framer: broken frame %d waited for more bytes\n", i);
+    feed(&fr, bad_frame + cut, n - cut);
+    ngot += take(&fr, got + ngot, &errors);
+    if((ngot != 1 || !same_msg(&got[0], &sent[1])) && !bad++)
+      printf("framer: broken frame %d gave %d messages, %d errors\n", i, ngot, errors);
+  }
+  printf("framer         %10d streams, %d mismatches\n", cases, bad);
+  return bad;
+}
+
+// one message of each kind, random fields, numbered from 0; return how many
+int test_msgs(struct msg* m, struct rng* r)
+{
+  static const int types[] = { MSG_DEPLOY, MSG_ATTACK, MSG_FLEET, MSG_RESULT, MSG_INCOMING,
+                               MSG_START, MSG_READY, MSG_RESUME, MSG_ATTACK };
+  struct game g;
+  int i;
+  for(i = 0; i < FRAME_MSGS; i++) {
+    memset(&m[i], 0, sizeof(m[i]));
+    m[i].type = types[i];
+    m[i].seq = i;
+    m[i].row = rng_range(r, BOARD_SIZE);
+    m[i].col = rng_range(r, BOARD_SIZE);
+    m[i].ship = m[i].type == MSG_DEPLOY ? (int)rng_range(r, SHIP_COUNT) : NO_SHIP;
+    if(m[i].type == MSG_RESULT || m[i].type == MSG_INCOMING) {
+      m[i].result = SHOT_SUNK;
+      m[i].ship = rng_range(r, SHIP_COUNT);
+    }
+    if(m[i].type == MSG_FLEET) {
+      engine_init(&g);
+      engine_random_fleet(&g, P1, r);
+      engine_fleet_layout(&g, P1, m[i].fleet);
+      m[i].row = m[i].col = 0;
+    }
+    if(m[i].type == MSG_START || m[i].type == MSG_READY || m[i].type == MSG_RESUME)
+      m[i].row = m[i].col = 0;
+  }
+  return FRAME_MSGS;
+}
+
+// bytes arriving on the channel, as chan_fill() takes them in
+void feed(struct framer* fr, const char* in, int n)
+{
+  if(fr->off) {
+    memmove(fr->buf, fr->buf + fr->off, fr->len - fr->off);
+    fr->len -= fr->off;
+    fr->off = 0;
+  }
+  memcpy(fr->buf + fr->len, in, n);
+  fr->len += n;
+}
+
+// every message the framer has whole, counting the errors; return the messages
+int take(struct framer* fr, struct msg* m, int* errors)
+{
+  int r, n = 0;
+  while((r = proto_decode(fr, &m[n])) != 0) {
+    if(r > 0)
+      n++;
+    else
+      (*errors)++;
+  }
+  return n;
+}
+
+// two messages say the same
+int same_msg(const struct msg* a, const struct msg* b)
+{
+  if(a->type != b->type || a->seq != b->seq)
+    return 0;
+  if(a->type == MSG_FLEET)
+    return !memcmp(a->fleet, b->fleet, SHIP_COUNT);
+  return a->ship == b->ship && a->row == b->row && a->col == b->col && a->result == b->result;
+}
+
+// a fleet deployed the way a player does it, cells cleared and overwritten by other
+// ships on the way, sent over a socket pair as the game sends it and applied with
+// proto_deploy() as the other player and the server apply it: after every message
+// the copy has to match, and the fleet has to end up down on both; return the
+// mismatches
+int check_deploy(struct rng* r)
+{
+  struct game want, g, copy;
+  struct channel out, in;
+  struct msg m;
+  int sv[2], round, t, i, k, cell, sent, got, msgs = 0, bad = 0;
+  if(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+    perror("socketpair");
+    return 1;
+  }
+  for(round = 0; round < DEPLOY_ROUNDS; round++) {
+    // text lines every other game, so both encodings of an erase get played
+    chan_init(&out, -1, sv[0], round & 1);
+    chan_init(&in, sv[1], -1, 0);
+    engine_init(&want);
+    engine_random_fleet(&want, P1, r);
+    engine_init(&g);
+    engine_init(&copy);
+    for(t = 0; !engine_fleet_deployed(&g, P1); t++) {
+      if(t < DEPLOY_CHANGES && rng_range(r, 2)) {
+        // a change of mind: a random cell cleared, or another ship put on it
+        cell = rng_range(r, TOT_ATK_CELL);
+        if(rng_range(r, 2))
+          sent = clear_cell(&g, &out, cell / BOARD_SIZE, cell % BOARD_SIZE);
+        else
+          sent = deploy_cell(&g, &out, rng_range(r, SHIP_COUNT), cell / BOARD_SIZE, cell % BOARD_SIZE);
+      }
+      else {
+        // then the fleet the player meant, cells of the wrong ship cleared first
+        for(cell = sent = 0; cell < TOT_ATK_CELL && !sent; cell++)
+          for(i = 0; i < SHIP_COUNT && !sent; i++)
+            if(bb_test(g.side[P1].ship_mask[i] & ~want.side[P1].ship_mask[i], cell))
+              sent = clear_cell(&g, &out, cell / BOARD_SIZE, cell % BOARD_SIZE);
+        for(i = 0; i < SHIP_COUNT && !sent; i++)
+          for(k = 0; k < ship_lengths[i] && !sent; k++)
+            if(!bb_test(g.side[P1].ship_mask[i], CELL(want.side[P1].ships[i].y[k], want.side[P1].ships[i].x[k])))
+              sent = deploy_cell(&g, &out, i, want.side[P1].ships[i].y[k], want.side[P1].ships[i].x[k]);
+        // a ship left with gaps no cell can fill: start it over, as a player has to
+        for(i = 0; i < SHIP_COUNT && !sent; i++)
+          for(cell = 0; cell < TOT_ATK_CELL && !g.side[P1].ships[i].has_deployed; cell++)
+            if(bb_test(g.side[P1].ship_mask[i], cell))
+              sent += clear_cell(&g, &out, cell / BOARD_SIZE, cell % BOARD_SIZE);
+        if(!sent) {
+          if(!bad++)
+            printf("deploy: game %d stuck short of its fleet\n", round);
+          break;
+        }
+      }
+      for(got = 0; got < sent; got++, msgs++) {
+        if(chan_recv(&in, &m) <= 0 || !proto_deploy(&copy, P1, &m)) {
+          if(!bad++)
+            printf("deploy: game %d message %d refused\n", round, msgs);
+        }
+      }
+      if(!same_game(&copy, &g) && !bad++)
+        printf("deploy: game %d copy of the fleet went out of step\n", round);
+    }
+    if(!engine_fleet_deployed(&copy, P1) && !bad++)
+      printf("deploy: game %d copy of the fleet never finished\n", round);
+  }
+  close(sv[0]);
+  close(sv[1]);
+  printf("deploy         %10d fleets, %d messages, %d mismatches\n", DEPLOY_ROUNDS, msgs, bad);
+  return bad;
+}
+
+// battleship's deploy_ship(): another ship's cell is taken back first, a ship left with
+// one way to go is finished off; return the messages sent
+int deploy_cell(struct game* g, struct channel* ch, int ship, int y, int x)
+{
+  struct msg m = { MSG_ERASE, NO_SHIP, y, x, 0 };
+  struct ship* s = engine_ship_at(g, P1, y, x);
+  int i, n, sent = 0, cells[MAX_SHIP_LEN];
+  if(s && s - g->side[P1].ships == ship)
+    return 0;
+  if(engine_erase_cell(g, P1, y, x)) {
+    chan_send(ch, &m);
+    sent++;
+  }
+  if(engine_deploy_cell(g, P1, ship_types[ship][0], y, x) != DEPLOY_OK)
+    return sent;
+  m.type = MSG_DEPLOY;
+  m.ship = ship;
+  chan_send(ch, &m);
+  n = engine_complete_ship(g, P1, ship, cells);
+  for(i = 0; i < n; i++) {
+    m.row = cells[i] / BOARD_SIZE;
+    m.col = cells[i] % BOARD_SIZE;
+    chan_send(ch, &m);
+  }
+  return sent + 1 + n;
+}
+
+// battleship's c key; return the messages sent
+int clear_cell(struct game* g, struct channel* ch, int y, int x)
+{
+  struct msg m = { MSG_ERASE, NO_SHIP, y, x, 0 };
+  if(!engine_erase_cell(g, P1, y, x))
+    return 0;
+  chan_send(ch, &m);
+  return 1;
+}
+
+// the shot state of two sides agrees
+int same_side(const struct side* a, const struct side* b)
+{
+  int i;
+  if(a->hits != b->hits || a->misses != b->misses)
+    return 0;
+  for(i = 0; i < SHIP_COUNT; i++)
+    if(a->ships[i].is_sunk != b->ships[i].is_sunk)
+      return 0;
+  return 1;
+}
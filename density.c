@@ -0,0 +1,215 @@
+/******************************************************
+ * Description: Probability-density targeting strategy.
+ *   Every legal placement of every ship still afloat
+ *   adds weight to the cells it covers, placements
+ *   through unexplained hits weigh much more, and the
+ *   shooter fires at the heaviest unshot cell. The
+ *   density grid is updated incrementally: a shot only
+ *   touches the placements running through that cell.
+ *   While the game is still in the opening book, if one
+ *   is loaded, the book's shot is fired instead; the
+ *   grid is kept up to date all the same, ready for the
+ *   first position the book does not have.
+ *   The endgame strategy is the same shooter until only
+ *   ENDGAME_SHIPS ships are afloat, then plays the exact
+ *   solver's shot whenever it can decide in time.
+ ******************************************************/
+
+#include <string.h>
+
+#include "book.h"
+#include "endgame.h"
+#include "place.h"
+#include "strategy.h"
+
+// per-game state of the density shooter
+struct density_state {
+  struct rng r;
+  bitboard shot;                        // cells fired at
+  bitboard hits;                        // hits not explained by a sunk ship
+  bitboard struck;                      // every hit
+  int sunk;                             // bit i set once ship i is sunk
+  long density[TOT_ATK_CELL];
+  unsigned char alive[PLACE_MAX];       // placement still possible
+  unsigned char covered[PLACE_MAX];     // unexplained hits inside placement
+};
+
+static void density_reset(void*, struct rng*);
+static int density_shoot(void*);
+static void density_result(void*, int, int, int);
+static void add_weight(struct density_state*, int, long);
+static void kill_place(struct density_state*, int);
+static void sink_ship(struct density_state*, int, int);
+static void endgame_reset(void*, struct rng*);
+static int endgame_shoot(void*);
+static void endgame_result(void*, int, int, int);
+
+// the density shooter plus what the solver needs to know
+struct endgame_state {
+  struct density_state ds;
+  struct sample_knowledge k;
+  int afloat;                           // ships not sunk yet
+  struct endgame e;
+};
+
+const struct strategy strategy_density = {
+  "density", sizeof(struct density_state), density_reset, density_shoot, density_result
+};
+
+const struct strategy strategy_endgame = {
+  "endgame", sizeof(struct endgame_state), endgame_reset, endgame_shoot, endgame_result
+};
+
+
+// weight of a placement covering h unexplained hits
+static const long hit_weight[MAX_SHIP_LEN + 1] = { 1, 30, 900, 27000, 810000, 24300000 };
+
+
+// start a game with every placement possible
+static void density_reset(void* state, struct rng* r)
+{
+  struct density_state* ds = state;
+  int p;
+  place_init();
+  rng_seed(&ds->r, rng_next(r));
+  ds->shot = 0;
+  ds->hits = 0;
+  ds->struck = 0;
+  ds->sunk = 0;
+  memset(ds->density, 0, sizeof(ds->density));
+  memset(ds->covered, 0, sizeof(ds->covered));
+  memset(ds->alive, 1, places->count);
+  for(p = 0; p < places->count; p++)
+    add_weight(ds, p, hit_weight[0]);
+}
+
+// fire the book's shot or at the heaviest unshot cell, breaking ties at random
+static int density_shoot(void* state)
+{
+  struct density_state* ds = state;
+  const struct book* b = book_default();
+  bitboard left = BB_BOARD & ~ds->shot;
+  long best = -1;
+  int cell, pick = 0, ties = 0;
+  if(b && bb_count(ds->shot) < (int)b->h->depth &&
+     (cell = book_lookup(b, ds->struck, ds->shot & ~ds->struck, ds->sunk, &ds->r)) >= 0 &&
+     bb_test(left, cell))
+    return cell;
+  while(left) {
+    cell = bb_pop(&left);
+    if(ds->density[cell] > best) {
+      best = ds->density[cell];
+      pick = cell;
+      ties = 1;
+    }
+    else if(ds->density[cell] == best && rng_range(&ds->r, ++ties) == 0)
+      pick = cell;
+  }
+  return pick;
+}
+
+// fold the outcome of a shot into the density grid
+static void density_result(void* state, int cell, int res, int ship)
+{
+  struct density_state* ds = state;
+  int i, p;
+  ds->shot |= bb_cell(cell);
+  // a miss rules out everything through the cell
+  if(res == SHOT_MISS) {
+    for(i = 0; i < places->cell_place_count[cell]; i++)
+      kill_place(ds, places->cell_place[cell][i]);
+    return;
+  }
+  // a hit makes everything through the cell more likely
+  ds->hits |= bb_cell(cell);
+  ds->struck |= bb_cell(cell);
+  for(i = 0; i < places->cell_place_count[cell]; i++) {
+    p = places->cell_place[cell][i];
+    if(!ds->alive[p])
+      continue;
+    add_weight(ds, p, hit_weight[ds->covered[p] + 1] - hit_weight[ds->covered[p]]);
+    ds->covered[p]++;
+  }
+  if(res == SHOT_SUNK) {
+    ds->sunk |= 1 << ship;
+    sink_ship(ds, ship, cell);
+  }
+}
+
+// drop a sunk ship and the hits it certainly covered
+static void sink_ship(struct density_state* ds, int ship, int cell)
+{
+  bitboard known = BB_BOARD;
+  int p, i, n = 0;
+  // cells shared by every placement of the ship that could have been sunk here
+  for(p = places->ship_first[ship]; p < places->ship_first[ship + 1]; p++) {
+    if(ds->alive[p] && bb_test(places->place[p].mask, cell) && !(places->place[p].mask & ~ds->hits)) {
+      known &= places->place[p].mask;
+      n++;
+    }
+  }
+  if(!n)
+    known = bb_cell(cell);
+  for(p = places->ship_first[ship]; p < places->ship_first[ship + 1]; p++)
+    kill_place(ds, p);
+  // those cells are taken, so no other ship can be there
+  ds->hits &= ~known;
+  while(known) {
+    cell = bb_pop(&known);
+    for(i = 0; i < places->cell_place_count[cell]; i++)
+      kill_place(ds, places->cell_place[cell][i]);
+  }
+}
+
+// remove a placement and its weight from the grid
+static void kill_place(struct density_state* ds, int p)
+{
+  if(!ds->alive[p])
+    return;
+  add_weight(ds, p, -hit_weight[ds->covered[p]]);
+  ds->alive[p] = 0;
+}
+
+// add w to every cell of a placement
+static void add_weight(struct density_state* ds, int p, long w)
+{
+  int i;
+  for(i = 0; i < places->place[p].len; i++)
+    ds->density[places->place[p].cell[i]] += w;
+}
+
+
+// a new game, with nothing known yet
+static void endgame_reset(void* state, struct rng* r)
+{
+  struct endgame_state* es = state;
+  density_reset(&es->ds, r);
+  memset(&es->k, 0, sizeof(es->k));
+  es->afloat = SHIP_COUNT;
+  endgame_init(&es->e);
+}
+
+// the solver's shot near the end, the density shot before or if it gives up
+static int endgame_shoot(void* state)
+{
+  struct endgame_state* es = state;
+  int cell;
+  if(es->afloat <= ENDGAME_SHIPS && (cell = endgame_solve(&es->e, &es->k, 0)) >= 0)
+    return cell;
+  return density_shoot(&es->ds);
+}
+
+// keep both the density grid and the knowledge up to date
+static void endgame_result(void* state, int cell, int res, int ship)
+{
+  struct endgame_state* es = state;
+  density_result(&es->ds, cell, res, ship);
+  if(res == SHOT_MISS)
+    es->k.misses |= bb_cell(cell);
+  else
+    es->k.hits |= bb_cell(cell);
+  if(res == SHOT_SUNK) {
+    es->k.sunk_at[ship] = bb_cell(cell);
+    es->afloat--;
+  }
+}
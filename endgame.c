@@ -0,0 +1,270 @@
+/******************************************************
+ * Description: Exact endgame solver. The layouts are
+ *   enumerated once per decision, then an expectimax
+ *   search over shots splits the layouts by what each
+ *   shot would report (miss, hit, which ship sank). A
+ *   shot costs one and every layout still needs all its
+ *   unshot cells fired at, which bounds each branch from
+ *   below and cuts most of the tree.
+ ******************************************************/
+
+#include <string.h>
+
+#include "endgame.h"
+
+// outcomes of a shot: miss, hit, then one per ship afloat that it may sink
+#define OUT_MISS 0
+#define OUT_HIT  1
+#define OUTCOMES (2 + ENDGAME_SHIPS)
+
+static int enumerate(struct endgame*, const struct sample_knowledge*, const int*, int, bitboard, bitboard*);
+static int add_layout(struct endgame*, const bitboard*);
+static double search(struct endgame*, const short*, int, bitboard, double, int*);
+static uint64_t mix(uint64_t);
+static uint64_t mix_bb(bitboard);
+
+
+// forget the positions searched so far, before a new game
+void endgame_init(struct endgame* e)
+{
+  // a new generation empties the table
+  if(!++e->gen) {
+    memset(e->tt, 0, sizeof(e->tt));
+    e->gen = 1;
+  }
+}
+
+// best cell to fire at and the expected shots left, -1 if the position is not solvable in time
+int endgame_solve(struct endgame* e, const struct sample_knowledge* k, double* expect)
+{
+  const struct place_table* t = places;
+  bitboard chosen[SHIP_COUNT], m;
+  short all[ENDGAME_LAYOUTS];
+  int order[SHIP_COUNT], i, j, p, n, pick = -1;
+  double v;
+  place_init();
+  e->nafloat = e->nlayout = 0;
+  e->nodes = 0;
+  e->aborted = 0;
+  for(i = 0; i < SHIP_COUNT; i++) {
+    if(k->sunk_at[i])
+      continue;
+    if(e->nafloat == ENDGAME_SHIPS)
+      return -1;
+    e->afloat[e->nafloat++] = i;
+  }
+  if(!e->nafloat)
+    return -1;
+  // the same filter as the sampler: sunk ships on hits only, ships afloat never
+  for(i = 0; i < SHIP_COUNT; i++) {
+    n = 0;
+    for(p = t->ship_first[i]; p < t->ship_first[i + 1]; p++) {
+      m = t->place[p].mask;
+      if(m & k->misses)
+        continue;
+      if(k->sunk_at[i] ? ((m & ~k->hits) || !(m & k->sunk_at[i])) : !(m & ~k->hits))
+        continue;
+      e->cand[i][n++] = m;
+    }
+    if(!(e->cand_count[i] = n))
+      return -1;
+  }
+  // fewest placements first, so dead ends show early
+  for(i = 0; i < SHIP_COUNT; i++) {
+    for(j = i; j > 0 && e->cand_count[order[j - 1]] > e->cand_count[i]; j--)
+      order[j] = order[j - 1];
+    order[j] = i;
+  }
+  memset(e->bucket, 0, sizeof(e->bucket));
+  if(!enumerate(e, k, order, 0, 0, chosen) || !e->nlayout)
+    return -1;
+  e->nodes = 0;
+  for(i = 0; i < e->nlayout; i++)
+    all[i] = i;
+  v = search(e, all, e->nlayout, k->hits | k->misses, 1e30, &pick);
+  if(e->aborted || pick < 0)
+    return -1;
+  if(expect)
+    *expect = v;
+  return pick;
+}
+
+// lay the ships down in order and add every whole layout that explains the hits, 0 if too many
+static int enumerate(struct endgame* e, const struct sample_knowledge* k, const int* order, int d,
+                     bitboard occ, bitboard* chosen)
+{
+  int i, s;
+  if(++e->nodes > ENDGAME_NODES)
+    return 0;
+  if(d == SHIP_COUNT)
+    return (k->hits & ~occ) ? 1 : add_layout(e, chosen);
+  s = order[d];
+  for(i = 0; i < e->cand_count[s]; i++) {
+    if(e->cand[s][i] & occ)
+      continue;
+    chosen[s] = e->cand[s][i];
+    if(!enumerate(e, k, order, d + 1, occ | chosen[s], chosen))
+      return 0;
+  }
+  return 1;
+}
+
+// count a whole layout under the layout of its ships afloat, 0 if there are too many
+static int add_layout(struct endgame* e, const bitboard* chosen)
+{
+  uint64_t h = 0;
+  int i, j, b;
+  for(i = 0; i < e->nafloat; i++)
+    h = mix(h ^ mix_bb(chosen[e->afloat[i]]));
+  // the sunk ships can often lie more than one way, that only adds weight
+  for(b = h & (2 * ENDGAME_LAYOUTS - 1); (j = e->bucket[b] - 1) >= 0; b = (b + 1) & (2 * ENDGAME_LAYOUTS - 1)) {
+    for(i = 0; i < e->nafloat && e->ship[j][i] == chosen[e->afloat[i]]; i++)
+      ;
+    if(i == e->nafloat) {
+      e->weight[j]++;
+      return 1;
+    }
+  }
+  if(e->nlayout == ENDGAME_LAYOUTS)
+    return 0;
+  j = e->nlayout++;
+  e->bucket[b] = j + 1;
+  e->occ[j] = 0;
+  for(i = 0; i < e->nafloat; i++) {
+    e->ship[j][i] = chosen[e->afloat[i]];
+    e->occ[j] |= e->ship[j][i];
+  }
+  e->weight[j] = 1;
+  // by content, so the table stays good for the next shot of the game
+  e->zob[j] = h;
+  return 1;
+}
+
+// expected shots to sink every ship afloat over the given layouts, the best first shot in *pick;
+// only values under limit matter, past it any value at least limit may come back
+static double search(struct endgame* e, const short* set, int n, bitboard shot, double limit, int* pick)
+{
+  short part[OUTCOMES][ENDGAME_LAYOUTS];
+  int count[OUTCOMES];
+  long cover[TOT_ATK_CELL], total = 0, w[OUTCOMES];
+  uint64_t sig[TOT_ATK_CELL], key = 0;
+  double lb = 0, lbo[OUTCOMES], best = limit, v, rest, p;
+  int cells[TOT_ATK_CELL], ncell = 0, i, j, o, c, s, best_cell = -1;
+  bitboard left, open = 0, all = 0, bit, m;
+  struct endgame_entry* te = 0;
+  if(++e->nodes > ENDGAME_NODES) {
+    e->aborted = 1;
+    return 0;
+  }
+  // the cells some layout still needs, how likely each is a hit and which
+  // layouts it splits off how; cells that split them alike are as good as each other
+  memset(cover, 0, sizeof(cover));
+  memset(sig, 0, sizeof(sig));
+  for(i = 0; i < n; i++) {
+    j = set[i];
+    total += e->weight[j];
+    all |= e->occ[j];
+    left = e->occ[j] & ~shot;
+    open |= left;
+    lb += (double)e->weight[j] * bb_count(left);
+    for(s = 0; s < e->nafloat; s++) {
+      m = e->ship[j][s] & ~shot;
+      while(m) {
+        c = bb_pop(&m);
+        cover[c] += e->weight[j];
+        sig[c] += mix(e->zob[j] + s);
+      }
+    }
+    key ^= e->zob[j];
+  }
+  lb /= total;
+  if(!open)
+    return 0;
+  // only the shots inside these layouts matter from here on
+  key ^= mix_bb(shot & all);
+  // one layout left: its cells, in any order
+  if(n == 1) {
+    if(pick)
+      *pick = bb_first(open);
+    return lb;
+  }
+  if(!pick) {
+    te = &e->tt[key & (ENDGAME_TT - 1)];
+    if(te->gen == e->gen && te->key == key && (te->exact || te->value >= limit))
+      return te->value;
+  }
+  // likeliest hits first; a sure hit is as good as any shot, so take it alone
+  for(left = open; left; ) {
+    c = bb_pop(&left);
+    for(i = 0; i < ncell && sig[cells[i]] != sig[c]; i++)
+      ;
+    if(i < ncell)
+      continue;
+    for(i = ncell; i > 0 && cover[cells[i - 1]] < cover[c]; i--)
+      cells[i] = cells[i - 1];
+    cells[i] = c;
+    ncell++;
+  }
+  if(cover[cells[0]] == total)
+    ncell = 1;
+  for(i = 0; i < ncell; i++) {
+    c = cells[i];
+    bit = bb_cell(c);
+    // every layout loses at most this one cell, so nothing later can do better
+    if(1 + lb - (double)cover[c] / total >= best)
+      break;
+    memset(count, 0, sizeof(count));
+    memset(w, 0, sizeof(w));
+    memset(lbo, 0, sizeof(lbo));
+    for(j = 0; j < n; j++) {
+      if(!(e->occ[set[j]] & bit))
+        o = OUT_MISS;
+      else {
+        for(s = 0; !(e->ship[set[j]][s] & bit); s++)
+          ;
+        o = (e->ship[set[j]][s] & ~(shot | bit)) ? OUT_HIT : 2 + s;
+      }
+      part[o][count[o]++] = set[j];
+      w[o] += e->weight[set[j]];
+      lbo[o] += (double)e->weight[set[j]] * bb_count(e->occ[set[j]] & ~(shot | bit));
+    }
+    v = 1;
+    rest = (lb * total - cover[c]) / total;
+    for(o = 0; o < OUTCOMES && v + rest < best; o++) {
+      if(!count[o])
+        continue;
+      rest -= lbo[o] / total;
+      // the most this branch may cost before the cell loses to the best so far
+      p = (double)w[o] / total;
+      v += p * search(e, part[o], count[o], shot | bit, (best - v - rest) / p, 0);
+      if(e->aborted)
+        return 0;
+    }
+    if(v + rest < best && o == OUTCOMES) {
+      best = v;
+      best_cell = c;
+    }
+  }
+  if(pick)
+    *pick = best_cell;
+  if(te) {
+    te->key = key;
+    te->gen = e->gen;
+    te->value = best;
+    te->exact = best_cell >= 0;
+  }
+  return best;
+}
+
+// splitmix64 finalizer
+static uint64_t mix(uint64_t z)
+{
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+static uint64_t mix_bb(bitboard b)
+{
+  return mix((uint64_t)b ^ mix((uint64_t)(b >> 64) + 0x9e3779b97f4a7c15ULL));
+}
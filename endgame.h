@@ -0,0 +1,62 @@
+/******************************************************
+ * Description: Exact endgame solver. Once only a ship
+ *   or two is afloat it lists every layout of those
+ *   ships that fits what the shooter knows, weighted by
+ *   how many whole-fleet layouts agree with it, and
+ *   searches the shot tree for the cell that minimizes
+ *   the expected number of shots left. Positions met
+ *   again by another shot order come out of a
+ *   transposition table keyed by the shots so far and
+ *   the layouts still possible, kept from one shot of a
+ *   game to the next. It gives up rather than take long
+ *   when there are too many layouts or the search runs
+ *   past its node budget.
+ ******************************************************/
+
+#ifndef ENDGAME_H
+#define ENDGAME_H
+
+#include <stdint.h>
+
+#include "engine.h"
+#include "place.h"
+#include "sampler.h"
+
+// ships afloat the solver takes on
+#define ENDGAME_SHIPS 2
+// distinct layouts of the ships afloat
+#define ENDGAME_LAYOUTS 16
+// transposition table entries, a power of two
+#define ENDGAME_TT (1 << 14)
+// search nodes per decision, a few milliseconds
+#define ENDGAME_NODES 8000
+
+struct endgame_entry {
+  uint64_t key;
+  uint32_t gen;         // endgame_init() it was stored after
+  float value;          // expected shots left
+  int exact;            // 0 if only a lower bound, the search was cut short
+};
+
+struct endgame {
+  int nafloat;
+  int afloat[ENDGAME_SHIPS];                          // ship indexes
+  int nlayout;
+  bitboard ship[ENDGAME_LAYOUTS][ENDGAME_SHIPS];      // cells of each ship afloat
+  bitboard occ[ENDGAME_LAYOUTS];                      // all of them
+  long weight[ENDGAME_LAYOUTS];                       // whole-fleet layouts behind it
+  uint64_t zob[ENDGAME_LAYOUTS];                      // hash key of each layout
+  short bucket[2 * ENDGAME_LAYOUTS];                  // layout + 1 by hash, to merge repeats
+  long nodes;
+  int aborted;
+  uint32_t gen;
+  struct endgame_entry tt[ENDGAME_TT];
+  // placements each ship may have, scratch for the enumeration
+  bitboard cand[SHIP_COUNT][SHIP_PLACE_MAX];
+  short cand_count[SHIP_COUNT];
+};
+
+void endgame_init(struct endgame*);
+int endgame_solve(struct endgame*, const struct sample_knowledge*, double*);
+
+#endif
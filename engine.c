@@ -0,0 +1,424 @@
+/******************************************************
+ * Description: Headless rules engine for the battleship
+ *   game: ship deployment, alignment checks, shot
+ *   resolution and win detection on a struct game.
+ *   Deployments are checked against the placement
+ *   tables in place.c.
+ ******************************************************/
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "engine.h"
+#include "place.h"
+#include "rng.h"
+
+const char* ship_types[SHIP_COUNT] = {
+  "Aircraft Carrier", "Battleship", "Frigate", "Submarine", "Minesweeper"
+};
+const int ship_lengths[SHIP_COUNT] = { A_LEN, B_LEN, F_LEN, S_LEN, M_LEN };
+
+
+// reset a game to empty boards and undeployed fleets
+void engine_init(struct game* g)
+{
+  int p, i, j;
+  memset(g, 0, sizeof(*g));
+  for(p = 0; p < 2; p++) {
+    struct side* sd = &g->side[p];
+    for(i = 0; i < SHIP_COUNT; i++) {
+      strcpy(sd->ships[i].type, ship_types[i]);
+      sd->ships[i].length = ship_lengths[i];
+      for(j = 0; j < MAX_SHIP_LEN; j++) {
+        sd->ships[i].x[j] = -1;
+        sd->ships[i].y[j] = -1;
+      }
+    }
+  }
+}
+
+// deploy one cell of ship ch for a player
+int engine_deploy_cell(struct game* g, int mode, char ch, int y_i, int x_i)
+{
+  struct side* sd = &g->side[mode];
+  struct ship* s = engine_ship_by_ch(g, mode, ch);
+  int err;
+  if(!s || !check_border(y_i, x_i) || bb_test(sd->occupied, CELL(y_i, x_i)))
+    return DEPLOY_BAD;
+  if((err = engine_check_align(g, mode, s - sd->ships, y_i, x_i)) <= 0)
+    return err;
+  sd->ship_mask[s - sd->ships] |= bb_cell(CELL(y_i, x_i));
+  sd->occupied |= bb_cell(CELL(y_i, x_i));
+  s->x[s->num_cell_deployed] = x_i;
+  s->y[s->num_cell_deployed] = y_i;
+  s->num_cell_deployed++;
+  sd->cells_deployed++;
+  if(s->num_cell_deployed == s->length)
+    s->has_deployed = 1;
+  return DEPLOY_OK;
+}
+
+// remove a deployed cell, return 1 if there was one
+int engine_erase_cell(struct game* g, int mode, int y_i, int x_i)
+{
+  struct side* sd = &g->side[mode];
+  struct ship* s;
+  int i;
+  if(!check_border(y_i, x_i) || !(s = engine_ship_at(g, mode, y_i, x_i)))
+    return 0;
+  for(i = 0; i < s->num_cell_deployed; i++) {
+    if(s->y[i] == y_i && s->x[i] == x_i) {
+      s->num_cell_deployed--;
+      s->y[i] = s->y[s->num_cell_deployed];
+      s->x[i] = s->x[s->num_cell_deployed];
+      s->y[s->num_cell_deployed] = -1;
+      s->x[s->num_cell_deployed] = -1;
+      break;
+    }
+  }
+  s->has_deployed = 0;
+  sd->ship_mask[s - sd->ships] &= ~bb_cell(CELL(y_i, x_i));
+  sd->occupied &= ~bb_cell(CELL(y_i, x_i));
+  sd->cells_deployed--;
+  return 1;
+}
+
+// place a whole ship starting at (y_i, x_i), going down if vertical
+int engine_place_ship(struct game* g, int mode, int idx, int y_i, int x_i, int vertical)
+{
+  struct side* sd = &g->side[mode];
+  struct ship* s = &sd->ships[idx];
+  int i, dy = vertical ? 1 : 0, dx = vertical ? 0 : 1;
+  bitboard mask = 0;
+  if(s->num_cell_deployed)
+    return 0;
+  if(!check_border(y_i + dy * (s->length - 1), x_i + dx * (s->length - 1)) ||
+     !check_border(y_i, x_i))
+    return 0;
+  for(i = 0; i < s->length; i++)
+    mask |= bb_cell(CELL(y_i + dy * i, x_i + dx * i));
+  if(sd->occupied & mask)
+    return 0;
+  for(i = 0; i < s->length; i++) {
+    s->y[i] = y_i + dy * i;
+    s->x[i] = x_i + dx * i;
+  }
+  sd->ship_mask[idx] = mask;
+  sd->occupied |= mask;
+  s->num_cell_deployed = s->length;
+  s->has_deployed = 1;
+  sd->cells_deployed += s->length;
+  return 1;
+}
+
+// check if a player finished deployment
+int engine_fleet_deployed(const struct game* g, int mode)
+{
+  return g->side[mode].cells_deployed == TOT_SHIP_CELL;
+}
+
+// deploy a random legal fleet for a player
+void engine_random_fleet(struct game* g, int mode, struct rng* r)
+{
+  int i, vertical, span;
+  for(i = 0; i < SHIP_COUNT; i++) {
+    span = BOARD_SIZE - ship_lengths[i] + 1;
+    do {
+      vertical = rng_range(r, 2);
+    } while(!(vertical ?
+              engine_place_ship(g, mode, i, rng_range(r, span), rng_range(r, BOARD_SIZE), 1) :
+              engine_place_ship(g, mode, i, rng_range(r, BOARD_SIZE), rng_range(r, span), 0)));
+  }
+}
+
+// deploy a whole fleet at once, all or nothing, return 1 if it was legal
+int engine_place_fleet(struct game* g, int mode, const unsigned char* fleet)
+{
+  struct side saved = g->side[mode];
+  int i, c;
+  if(g->side[mode].cells_deployed)
+    return 0;
+  for(i = 0; i < SHIP_COUNT; i++) {
+    c = FLEET_CELL(fleet[i]);
+    if(c >= TOT_ATK_CELL ||
+       !engine_place_ship(g, mode, i, c / BOARD_SIZE, c % BOARD_SIZE, (fleet[i] & FLEET_DOWN) != 0)) {
+      g->side[mode] = saved;
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// the layout of a fully deployed fleet, return 0 if it is not
+int engine_fleet_layout(const struct game* g, int mode, unsigned char* fleet)
+{
+  const struct side* sd = &g->side[mode];
+  int i, c;
+  if(!engine_fleet_deployed(g, mode))
+    return 0;
+  for(i = 0; i < SHIP_COUNT; i++) {
+    c = bb_first(sd->ship_mask[i]);
+    fleet[i] = c | (bb_test(sd->ship_mask[i], c + BOARD_SIZE) ? FLEET_DOWN : 0);
+  }
+  return 1;
+}
+
+// read "A A1 h B C3 v ..." (ship, top/left cell, h or v), every ship
+// once in any order, return 0 or -1 if the text is not a whole fleet
+int engine_parse_fleet(const char* text, unsigned char* fleet)
+{
+  char t, y, dir;
+  int x, n, i, seen = 0;
+  while(sscanf(text, " %c %c%d %c%n", &t, &y, &x, &dir, &n) == 4) {
+    text += n;
+    i = engine_ship_index(toupper(t));
+    y = toupper(y);
+    dir = tolower(dir);
+    if(i < 0 || (seen >> i) & 1 || y < 'A' || y >= 'A' + BOARD_SIZE || x < 0 || x >= BOARD_SIZE ||
+       (dir != 'h' && dir != 'v'))
+      return -1;
+    fleet[i] = CELL(row_char2index(y), col_num2index(x)) | (dir == 'v' ? FLEET_DOWN : 0);
+    seen |= 1 << i;
+  }
+  while(isspace((unsigned char)*text))
+    text++;
+  return *text || seen != (1 << SHIP_COUNT) - 1 ? -1 : 0;
+}
+
+// write a fleet layout in the engine_parse_fleet() format, return its length
+int engine_format_fleet(const unsigned char* fleet, char* out)
+{
+  int i, c, n = 0;
+  for(i = 0; i < SHIP_COUNT; i++) {
+    c = FLEET_CELL(fleet[i]);
+    n += sprintf(out + n, "%s%c %c%d %c", i ? " " : "", ship_types[i][0], row_index2char(c / BOARD_SIZE),
+                 col_index2num(c % BOARD_SIZE), fleet[i] & FLEET_DOWN ? 'v' : 'h');
+  }
+  return n;
+}
+
+// bomb a cell on the given player's board
+int engine_attack(struct game* g, int mode, int y_i, int x_i)
+{
+  struct side* sd = &g->side[mode];
+  bitboard bit;
+  int i;
+  if(!check_border(y_i, x_i))
+    return SHOT_REPEAT;
+  bit = bb_cell(CELL(y_i, x_i));
+  if((sd->hits | sd->misses) & bit)
+    return SHOT_REPEAT;
+  g->shots[!mode]++;
+  // miss
+  if(!(sd->occupied & bit)) {
+    sd->misses |= bit;
+    return SHOT_MISS;
+  }
+  // hit, sank any ship?
+  sd->hits |= bit;
+  for(i = 0; !(sd->ship_mask[i] & bit); i++)
+    ;
+  if(sd->ship_mask[i] & ~sd->hits)
+    return SHOT_HIT;
+  sd->ships[i].is_sunk = 1;
+  return SHOT_SUNK;
+}
+
+// put down a shot someone else resolved: SHOT_* result and the ship it sank;
+// on a board whose fleet is hidden the sinks are all that is known of it. 0 if already shot
+int engine_record(struct game* g, int mode, int y_i, int x_i, int res, int ship)
+{
+  struct side* sd = &g->side[mode];
+  bitboard bit;
+  int i;
+  if(!check_border(y_i, x_i))
+    return 0;
+  bit = bb_cell(CELL(y_i, x_i));
+  if((sd->hits | sd->misses) & bit)
+    return 0;
+  g->shots[!mode]++;
+  if(res == SHOT_MISS)
+    sd->misses |= bit;
+  else
+    sd->hits |= bit;
+  if(res != SHOT_SUNK || ship < 0 || ship >= SHIP_COUNT)
+    return 1;
+  sd->ships[ship].is_sunk = 1;
+  if(sd->occupied)
+    return 1;
+  // once a hidden fleet is all sunk its cells are the hits, which is what engine_win() looks at
+  for(i = 0; i < SHIP_COUNT && sd->ships[i].is_sunk; i++)
+    ;
+  if(i == SHIP_COUNT)
+    sd->occupied = sd->hits;
+  return 1;
+}
+
+// check if all ships of a player are sunk
+int engine_fleet_sunk(const struct game* g, int mode)
+{
+  const struct side* sd = &g->side[mode];
+  return sd->occupied && !(sd->occupied & ~sd->hits);
+}
+
+// determine if anyone wins: 1 tie, 2 P1 wins, 3 P2 wins
+int engine_win(const struct game* g)
+{
+  int p1_all_sunk = engine_fleet_sunk(g, P1);
+  int p2_all_sunk = engine_fleet_sunk(g, P2);
+  if(p1_all_sunk && p2_all_sunk)
+    return 1;
+  else if(p2_all_sunk)
+    return 2;
+  else if(p1_all_sunk)
+    return 3;
+  return 0;
+}
+
+// all cells of a player's board not bombarded yet
+bitboard engine_unshot(const struct game* g, int mode)
+{
+  return BB_BOARD & ~(g->side[mode].hits | g->side[mode].misses);
+}
+
+// check if given cell lines up with the deployed cells of ship idx and
+// the ship can still be finished around the other ships
+int engine_check_align(const struct game* g, int mode, int idx, int y_i, int x_i)
+{
+  const struct side* sd = &g->side[mode];
+  bitboard part = sd->ship_mask[idx] | bb_cell(CELL(y_i, x_i));
+  if(sd->ships[idx].has_deployed)
+    return DEPLOY_DONE;
+  if(!place_is_run(part) || !place_find(idx, part, sd->occupied & ~sd->ship_mask[idx], 0))
+    return DEPLOY_BAD;
+  return DEPLOY_OK;
+}
+
+// placements ship idx can still take given its deployed cells and the
+// other ships, return how many and store their place.h numbers in out if given
+int engine_placements(const struct game* g, int mode, int idx, short* out)
+{
+  const struct side* sd = &g->side[mode];
+  if(sd->ships[idx].num_cell_deployed && !place_is_run(sd->ship_mask[idx]))
+    return 0;
+  return place_find(idx, sd->ship_mask[idx], sd->occupied & ~sd->ship_mask[idx], out);
+}
+
+// deploy the rest of ship idx if only one placement is left for it,
+// return the cells added, in a deploy order, and how many
+int engine_complete_ship(struct game* g, int mode, int idx, int* cells)
+{
+  const struct placement* pl;
+  struct ship* s = &g->side[mode].ships[idx];
+  bitboard part = g->side[mode].ship_mask[idx];
+  short p;
+  int i, first, n = 0;
+  // count first, out gets every placement there is
+  if(s->has_deployed || !part || engine_placements(g, mode, idx, 0) != 1)
+    return 0;
+  engine_placements(g, mode, idx, &p);
+  pl = &places->place[p];
+  for(first = 0; !bb_test(part, pl->cell[first]); first++)
+    ;
+  // grow from the deployed run: forward to the end, then back to the start
+  for(i = first; i < pl->len; i++)
+    if(!bb_test(part, pl->cell[i]))
+      cells[n++] = pl->cell[i];
+  for(i = first - 1; i >= 0; i--)
+    cells[n++] = pl->cell[i];
+  for(i = 0; i < n; i++)
+    engine_deploy_cell(g, mode, ship_types[idx][0], cells[i] / BOARD_SIZE, cells[i] % BOARD_SIZE);
+  return n;
+}
+
+// return reference to a ship with given mode and coordinate
+struct ship* engine_ship_at(struct game* g, int mode, int y_i, int x_i)
+{
+  struct side* sd = &g->side[mode];
+  bitboard bit = bb_cell(CELL(y_i, x_i));
+  int i;
+  if(!(sd->occupied & bit))
+    return 0;
+  for(i = 0; !(sd->ship_mask[i] & bit); i++)
+    ;
+  return &sd->ships[i];
+}
+
+// return reference to a ship with given char
+struct ship* engine_ship_by_ch(struct game* g, int mode, char ch)
+{
+  int i = engine_ship_index(ch);
+  return (i < 0) ? 0 : &g->side[mode].ships[i];
+}
+
+// map a ship letter to its index in the ship arrays
+int engine_ship_index(char ch)
+{
+  switch(ch) {
+    case 'A':
+      return A;
+    case 'B':
+      return B;
+    case 'F':
+      return F;
+    case 'S':
+      return S;
+    case 'M':
+      return M;
+    default:
+      return -1;
+  }
+}
+
+// ship letter or '.' at a cell of a player's layout
+char engine_board_ch(const struct game* g, int mode, int y_i, int x_i)
+{
+  const struct side* sd = &g->side[mode];
+  bitboard bit = bb_cell(CELL(y_i, x_i));
+  int i;
+  if(!(sd->occupied & bit))
+    return '.';
+  for(i = 0; !(sd->ship_mask[i] & bit); i++)
+    ;
+  return sd->ships[i].type[0];
+}
+
+// 'X', 'O' or '.' for shots received at a cell
+char engine_shot_ch(const struct game* g, int mode, int y_i, int x_i)
+{
+  bitboard bit = bb_cell(CELL(y_i, x_i));
+  if(g->side[mode].hits & bit)
+    return 'X';
+  return (g->side[mode].misses & bit) ? 'O' : '.';
+}
+
+// check if array indexes are within the board
+int check_border(int y_i, int x_i)
+{
+  return y_i >= 0 && y_i < BOARD_SIZE && x_i >= 0 && x_i < BOARD_SIZE;
+}
+
+// convert row board letter to array index
+int row_char2index(char c)
+{
+  return (int)(c - 'A');
+}
+
+// convert row array index to board letter
+char row_index2char(int i)
+{
+  return (char)(i + 'A');
+}
+
+// convert column board number to array index
+int col_num2index(int i)
+{
+  return (i == 0) ? BOARD_SIZE - 1 : i - 1;
+}
+
+// convert column array index to board number
+int col_index2num(int i)
+{
+  return (i == BOARD_SIZE - 1) ? 0 : i + 1;
+}
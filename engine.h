@@ -0,0 +1,121 @@
+/******************************************************
+ * Description: Headless rules engine for the battleship
+ *   game. All state lives in a struct game passed in
+ *   by the caller, so the engine has no globals and
+ *   does no I/O.
+ ******************************************************/
+
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include "bitboard.h"
+
+// index for the struct ship arrays
+#define A 0
+#define B 1
+#define F 2
+#define S 3
+#define M 4
+// length of each ship
+#define A_LEN 5
+#define B_LEN 4
+#define F_LEN 3
+#define S_LEN 3
+#define M_LEN 2
+// mode for deploy & attack phase
+#define P1 0
+#define P2 1
+// general consts
+#define TOT_SHIP_CELL 17
+#define TOT_ATK_CELL 100
+#define BOARD_SIZE  10
+#define SHIP_COUNT  5
+#define MAX_SHIP_LEN 5
+// results of a deploy
+#define DEPLOY_DONE    -1   // ship already fully deployed
+#define DEPLOY_BAD      0   // cell not aligned with the ship
+#define DEPLOY_OK       1
+// results of an attack
+#define SHOT_REPEAT 0   // cell has already been bombarded
+#define SHOT_MISS   1
+#define SHOT_HIT    2
+#define SHOT_SUNK   3
+
+// ship struct
+struct ship {
+  char type[25];
+  int length;
+  int y[MAX_SHIP_LEN];
+  int x[MAX_SHIP_LEN];
+  int is_sunk;
+  int has_deployed;
+  int num_cell_deployed;
+};
+
+// one player's half of the game
+struct side {
+  bitboard ship_mask[SHIP_COUNT];   // cells of each ship
+  bitboard occupied;                // cells of all ships
+  bitboard hits;                    // shots received that hit a ship
+  bitboard misses;                  // shots received that missed
+  struct ship ships[SHIP_COUNT];
+  int cells_deployed;
+};
+
+// whole-fleet layout: start cell of each ship, FLEET_DOWN set if it runs down
+#define FLEET_DOWN 0x80
+#define FLEET_CELL(v) ((v) & ~FLEET_DOWN)
+// "A A1 h " per ship, and a NUL
+#define FLEET_TEXT_MAX (SHIP_COUNT * 8 + 1)
+
+// board cell index for bitboards
+#define CELL(y, x) ((y) * BOARD_SIZE + (x))
+// mask of every cell on the board
+#define BB_BOARD BB_FIRST(TOT_ATK_CELL)
+
+struct rng;
+
+// standard fleet, indexed A..M
+extern const char* ship_types[SHIP_COUNT];
+extern const int ship_lengths[SHIP_COUNT];
+
+// complete game state
+struct game {
+  struct side side[2];
+  int shots[2];       // shots fired by each player
+};
+
+// setup
+void engine_init(struct game*);
+int engine_deploy_cell(struct game*, int, char, int, int);
+int engine_erase_cell(struct game*, int, int, int);
+int engine_place_ship(struct game*, int, int, int, int, int);
+int engine_fleet_deployed(const struct game*, int);
+void engine_random_fleet(struct game*, int, struct rng*);
+int engine_place_fleet(struct game*, int, const unsigned char*);
+int engine_fleet_layout(const struct game*, int, unsigned char*);
+int engine_parse_fleet(const char*, unsigned char*);
+int engine_format_fleet(const unsigned char*, char*);
+// attack
+int engine_attack(struct game*, int, int, int);
+int engine_record(struct game*, int, int, int, int, int);
+int engine_fleet_sunk(const struct game*, int);
+int engine_win(const struct game*);
+bitboard engine_unshot(const struct game*, int);
+// queries
+int engine_check_align(const struct game*, int, int, int, int);
+int engine_placements(const struct game*, int, int, short*);
+int engine_complete_ship(struct game*, int, int, int*);
+struct ship* engine_ship_at(struct game*, int, int, int);
+struct ship* engine_ship_by_ch(struct game*, int, char);
+int engine_ship_index(char);
+char engine_board_ch(const struct game*, int, int, int);
+char engine_shot_ch(const struct game*, int, int, int);
+// coordinate helpers
+int check_border(int, int);
+int row_char2index(char);
+char row_index2char(int);
+int col_num2index(int);
+int col_index2num(int);
+
+#endif
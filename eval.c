@@ -0,0 +1,454 @@
+/******************************************************
+ * Description: Strategy evaluation. Every strategy
+ *   fires alone at the same corpus of fleet layouts
+ *   (random, hard, or the fleets of replay logs) until
+ *   each fleet is sunk, and the shots it took out of
+ *   the 100 cells are tallied into a distribution.
+ *   Fleets are played in rounds that double the total
+ *   so far, chunked over the work-stealing pool; after
+ *   each round the confidence interval of every mean
+ *   is checked and the run stops as soon as all of
+ *   them are tight enough. The intervals are wide
+ *   enough to hold over every look at once, so
+ *   stopping early does not make them lie. Strategies
+ *   are ranked by mean, each against the next on the
+ *   paired differences of the fleets they shared.
+ ******************************************************/
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "engine.h"
+#include "gamelog.h"
+#include "place.h"
+#include "pool.h"
+#include "rng.h"
+#include "strategy.h"
+#include "timer.h"
+
+// fleets played by one task
+#define CHUNK 256
+// fleets in the first round
+#define FIRST_ROUND 2048
+// random fleets a hard fleet is picked out of
+#define HARD_TRIES 16
+// two-sided 95% normal quantile split over ten looks (Bonferroni)
+#define Z_LOOKS 2.807
+
+// corpus kinds
+#define CORPUS_RANDOM 0
+#define CORPUS_HARD 1
+#define CORPUS_LOGS 2
+
+// shots-to-sink of one strategy
+struct eval_stats {
+  long n;
+  double sum, sumsq;
+  long hist[TOT_ATK_CELL + 1];
+};
+
+// paired shot differences of two strategies over the same fleets
+struct pair_stats {
+  double sum, sumsq;
+};
+
+// a run of fleets and what every strategy made of them
+struct task {
+  long first;
+  int count;
+  struct eval_stats* st;        // one per strategy
+  struct pair_stats* pair;      // nstrat * nstrat
+};
+
+// everything a worker touches while playing
+struct worker {
+  struct game g;
+  struct rng r;
+  void** state;                 // one state buffer per strategy
+  int* shots;                   // shots of each strategy at the current fleet
+} __attribute__((aligned(64)));
+
+struct eval {
+  int nstrat;
+  const struct strategy** strat;
+  int corpus;
+  unsigned char (*fleets)[SHIP_COUNT];  // CORPUS_LOGS
+  long nfleet;
+  uint64_t seed;
+  struct worker* workers;
+};
+
+void run_chunk(int, void*, void*);
+void make_fleet(struct eval*, struct rng*, long, unsigned char*);
+void load_log(const char*, struct eval*);
+void merge(struct eval*, struct task*, int, struct eval_stats*, struct pair_stats*);
+double std_dev(long, double, double);
+double interval(long, double, double);
+double half_width(const struct eval_stats*);
+int percentile(const struct eval_stats*, double);
+void report(struct eval*, struct eval_stats*, struct pair_stats*, int, double, int);
+
+
+int main(int argc, char** argv)
+{
+  static const struct strategy* picked[64];
+  int opt, i, w, ntask, rounds = 0, dist = 0, npick = 0, threads = pool_cpus();
+  long limit = 1000000, done = 0, next, first;
+  double target = 0.25, start, secs;
+  struct eval_stats* total;
+  struct pair_stats* pair;
+  struct task* tasks;
+  struct pool* pool;
+  struct eval ev;
+
+  memset(&ev, 0, sizeof(ev));
+  ev.seed = 1;
+  while((opt = getopt(argc, argv, "a:f:e:n:s:t:d")) != -1) {
+    switch(opt) {
+      case 'a':
+        if(!(picked[npick] = strategy_find(optarg))) {
+          fprintf(stderr, "unknown strategy: %s\n", optarg);
+          return 1;
+        }
+        if(npick < 63)
+          npick++;
+        break;
+      case 'f':
+        if(!strcmp(optarg, "random"))
+          ev.corpus = CORPUS_RANDOM;
+        else if(!strcmp(optarg, "hard"))
+          ev.corpus = CORPUS_HARD;
+        else {
+          fprintf(stderr, "unknown corpus: %s (random or hard)\n", optarg);
+          return 1;
+        }
+        break;
+      case 'e':
+        // wanted half width of every interval, in shots
+        target = atof(optarg);
+        break;
+      case 'n':
+        limit = atol(optarg);
+        break;
+      case 's':
+        ev.seed = strtoul(optarg, 0, 10);
+        break;
+      case 't':
+        threads = atoi(optarg);
+        break;
+      case 'd':
+        // print the whole distribution
+        dist = 1;
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-a strategy]... [-f random|hard] [-e half-width] [-n max fleets] "
+                "[-s seed] [-t threads] [-d] [log...]\n", argv[0]);
+        return 1;
+    }
+  }
+  if(threads < 1)
+    threads = 1;
+  if(limit < 1)
+    limit = 1;
+
+  // every strategy unless some were named
+  if(!npick)
+    for(; strategies[npick] && npick < 63; npick++)
+      picked[npick] = strategies[npick];
+  ev.strat = picked;
+  ev.nstrat = npick;
+
+  // logs replace the generated corpus with the fleets that were really played
+  place_init();
+  if(optind < argc) {
+    ev.corpus = CORPUS_LOGS;
+    for(; optind < argc; optind++)
+      load_log(argv[optind], &ev);
+    if(!ev.nfleet) {
+      fprintf(stderr, "no whole fleet in the logs\n");
+      return 1;
+    }
+    if(limit > ev.nfleet)
+      limit = ev.nfleet;
+  }
+
+  if(posix_memalign((void**)&ev.workers, 64, threads * sizeof(struct worker)))
+    return 1;
+  for(w = 0; w < threads; w++) {
+    ev.workers[w].state = malloc(ev.nstrat * sizeof(void*));
+    ev.workers[w].shots = malloc(ev.nstrat * sizeof(int));
+    for(i = 0; i < ev.nstrat; i++)
+      ev.workers[w].state[i] = malloc(ev.strat[i]->size);
+  }
+  total = calloc(ev.nstrat, sizeof(*total));
+  pair = calloc(ev.nstrat * ev.nstrat, sizeof(*pair));
+  if(!(pool = pool_create(threads, run_chunk, &ev)) || !total || !pair)
+    return 1;
+
+  // rounds double what has been played, so there are few looks at the intervals
+  start = now();
+  do {
+    next = done ? 2 * done : FIRST_ROUND;
+    if(next > limit)
+      next = limit;
+    ntask = (next - done + CHUNK - 1) / CHUNK;
+    if(!(tasks = calloc(ntask, sizeof(*tasks))))
+      return 1;
+    for(i = 0, first = done; i < ntask; i++, first += CHUNK) {
+      tasks[i].first = first;
+      tasks[i].count = next - first < CHUNK ? next - first : CHUNK;
+      tasks[i].st = calloc(ev.nstrat, sizeof(struct eval_stats));
+      tasks[i].pair = calloc(ev.nstrat * ev.nstrat, sizeof(struct pair_stats));
+      if(!tasks[i].st || !tasks[i].pair)
+        return 1;
+      pool_submit(pool, i, &tasks[i]);
+    }
+    pool_run(pool);
+    merge(&ev, tasks, ntask, total, pair);
+    free(tasks);
+    done = next;
+    rounds++;
+    for(i = 0; i < ev.nstrat && half_width(&total[i]) <= target; i++)
+      ;
+  } while(i < ev.nstrat && done < limit);
+  secs = now() - start;
+
+  report(&ev, total, pair, rounds, secs, dist);
+  pool_destroy(pool);
+  return 0;
+}
+
+// play one run of fleets with every strategy on worker w
+void run_chunk(int w, void* arg, void* ctx)
+{
+  struct task* tk = arg;
+  struct eval* ev = ctx;
+  struct worker* wk = &ev->workers[w];
+  unsigned char fleet[SHIP_COUNT];
+  struct rng fr;
+  int f, i, j, n, d;
+  // seeding per task keeps results independent of the thread count
+  rng_seed(&fr, ev->seed * 0x100000001b3ULL + tk->first);
+  rng_seed(&wk->r, ~ev->seed * 0x9e3779b97f4a7c15ULL + tk->first);
+  for(f = 0; f < tk->count; f++) {
+    make_fleet(ev, &fr, tk->first + f, fleet);
+    for(i = 0; i < ev->nstrat; i++) {
+      engine_init(&wk->g);
+      engine_place_fleet(&wk->g, P2, fleet);
+      ev->strat[i]->reset(wk->state[i], &wk->r);
+      for(n = 0; !engine_fleet_sunk(&wk->g, P2) && n < TOT_ATK_CELL; n++)
+        strategy_fire(ev->strat[i], wk->state[i], &wk->g, P2, 0);
+      wk->shots[i] = n;
+      tk->st[i].n++;
+      tk->st[i].sum += n;
+      tk->st[i].sumsq += (double)n * n;
+      tk->st[i].hist[n]++;
+    }
+    for(i = 0; i < ev->nstrat; i++) {
+      for(j = 0; j < ev->nstrat; j++) {
+        d = wk->shots[i] - wk->shots[j];
+        tk->pair[i * ev->nstrat + j].sum += d;
+        tk->pair[i * ev->nstrat + j].sumsq += (double)d * d;
+      }
+    }
+  }
+}
+
+// fleet i of the corpus; generated ones come in order from the task's rng
+void make_fleet(struct eval* ev, struct rng* r, long i, unsigned char* fleet)
+{
+  struct game g;
+  bitboard left;
+  long heat, best = -1;
+  int k;
+  if(ev->corpus == CORPUS_LOGS) {
+    memcpy(fleet, ev->fleets[i % ev->nfleet], SHIP_COUNT);
+    return;
+  }
+  // a hard fleet sits on the cells the fewest placements cover, where shooters look last
+  for(k = 0; k < (ev->corpus == CORPUS_HARD ? HARD_TRIES : 1); k++) {
+    engine_init(&g);
+    engine_random_fleet(&g, P2, r);
+    for(heat = 0, left = g.side[P2].occupied; left; )
+      heat += places->cell_place_count[bb_pop(&left)];
+    if(best < 0 || heat < best) {
+      best = heat;
+      engine_fleet_layout(&g, P2, fleet);
+    }
+  }
+}
+
+// add the fleets of every game in a log that got both of them down
+void load_log(const char* path, struct eval* ev)
+{
+  struct log_rec r;
+  struct stat sb;
+  struct game g;
+  unsigned char* p;
+  void* grown;
+  long off, len, cap = ev->nfleet;
+  int fd, side, ingame = 0;
+  if((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &sb) < 0) {
+    perror(path);
+    exit(1);
+  }
+  len = sb.st_size - sb.st_size % LOG_REC;
+  if(!len) {
+    close(fd);
+    return;
+  }
+  if((p = mmap(0, len, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+    perror(path);
+    exit(1);
+  }
+  madvise(p, len, MADV_SEQUENTIAL);
+  close(fd);
+
+  // a start record past the end closes the last game
+  for(off = 0; off <= len; off += LOG_REC) {
+    if(off < len)
+      gamelog_decode(p + off, &r);
+    if(off == len || r.type == LOG_GAME) {
+      for(side = P1; ingame && side <= P2; side++) {
+        if(!engine_fleet_deployed(&g, side))
+          continue;
+        if(ev->nfleet == cap) {
+          cap = cap ? 2 * cap : 1024;
+          if(!(grown = realloc(ev->fleets, cap * sizeof(*ev->fleets)))) {
+            perror("realloc");
+            exit(1);
+          }
+          ev->fleets = grown;
+        }
+        engine_fleet_layout(&g, side, ev->fleets[ev->nfleet++]);
+      }
+      engine_init(&g);
+      ingame = 1;
+    }
+    else if(r.type == LOG_DEPLOY && ingame && r.side <= P2 && r.cell < TOT_ATK_CELL && r.arg < SHIP_COUNT)
+      engine_deploy_cell(&g, r.side, ship_types[r.arg][0], r.cell / BOARD_SIZE, r.cell % BOARD_SIZE);
+  }
+  munmap(p, len);
+}
+
+// add a round's task counters to the totals
+void merge(struct eval* ev, struct task* tasks, int ntask, struct eval_stats* total, struct pair_stats* pair)
+{
+  int t, i, s;
+  for(t = 0; t < ntask; t++) {
+    for(i = 0; i < ev->nstrat; i++) {
+      total[i].n += tasks[t].st[i].n;
+      total[i].sum += tasks[t].st[i].sum;
+      total[i].sumsq += tasks[t].st[i].sumsq;
+      for(s = 0; s <= TOT_ATK_CELL; s++)
+        total[i].hist[s] += tasks[t].st[i].hist[s];
+    }
+    for(i = 0; i < ev->nstrat * ev->nstrat; i++) {
+      pair[i].sum += tasks[t].pair[i].sum;
+      pair[i].sumsq += tasks[t].pair[i].sumsq;
+    }
+    free(tasks[t].st);
+    free(tasks[t].pair);
+  }
+}
+
+// sample standard deviation of n values from their sum and sum of squares
+double std_dev(long n, double sum, double sumsq)
+{
+  double var = n > 1 ? (sumsq - sum * sum / n) / (n - 1) : 0;
+  return var > 0 ? sqrt(var) : 0;
+}
+
+// half width of the interval around the mean of n values
+double interval(long n, double sum, double sumsq)
+{
+  return n > 1 ? Z_LOOKS * std_dev(n, sum, sumsq) / sqrt(n) : INFINITY;
+}
+
+// half width of the interval around a strategy's mean
+double half_width(const struct eval_stats* s)
+{
+  return interval(s->n, s->sum, s->sumsq);
+}
+
+// shots within which a fraction q of the fleets went down
+int percentile(const struct eval_stats* s, double q)
+{
+  long seen = 0;
+  int k;
+  for(k = 0; k < TOT_ATK_CELL; k++)
+    if((seen += s->hist[k]) >= q * s->n)
+      break;
+  return k;
+}
+
+// print the ranking, the intervals and the distributions
+void report(struct eval* ev, struct eval_stats* total, struct pair_stats* pair, int rounds, double secs, int dist)
+{
+  static const char* corpora[] = { "random", "hard", "logs" };
+  struct pair_stats* p;
+  int order[64], i, j, k, a, b, lo = TOT_ATK_CELL, hi = 0;
+  long fleets = total[0].n;
+  double diff, hw;
+  // best mean first
+  for(i = 0; i < ev->nstrat; i++) {
+    for(j = i; j > 0 && total[order[j - 1]].sum > total[i].sum; j--)
+      order[j] = order[j - 1];
+    order[j] = i;
+  }
+
+  printf("%-10s %9s %8s %8s %6s %4s %4s %4s %4s %4s %4s\n", "strategy", "fleets", "mean", "+-",
+         "sd", "min", "p10", "p50", "p90", "p99", "max");
+  for(i = 0; i < ev->nstrat; i++) {
+    struct eval_stats* s = &total[order[i]];
+    for(j = 0; !s->hist[j]; j++)
+      ;
+    for(k = TOT_ATK_CELL; !s->hist[k]; k--)
+      ;
+    lo = j < lo ? j : lo;
+    hi = k > hi ? k : hi;
+    printf("%-10s %9ld %8.3f %8.3f %6.2f %4d %4d %4d %4d %4d %4d\n", ev->strat[order[i]]->name, s->n,
+           s->sum / s->n, half_width(s), std_dev(s->n, s->sum, s->sumsq),
+           j, percentile(s, 0.1), percentile(s, 0.5), percentile(s, 0.9), percentile(s, 0.99), k);
+  }
+
+  // neighbours in the ranking, on the fleets both played
+  if(ev->nstrat > 1)
+    printf("\n");
+  for(i = 0; i + 1 < ev->nstrat; i++) {
+    a = order[i];
+    b = order[i + 1];
+    p = &pair[a * ev->nstrat + b];
+    diff = p->sum / fleets;
+    hw = interval(fleets, p->sum, p->sumsq);
+    printf("%-10s vs %-10s %+8.3f +- %.3f shots  %s\n", ev->strat[a]->name, ev->strat[b]->name, diff, hw,
+           fabs(diff) > hw ? "better" : "not told apart");
+  }
+
+  if(dist) {
+    printf("\n%5s", "shots");
+    for(i = 0; i < ev->nstrat; i++)
+      printf(" %10s", ev->strat[order[i]]->name);
+    printf("\n");
+    for(k = lo; k <= hi; k++) {
+      printf("%5d", k);
+      for(i = 0; i < ev->nstrat; i++)
+        printf(" %9.3f%%", 100.0 * total[order[i]].hist[k] / total[order[i]].n);
+      printf("\n");
+    }
+  }
+
+  printf("\ncorpus:       %s", corpora[ev->corpus]);
+  if(ev->corpus == CORPUS_LOGS)
+    printf(", %ld fleets", ev->nfleet);
+  printf("\nrounds:       %d\n", rounds);
+  printf("fleets:       %ld\n", fleets);
+  printf("seconds:      %.3f\n", secs);
+  printf("fleets/sec:   %.0f (per strategy)\n", secs > 0 ? fleets / secs : 0.0);
+}
@@ -0,0 +1,117 @@
+/******************************************************
+ * Description: Append-only binary game log: records
+ *   are packed into a per-game buffer and the whole
+ *   game goes to the file with one O_APPEND write.
+ ******************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "gamelog.h"
+#include "timer.h"
+
+static void put(struct gamelog*, int, int, int, int, uint32_t);
+static uint32_t elapsed(struct gamelog*);
+
+
+// open a log for appending, return 0 or -1 with errno set
+int gamelog_open(struct gamelog* l, const char* path)
+{
+  l->len = 0;
+  l->fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0666);
+  return l->fd < 0 ? -1 : 0;
+}
+
+// start a new game record
+void gamelog_begin(struct gamelog* l)
+{
+  l->len = 0;
+  l->start = now();
+  put(l, LOG_GAME, 0, 0, 0, (uint32_t)time(0));
+}
+
+// log every deployed cell of a fleet as the given side
+void gamelog_fleet(struct gamelog* l, const struct game* g, int mode, int side)
+{
+  const struct side* sd = &g->side[mode];
+  uint32_t t = elapsed(l);
+  bitboard cells;
+  int i;
+  for(i = 0; i < SHIP_COUNT; i++) {
+    cells = sd->ship_mask[i];
+    while(cells)
+      put(l, LOG_DEPLOY, side, bb_pop(&cells), i, t);
+  }
+}
+
+// log a shot fired by side at the other side
+void gamelog_shot(struct gamelog* l, int side, int cell, int res)
+{
+  put(l, LOG_SHOT, side, cell, res, elapsed(l));
+}
+
+// log the result and append the game to the file, return 0 or -1
+int gamelog_end(struct gamelog* l, int result)
+{
+  int n, done = 0;
+  if(!l->len)
+    return 0;
+  put(l, LOG_END, 0, 0, result, elapsed(l));
+  while(done < l->len) {
+    if((n = write(l->fd, l->buf + done, l->len - done)) < 0) {
+      if(errno == EINTR)
+        continue;
+      l->len = 0;
+      return -1;
+    }
+    done += n;
+  }
+  l->len = 0;
+  return 0;
+}
+
+// close the log, keeping an unfinished game as abandoned
+void gamelog_close(struct gamelog* l)
+{
+  if(l->fd < 0)
+    return;
+  gamelog_end(l, 0);
+  close(l->fd);
+  l->fd = -1;
+}
+
+// unpack one record from the file
+void gamelog_decode(const unsigned char* p, struct log_rec* r)
+{
+  r->type = p[0];
+  r->side = p[1];
+  r->cell = p[2];
+  r->arg = p[3];
+  r->time = p[4] | (p[5] << 8) | (p[6] << 16) | ((uint32_t)p[7] << 24);
+}
+
+// append one record to the game buffer
+static void put(struct gamelog* l, int type, int side, int cell, int arg, uint32_t t)
+{
+  unsigned char* p;
+  if(l->fd < 0 || l->len + LOG_REC > (int)sizeof(l->buf))
+    return;
+  p = l->buf + l->len;
+  p[0] = type;
+  p[1] = side;
+  p[2] = cell;
+  p[3] = arg;
+  p[4] = t & 0xff;
+  p[5] = (t >> 8) & 0xff;
+  p[6] = (t >> 16) & 0xff;
+  p[7] = (t >> 24) & 0xff;
+  l->len += LOG_REC;
+}
+
+// milliseconds since the game started
+static uint32_t elapsed(struct gamelog* l)
+{
+  return (uint32_t)((now() - l->start) * 1000);
+}
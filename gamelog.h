@@ -0,0 +1,50 @@
+/******************************************************
+ * Description: Append-only binary game log. A game is
+ *   a run of 8-byte records: a start record, the cells
+ *   of both fleets, every shot with its result and an
+ *   end record with the winner. Games are buffered and
+ *   appended with one write, so several writers can
+ *   share a file without their games interleaving.
+ ******************************************************/
+
+#ifndef GAMELOG_H
+#define GAMELOG_H
+
+#include <stdint.h>
+
+#include "engine.h"
+
+// record types
+#define LOG_GAME 'G'    // time: unix seconds
+#define LOG_DEPLOY 'D'  // side, cell, arg: ship index
+#define LOG_SHOT 'S'    // side fired at the other, cell, arg: SHOT_* result
+#define LOG_END 'E'     // arg: engine_win() result, 0 if the game was abandoned
+#define LOG_REC 8
+// the longest game: start, both fleets, every cell shot twice, end
+#define LOG_GAME_MAX (2 + 2 * TOT_SHIP_CELL + 2 * TOT_ATK_CELL)
+
+// one record, time is milliseconds since the start record unless noted
+struct log_rec {
+  uint8_t type;
+  uint8_t side;         // P1 or P2, player 1 or 2 of the game
+  uint8_t cell;
+  uint8_t arg;
+  uint32_t time;        // little endian on disk
+};
+
+struct gamelog {
+  int fd;
+  double start;
+  int len;
+  unsigned char buf[LOG_GAME_MAX * LOG_REC];
+};
+
+int gamelog_open(struct gamelog*, const char*);
+void gamelog_begin(struct gamelog*);
+void gamelog_fleet(struct gamelog*, const struct game*, int, int);
+void gamelog_shot(struct gamelog*, int, int, int);
+int gamelog_end(struct gamelog*, int);
+void gamelog_close(struct gamelog*);
+void gamelog_decode(const unsigned char*, struct log_rec*);
+
+#endif
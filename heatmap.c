@@ -0,0 +1,107 @@
+/******************************************************
+ * Description: Placement sampler driver. Sets up a
+ *   random fleet, lets a strategy fire a number of
+ *   shots at it, then samples fleet layouts consistent
+ *   with what the shooter saw and prints the resulting
+ *   occupancy heatmap and the sampling rate, and the
+ *   endgame solver's shot when few enough ships are
+ *   left afloat.
+ ******************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "endgame.h"
+#include "engine.h"
+#include "rng.h"
+#include "sampler.h"
+#include "strategy.h"
+#include "timer.h"
+
+
+int main(int argc, char** argv)
+{
+  int opt, i, y, x, shots = 20, samples = 200000, best;
+  unsigned long seed = 1;
+  const struct strategy* st = &strategy_density;
+  struct sample_knowledge k;
+  struct sampler* s;
+  struct endgame* e;
+  struct game g;
+  struct rng r;
+  void* state;
+  double prob[TOT_ATK_CELL], start, secs, expect, solve;
+
+  while((opt = getopt(argc, argv, "k:n:s:a:")) != -1) {
+    switch(opt) {
+      case 'k':
+        shots = atoi(optarg);
+        break;
+      case 'n':
+        samples = atoi(optarg);
+        break;
+      case 's':
+        seed = strtoul(optarg, 0, 10);
+        break;
+      case 'a':
+        if(!(st = strategy_find(optarg))) {
+          fprintf(stderr, "unknown strategy: %s\n", optarg);
+          return 1;
+        }
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-k shots] [-n samples] [-s seed] [-a strategy]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  // a position: a random fleet and some shots at it
+  rng_seed(&r, seed);
+  engine_init(&g);
+  engine_random_fleet(&g, P2, &r);
+  if(!(state = malloc(st->size)) || !(s = malloc(sizeof(*s))) || !(e = calloc(1, sizeof(*e))))
+    return 1;
+  st->reset(state, &r);
+  for(i = 0; i < shots && !engine_fleet_sunk(&g, P2); i++)
+    strategy_fire(st, state, &g, P2, 0);
+
+  sampler_knowledge(&g, P2, &k);
+  start = now();
+  if(!sampler_init(s, &k, rng_next(&r))) {
+    fprintf(stderr, "no fleet layout fits this position\n");
+    return 1;
+  }
+  sampler_heatmap(s, samples, prob);
+  secs = now() - start;
+  endgame_init(e);
+  start = now();
+  best = endgame_solve(e, &k, &expect);
+  solve = now() - start;
+
+  printf("    shots                   occupancy %%\n");
+  printf("    1 2 3 4 5 6 7 8 9 0     1  2  3  4  5  6  7  8  9  0\n");
+  for(y = 0; y < BOARD_SIZE; y++) {
+    printf("%c   ", row_index2char(y));
+    for(x = 0; x < BOARD_SIZE; x++)
+      printf("%c ", engine_shot_ch(&g, P2, y, x));
+    printf("  ");
+    for(x = 0; x < BOARD_SIZE; x++)
+      printf("%3.0f", 100 * prob[CELL(y, x)]);
+    printf("\n");
+  }
+  printf("\nshots:        %d\n", i);
+  printf("samples:      %d\n", samples);
+  printf("seconds:      %.3f\n", secs);
+  printf("samples/sec:  %.0f\n", secs > 0 ? samples / secs : 0.0);
+  if(best >= 0)
+    printf("endgame:      (%c,%d), %.3f shots left, %d layouts, %ld nodes, %.3f ms\n",
+           row_index2char(best / BOARD_SIZE), col_index2num(best % BOARD_SIZE), expect,
+           e->nlayout, e->nodes, solve * 1000);
+  else
+    printf("endgame:      not solved, %.3f ms\n", solve * 1000);
+  free(state);
+  free(s);
+  free(e);
+  return 0;
+}
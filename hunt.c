@@ -0,0 +1,149 @@
+/******************************************************
+ * Description: Hunt/target strategy, the cheap bot.
+ *   While hunting it fires at random on a diagonal
+ *   lattice spaced by the shortest ship still afloat,
+ *   which every ship must cross. Once something is hit
+ *   it targets the cells around the hits, extending a
+ *   line of hits first. Every decision is a handful of
+ *   bitboard shifts and masks.
+ ******************************************************/
+
+#include <pthread.h>
+
+#include "strategy.h"
+
+// per-game state of the hunt/target shooter
+struct hunt_state {
+  struct rng r;
+  bitboard shot;          // cells fired at
+  bitboard hits;          // hits not yet put down to a sunk ship
+  int afloat;             // bit i set while ship i is afloat
+  int spacing;            // length of the shortest ship afloat
+  int offset[MAX_SHIP_LEN + 1];   // lattice picked for each spacing
+};
+
+static void hunt_reset(void*, struct rng*);
+static int hunt_shoot(void*);
+static void hunt_result(void*, int, int, int);
+static void build_tables();
+static bitboard east(bitboard);
+static bitboard west(bitboard);
+static bitboard north(bitboard);
+static bitboard south(bitboard);
+static bitboard run_through(bitboard, int, int);
+
+const struct strategy strategy_hunt = {
+  "hunt", sizeof(struct hunt_state), hunt_reset, hunt_shoot, hunt_result
+};
+
+// cells with (y + x) % n == k, for every spacing n of a ship
+static bitboard lattice[MAX_SHIP_LEN + 1][MAX_SHIP_LEN];
+static bitboard first_col, last_col;
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+
+// start a game hunting on the minesweeper lattice
+static void hunt_reset(void* state, struct rng* r)
+{
+  struct hunt_state* hs = state;
+  int n;
+  pthread_once(&tables_once, build_tables);
+  rng_seed(&hs->r, rng_next(r));
+  hs->shot = 0;
+  hs->hits = 0;
+  hs->afloat = (1 << SHIP_COUNT) - 1;
+  hs->spacing = M_LEN;
+  // one random lattice per spacing keeps the bot from being predictable
+  for(n = 1; n <= MAX_SHIP_LEN; n++)
+    hs->offset[n] = rng_range(&hs->r, n);
+}
+
+// target around open hits, else hunt on the lattice, else anything left
+static int hunt_shoot(void* state)
+{
+  struct hunt_state* hs = state;
+  bitboard open = ~hs->shot & BB_BOARD, h = hs->hits, row, col, pick;
+  if(h) {
+    // hits with a hit beside them form a line, try its ends first
+    row = h & (east(h) | west(h));
+    col = h & (north(h) | south(h));
+    if(!(pick = (east(row) | west(row) | north(col) | south(col)) & open))
+      pick = (east(h) | west(h) | north(h) | south(h)) & open;
+    if(pick)
+      return bb_select(pick, rng_range(&hs->r, bb_count(pick)));
+  }
+  if(!(pick = lattice[hs->spacing][hs->offset[hs->spacing]] & open))
+    pick = open;
+  return bb_select(pick, rng_range(&hs->r, bb_count(pick)));
+}
+
+// note a shot, and on a sink drop the ship's hits and maybe widen the lattice
+static void hunt_result(void* state, int cell, int res, int ship)
+{
+  struct hunt_state* hs = state;
+  bitboard run;
+  int i, len;
+  hs->shot |= bb_cell(cell);
+  if(res == SHOT_MISS)
+    return;
+  hs->hits |= bb_cell(cell);
+  if(res != SHOT_SUNK)
+    return;
+  // the ship is the run of hits through the cell that has exactly its length;
+  // if that is unclear only the cell itself is known
+  len = ship_lengths[ship];
+  if(bb_count(run = run_through(hs->hits, cell, 1)) != len &&
+     bb_count(run = run_through(hs->hits, cell, BOARD_SIZE)) != len)
+    run = bb_cell(cell);
+  hs->hits &= ~run;
+  hs->afloat &= ~(1 << ship);
+  hs->spacing = MAX_SHIP_LEN;
+  for(i = 0; i < SHIP_COUNT; i++)
+    if((hs->afloat >> i) & 1 && ship_lengths[i] < hs->spacing)
+      hs->spacing = ship_lengths[i];
+}
+
+// the gapless line of cells in b through cell, along a row (step 1) or a column
+static bitboard run_through(bitboard b, int cell, int step)
+{
+  bitboard run = bb_cell(cell), grow;
+  do {
+    grow = run;
+    run |= (step == 1 ? east(run) | west(run) : north(run) | south(run)) & b;
+  } while(run != grow);
+  return run;
+}
+
+// every cell moved one column right, dropping the last column
+static bitboard east(bitboard b)
+{
+  return (b & ~last_col) << 1;
+}
+
+static bitboard west(bitboard b)
+{
+  return (b & ~first_col) >> 1;
+}
+
+static bitboard north(bitboard b)
+{
+  return b >> BOARD_SIZE;
+}
+
+static bitboard south(bitboard b)
+{
+  return (b << BOARD_SIZE) & BB_BOARD;
+}
+
+// lattices and edge columns
+static void build_tables()
+{
+  int n, y, x;
+  for(y = 0; y < BOARD_SIZE; y++) {
+    first_col |= bb_cell(CELL(y, 0));
+    last_col |= bb_cell(CELL(y, BOARD_SIZE - 1));
+    for(x = 0; x < BOARD_SIZE; x++)
+      for(n = 1; n <= MAX_SHIP_LEN; n++)
+        lattice[n][(y + x) % n] |= bb_cell(CELL(y, x));
+  }
+}
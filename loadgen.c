@@ -0,0 +1,326 @@
+/******************************************************
+ * Description: Load generator for battleship-server.
+ *   Opens many bot players on one epoll set; each bot
+ *   deploys a random fleet, shoots with a strategy in
+ *   strict turns (player 1 first) and reconnects for a
+ *   new game when one ends. Reports moves/sec and the
+ *   move latency, timed from sending a shot until the
+ *   opponent's answering shot comes back, and the
+ *   deploy latency, from the server pairing a bot until
+ *   both fleets are down. Against a refereeing server
+ *   the bots never see the other fleet and play from
+ *   the results the server sends back.
+ ******************************************************/
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "engine.h"
+#include "net.h"
+#include "proto.h"
+#include "rng.h"
+#include "strategy.h"
+#include "timer.h"
+
+#define MAX_EVENTS 256
+// latency samples kept, later ones are dropped
+#define MAX_SAMPLES (1 << 22)
+#define MAX_DEPLOYS (1 << 20)
+
+// one bot player, P1 is its own board and P2 the opponent's
+struct bot {
+  int fd;
+  int player;           // 1 or 2 once the server paired us, 0 before
+  int referee;          // the server resolves the shots
+  int fired, taken;
+  double sent;          // when the last shot left
+  double paired;        // when the server started the game
+  struct game g;
+  struct rng r;
+  void* state;
+  struct channel ch;
+};
+
+void bot_connect(struct bot*);
+void bot_read(struct bot*);
+void bot_msg(struct bot*, struct msg*);
+void bot_fire(struct bot*);
+void bot_shot_taken(struct bot*);
+void bot_send(struct bot*, int, int, int, int);
+void bot_done(struct bot*);
+void bot_over(struct bot*);
+int game_over(struct bot*);
+int dblcmp(const void*, const void*);
+void print_latency(const char*, double*, long);
+
+
+// global vars
+const char* addr;
+const struct strategy* st;
+int epfd;
+double* samples;
+double* deploys;
+long nsamples, ndeploys, moves, games, errors;
+int by_cell;          // deploy one cell per message as the old clients did
+
+
+int main(int argc, char** argv)
+{
+  struct epoll_event events[MAX_EVENTS];
+  struct bot* bots;
+  struct rlimit rl;
+  int opt, i, n, nbots = 100;
+  double secs = 5, start, end, t;
+
+  // the cheap shooter keeps the bots from being the bottleneck
+  st = &strategy_hunt;
+  while((opt = getopt(argc, argv, "n:d:a:c")) != -1) {
+    switch(opt) {
+      case 'n':
+        nbots = atoi(optarg);
+        break;
+      case 'd':
+        secs = atof(optarg);
+        break;
+      case 'a':
+        if(!(st = strategy_find(optarg))) {
+          fprintf(stderr, "unknown strategy %s\n", optarg);
+          return 1;
+        }
+        break;
+      case 'c':
+        by_cell = 1;
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-n bots] [-d seconds] [-a strategy] [-c] addr\n", argv[0]);
+        return 1;
+    }
+  }
+  if(optind != argc - 1 || nbots < 2) {
+    fprintf(stderr, "usage: %s [-n bots] [-d seconds] [-a strategy] [-c] addr\n", argv[0]);
+    return 1;
+  }
+  addr = argv[optind];
+
+  if(!getrlimit(RLIMIT_NOFILE, &rl) && rl.rlim_cur < rl.rlim_max) {
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+  }
+  signal(SIGPIPE, SIG_IGN);
+  if((epfd = epoll_create1(0)) < 0 || !(bots = calloc(nbots, sizeof(*bots))) ||
+     !(samples = malloc(MAX_SAMPLES * sizeof(double))) || !(deploys = malloc(MAX_DEPLOYS * sizeof(double)))) {
+    perror("setup");
+    return 1;
+  }
+  for(i = 0; i < nbots; i++) {
+    rng_seed(&bots[i].r, i);
+    if(!(bots[i].state = malloc(st->size))) {
+      perror("malloc");
+      return 1;
+    }
+    bot_connect(&bots[i]);
+  }
+
+  start = now();
+  end = start + secs;
+  while((t = now()) < end) {
+    if((n = epoll_wait(epfd, events, MAX_EVENTS, (int)((end - t) * 1000) + 1)) < 0) {
+      if(errno == EINTR)
+        continue;
+      perror("epoll_wait");
+      return 1;
+    }
+    for(i = 0; i < n; i++)
+      bot_read(events[i].data.ptr);
+  }
+  secs = now() - start;
+
+  printf("bots:         %d\n", nbots);
+  printf("seconds:      %.3f\n", secs);
+  printf("games:        %ld\n", games);
+  printf("moves:        %ld\n", moves);
+  printf("moves/sec:    %.0f\n", moves / secs);
+  printf("errors:       %ld\n", errors);
+  print_latency("latency", samples, nsamples);
+  print_latency("deploy", deploys, ndeploys);
+  return 0;
+}
+
+// open a fresh connection and wait to be paired
+void bot_connect(struct bot* b)
+{
+  struct epoll_event ev;
+  if((b->fd = net_connect(addr)) < 0 || net_nonblock(b->fd) < 0) {
+    perror(addr);
+    exit(1);
+  }
+  chan_init(&b->ch, b->fd, b->fd, 0);
+  b->player = b->fired = b->taken = 0;
+  ev.events = EPOLLIN;
+  ev.data.ptr = b;
+  epoll_ctl(epfd, EPOLL_CTL_ADD, b->fd, &ev);
+}
+
+// take whatever the server sent
+void bot_read(struct bot* b)
+{
+  struct msg m;
+  int r;
+  while((r = chan_fill(&b->ch)) != 0) {
+    if(r < 0) {
+      if(errno == EAGAIN || errno == EWOULDBLOCK)
+        return;
+      if(errno == EINTR)
+        continue;
+      break;
+    }
+    while((r = chan_next(&b->ch, &m)) != 0) {
+      if(r < 0) {
+        errors++;
+        continue;
+      }
+      bot_msg(b, &m);
+      // the game ended and the bot is on a new socket
+      if(!b->player)
+        return;
+    }
+  }
+  // server hung up in the middle of a game
+  errors++;
+  bot_done(b);
+}
+
+// act on one message from the server
+void bot_msg(struct bot* b, struct msg* m)
+{
+  int i, j;
+  switch(m->type) {
+    case MSG_START:
+      b->player = m->ship;
+      b->referee = m->row == START_REFEREE;
+      b->paired = now();
+      engine_init(&b->g);
+      engine_random_fleet(&b->g, P1, &b->r);
+      st->reset(b->state, &b->r);
+      if(!by_cell) {
+        struct msg f = { MSG_FLEET, NO_SHIP, 0, 0, 0 };
+        engine_fleet_layout(&b->g, P1, f.fleet);
+        if(chan_send(&b->ch, &f) < 0)
+          errors++;
+        break;
+      }
+      for(i = 0; i < SHIP_COUNT; i++)
+        for(j = 0; j < b->g.side[P1].ships[i].length; j++)
+          bot_send(b, MSG_DEPLOY, i, b->g.side[P1].ships[i].y[j], b->g.side[P1].ships[i].x[j]);
+      break;
+    case MSG_DEPLOY:
+    case MSG_ERASE:
+    case MSG_FLEET:
+    case MSG_READY:
+      if(m->type != MSG_READY)
+        proto_deploy(&b->g, P2, m);
+      if(b->player == 1 && !b->fired && (m->type == MSG_READY || engine_fleet_deployed(&b->g, P2))) {
+        if(ndeploys < MAX_DEPLOYS)
+          deploys[ndeploys++] = now() - b->paired;
+        bot_fire(b);
+      }
+      break;
+    case MSG_RESULT:
+      engine_record(&b->g, P2, m->row, m->col, m->result, m->ship == NO_SHIP ? -1 : m->ship);
+      st->result(b->state, CELL(m->row, m->col), m->result, m->ship == NO_SHIP ? -1 : m->ship);
+      // the last result of the game may come in after the opponent's last shot
+      if(game_over(b))
+        bot_over(b);
+      break;
+    case MSG_ATTACK:
+      engine_attack(&b->g, P1, m->row, m->col);
+      bot_shot_taken(b);
+      break;
+    case MSG_INCOMING:
+      engine_record(&b->g, P1, m->row, m->col, m->result, m->ship == NO_SHIP ? -1 : m->ship);
+      bot_shot_taken(b);
+      break;
+  }
+}
+
+// the opponent fired: answer it, or shoot again, or leave if that was the end
+void bot_shot_taken(struct bot* b)
+{
+  b->taken++;
+  if(b->fired) {
+    if(nsamples < MAX_SAMPLES)
+      samples[nsamples++] = now() - b->sent;
+  }
+  moves++;
+  // player 2 answers every shot, player 1 shoots again once answered
+  if(!game_over(b) && (b->player == 1 ? b->fired == b->taken : b->fired < b->taken))
+    bot_fire(b);
+  if(game_over(b))
+    bot_over(b);
+}
+
+// let the strategy pick a shot and send it, resolved here unless the server referees
+void bot_fire(struct bot* b)
+{
+  int cell;
+  if(b->referee)
+    cell = st->shoot(b->state);
+  else
+    strategy_fire(st, b->state, &b->g, P2, &cell);
+  b->fired++;
+  b->sent = now();
+  bot_send(b, MSG_ATTACK, NO_SHIP, cell / BOARD_SIZE, cell % BOARD_SIZE);
+}
+
+// send one move, the server drops bots that fall behind so blocking is fine
+void bot_send(struct bot* b, int type, int ship, int y, int x)
+{
+  struct msg m = { type, ship, y, x, 0 };
+  if(chan_send(&b->ch, &m) < 0)
+    errors++;
+}
+
+// hang up and queue for the next game
+void bot_done(struct bot* b)
+{
+  close(b->fd);
+  bot_connect(b);
+}
+
+// count a finished game once and move on to the next
+void bot_over(struct bot* b)
+{
+  if(b->player == 1)
+    games++;
+  bot_done(b);
+}
+
+// both sides fired equally, every result is in and someone is sunk or the board is used up
+int game_over(struct bot* b)
+{
+  return b->fired == b->taken && b->g.shots[P1] == b->fired && (engine_win(&b->g) || b->fired == TOT_ATK_CELL);
+}
+
+// print the median, 99th percentile and worst of some latency samples
+void print_latency(const char* name, double* s, long n)
+{
+  if(!n)
+    return;
+  qsort(s, n, sizeof(double), dblcmp);
+  printf("%s p50:%*s%.1f usec\n", name, (int)(9 - strlen(name)), "", s[n / 2] * 1e6);
+  printf("%s p99:%*s%.1f usec\n", name, (int)(9 - strlen(name)), "", s[(long)(n * 0.99)] * 1e6);
+  printf("%s max:%*s%.1f usec\n", name, (int)(9 - strlen(name)), "", s[n - 1] * 1e6);
+}
+
+// order latency samples
+int dblcmp(const void* p1, const void* p2)
+{
+  double a = *(const double*)p1, b = *(const double*)p2;
+  return (a > b) - (a < b);
+}
@@ -0,0 +1,124 @@
+/******************************************************
+ * Description: Histogram recording and the metrics
+ *   report.
+ ******************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "metrics.h"
+
+static void on_usr1(int);
+static int bucket_of(uint64_t);
+static uint64_t bucket_value(int);
+
+static const char* phase_names[MT_COUNT] = { "wait", "read", "parse", "rules", "draw", "write" };
+static const char* counter_names[MC_COUNT] = {
+  "bytes in", "bytes out", "messages in", "messages out", "read calls", "write calls",
+  "poll calls", "redraws", "terminal bytes", "keys"
+};
+
+// global vars
+int metrics_on;
+long metrics_counter[MC_COUNT];
+volatile sig_atomic_t metrics_requested;
+static struct histogram phases[MT_COUNT];
+static const char* out_path;    // where reports go
+static const char* prog_name;
+
+
+// switch on if BATTLESHIP_METRICS is set, and listen for SIGUSR1
+void metrics_init(const char* prog)
+{
+  if(!(out_path = getenv("BATTLESHIP_METRICS")) || !*out_path)
+    return;
+  prog_name = prog;
+  metrics_on = 1;
+  signal(SIGUSR1, on_usr1);
+}
+
+// add one latency to a phase
+void metrics_record(int phase, uint64_t ns)
+{
+  struct histogram* h = &phases[phase];
+  h->count++;
+  h->sum += ns;
+  if(ns > h->max)
+    h->max = ns;
+  h->bucket[bucket_of(ns)]++;
+}
+
+// smallest recorded value at or above the given fraction of samples
+uint64_t metrics_percentile(const struct histogram* h, double q)
+{
+  uint64_t want = (uint64_t)(q * h->count + 0.5), seen = 0;
+  int i;
+  if(!h->count)
+    return 0;
+  if(want < 1)
+    want = 1;
+  for(i = 0; i < MH_BUCKETS; i++)
+    if((seen += h->bucket[i]) >= want)
+      return bucket_value(i) < h->max ? bucket_value(i) : h->max;
+  return h->max;
+}
+
+// append the report to the configured place
+void metrics_dump(const char* why)
+{
+  FILE* f;
+  int i;
+  if(!metrics_on)
+    return;
+  f = strcmp(out_path, "stderr") ? fopen(out_path, "a") : stderr;
+  if(!f)
+    return;
+  fprintf(f, "metrics %s pid %d at %ld (%s)\n", prog_name, (int)getpid(), (long)time(0), why);
+  fprintf(f, "%-8s %10s %10s %10s %10s %10s %10s %10s\n", "phase", "count", "mean us", "p50", "p90",
+          "p99", "p99.9", "max");
+  for(i = 0; i < MT_COUNT; i++) {
+    struct histogram* h = &phases[i];
+    if(!h->count)
+      continue;
+    fprintf(f, "%-8s %10lu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n", phase_names[i],
+            (unsigned long)h->count, h->sum / 1e3 / h->count, metrics_percentile(h, 0.5) / 1e3,
+            metrics_percentile(h, 0.9) / 1e3, metrics_percentile(h, 0.99) / 1e3,
+            metrics_percentile(h, 0.999) / 1e3, h->max / 1e3);
+  }
+  for(i = 0; i < MC_COUNT; i++)
+    if(metrics_counter[i])
+      fprintf(f, "%-15s %ld\n", counter_names[i], metrics_counter[i]);
+  if(f == stderr)
+    fflush(f);
+  else
+    fclose(f);
+}
+
+// only note the request, the report is written outside the handler
+static void on_usr1(int sig)
+{
+  metrics_requested = 1;
+}
+
+// histogram bucket of a value
+static int bucket_of(uint64_t v)
+{
+  int e;
+  if(v < (1ULL << MH_SUB_BITS))
+    return (int)v;
+  e = 63 - __builtin_clzll(v) - MH_SUB_BITS + 1;
+  return (e << (MH_SUB_BITS - 1)) + (int)(v >> e);
+}
+
+// highest value that lands in a bucket
+static uint64_t bucket_value(int i)
+{
+  int e;
+  if(i < (1 << MH_SUB_BITS))
+    return i;
+  e = (i >> (MH_SUB_BITS - 1)) - 1;
+  return ((uint64_t)(i - (e << (MH_SUB_BITS - 1))) << e) + ((1ULL << e) - 1);
+}
@@ -0,0 +1,89 @@
+/******************************************************
+ * Description: Always-built instrumentation: per-phase
+ *   latency histograms and event counters. It is off
+ *   unless BATTLESHIP_METRICS names where to write the
+ *   report ("stderr" or a file path); while off every
+ *   hook is one predictable branch on metrics_on. The
+ *   report is written by metrics_dump(), and on SIGUSR1
+ *   at the next metrics_check().
+ ******************************************************/
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <signal.h>
+#include <stdint.h>
+
+#include "timer.h"
+
+// timed phases
+#define MT_WAIT   0   // blocked in poll() for input
+#define MT_READ   1   // read() from the opponent
+#define MT_PARSE  2   // decoding frames and text lines
+#define MT_RULES  3   // engine calls for a move
+#define MT_DRAW   4   // curses screen updates
+#define MT_WRITE  5   // write() to the opponent
+#define MT_COUNT  6
+// counters
+#define MC_BYTES_IN    0
+#define MC_BYTES_OUT   1
+#define MC_MSGS_IN     2
+#define MC_MSGS_OUT    3
+#define MC_READS       4    // syscalls
+#define MC_WRITES      5
+#define MC_POLLS       6
+#define MC_REDRAWS     7
+#define MC_TERM_BYTES  8
+#define MC_KEYS        9
+#define MC_COUNT      10
+
+// log-linear buckets: 2^MH_SUB_BITS exact values, then 2^(MH_SUB_BITS-1) per power of two
+#define MH_SUB_BITS 6
+#define MH_BUCKETS ((64 - MH_SUB_BITS + 2) << (MH_SUB_BITS - 1))
+
+// latencies of one phase in nanoseconds, about 3% resolution
+struct histogram {
+  uint64_t count;
+  uint64_t sum;
+  uint64_t max;
+  uint64_t bucket[MH_BUCKETS];
+};
+
+extern int metrics_on;
+extern long metrics_counter[MC_COUNT];
+extern volatile sig_atomic_t metrics_requested;
+
+void metrics_init(const char*);
+void metrics_record(int, uint64_t);
+void metrics_dump(const char*);
+uint64_t metrics_percentile(const struct histogram*, double);
+
+// start time of a phase, 0 while off
+static inline uint64_t metrics_start()
+{
+  return metrics_on ? now_ns() : 0;
+}
+
+// close a phase started at t
+static inline void metrics_stop(int phase, uint64_t t)
+{
+  if(metrics_on)
+    metrics_record(phase, now_ns() - t);
+}
+
+static inline void metrics_count(int counter, long n)
+{
+  if(metrics_on)
+    metrics_counter[counter] += n;
+}
+
+// write the report if SIGUSR1 asked for one
+static inline void metrics_check()
+{
+  if(metrics_requested) {
+    metrics_requested = 0;
+    metrics_dump("SIGUSR1");
+  }
+}
+
+#endif
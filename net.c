@@ -0,0 +1,138 @@
+/******************************************************
+ * Description: Socket transport: parses an address,
+ *   opens TCP or AF_UNIX listeners for the server and
+ *   connects clients, with Nagle turned off since every
+ *   move is a tiny frame that should leave at once.
+ ******************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "net.h"
+
+#define NET_BACKLOG 512
+
+static int unix_addr(const char*, struct sockaddr_un*);
+static struct addrinfo* tcp_addr(const char*, int);
+
+
+// open a non-blocking listener on spec, -1 with errno set on failure
+int net_listen(const char* spec)
+{
+  struct sockaddr_un un;
+  struct addrinfo* ai;
+  int fd, one = 1;
+  if(unix_addr(spec, &un)) {
+    if((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+      return -1;
+    // a stale socket file from an earlier run would make bind fail
+    unlink(un.sun_path);
+    if(bind(fd, (struct sockaddr*)&un, sizeof(un)) < 0)
+      goto fail;
+  }
+  else {
+    if(!(ai = tcp_addr(spec, AI_PASSIVE)))
+      return -1;
+    if((fd = socket(ai->ai_family, SOCK_STREAM, 0)) < 0) {
+      freeaddrinfo(ai);
+      return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if(bind(fd, ai->ai_addr, ai->ai_addrlen) < 0) {
+      freeaddrinfo(ai);
+      goto fail;
+    }
+    freeaddrinfo(ai);
+  }
+  if(listen(fd, NET_BACKLOG) < 0 || net_nonblock(fd) < 0)
+    goto fail;
+  return fd;
+
+fail:
+  close(fd);
+  return -1;
+}
+
+// connect a blocking stream socket to spec, -1 with errno set on failure
+int net_connect(const char* spec)
+{
+  struct sockaddr_un un;
+  struct addrinfo* ai;
+  int fd, one = 1;
+  if(unix_addr(spec, &un)) {
+    if((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+      return -1;
+    if(connect(fd, (struct sockaddr*)&un, sizeof(un)) < 0) {
+      close(fd);
+      return -1;
+    }
+    return fd;
+  }
+  if(!(ai = tcp_addr(spec, 0)))
+    return -1;
+  if((fd = socket(ai->ai_family, SOCK_STREAM, 0)) < 0 ||
+     connect(fd, ai->ai_addr, ai->ai_addrlen) < 0) {
+    if(fd >= 0)
+      close(fd);
+    freeaddrinfo(ai);
+    return -1;
+  }
+  freeaddrinfo(ai);
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  return fd;
+}
+
+// switch a descriptor to non-blocking mode
+int net_nonblock(int fd)
+{
+  int fl = fcntl(fd, F_GETFL);
+  if(fl < 0)
+    return -1;
+  return fcntl(fd, F_SETFL, fl | O_NONBLOCK);
+}
+
+// fill in un if spec names a unix socket, return 1 if it does
+static int unix_addr(const char* spec, struct sockaddr_un* un)
+{
+  if(strncmp(spec, "unix:", 5))
+    return 0;
+  memset(un, 0, sizeof(*un));
+  un->sun_family = AF_UNIX;
+  snprintf(un->sun_path, sizeof(un->sun_path), "%s", spec + 5);
+  return 1;
+}
+
+// resolve "tcp:host:port" or "host:port", an empty host means any address
+static struct addrinfo* tcp_addr(const char* spec, int flags)
+{
+  struct addrinfo hints, *ai;
+  char host[256];
+  const char* port;
+  int len;
+  if(!strncmp(spec, "tcp:", 4))
+    spec += 4;
+  if(!(port = strrchr(spec, ':'))) {
+    errno = EINVAL;
+    return 0;
+  }
+  len = port - spec < (int)sizeof(host) - 1 ? port - spec : (int)sizeof(host) - 1;
+  memcpy(host, spec, len);
+  host[len] = '\0';
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = flags;
+  if(getaddrinfo(len ? host : 0, port + 1, &hints, &ai)) {
+    errno = EINVAL;
+    return 0;
+  }
+  return ai;
+}
@@ -0,0 +1,15 @@
+/******************************************************
+ * Description: Socket transport. Addresses are written
+ *   "unix:/path", "tcp:host:port" or just "host:port";
+ *   the returned descriptors carry the same frames as
+ *   the named pipes.
+ ******************************************************/
+
+#ifndef NET_H
+#define NET_H
+
+int net_listen(const char*);
+int net_connect(const char*);
+int net_nonblock(int);
+
+#endif
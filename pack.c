@@ -0,0 +1,167 @@
+/******************************************************
+ * Description: Packed game records: a struct game to
+ *   its 46-byte record and back. Unpacking lays the
+ *   cells down directly, with no rule checks; a record
+ *   only ever comes from a game that passed them. The
+ *   attack and win checks give the engine's answers
+ *   without rebuilding anything.
+ ******************************************************/
+
+#include "pack.h"
+
+static uint16_t pack_ship(bitboard);
+static bitboard ship_mask(uint16_t);
+static int fleet_sunk(const struct game_pack*, int);
+
+
+// squeeze a game with known fleets into a record
+void pack_game(const struct game* g, struct game_pack* p)
+{
+  const struct side* sd;
+  int mode, i;
+  for(mode = P1; mode <= P2; mode++) {
+    sd = &g->side[mode];
+    for(i = 0; i < SHIP_COUNT; i++)
+      p->ship[mode][i] = pack_ship(sd->ship_mask[i]);
+    bb_store(sd->hits | sd->misses, p->shot[mode], PACK_BB_BYTES);
+  }
+}
+
+// rebuild the whole game from a record
+void unpack_game(const struct game_pack* p, struct game* g)
+{
+  struct side* sd;
+  struct ship* s;
+  bitboard shot;
+  int mode, i, k, c, step;
+  uint16_t w;
+  engine_init(g);
+  for(mode = P1; mode <= P2; mode++) {
+    sd = &g->side[mode];
+    for(i = 0; i < SHIP_COUNT; i++) {
+      s = &sd->ships[i];
+      w = p->ship[mode][i];
+      step = w & PACK_DOWN ? BOARD_SIZE : 1;
+      for(k = 0; k < MAX_SHIP_LEN; k++) {
+        if(!(PACK_CELLS(w) >> k & 1))
+          continue;
+        c = (w & 0x7f) + k * step;
+        sd->ship_mask[i] |= bb_cell(c);
+        s->y[s->num_cell_deployed] = c / BOARD_SIZE;
+        s->x[s->num_cell_deployed] = c % BOARD_SIZE;
+        s->num_cell_deployed++;
+      }
+      s->has_deployed = s->num_cell_deployed == s->length;
+      sd->occupied |= sd->ship_mask[i];
+      sd->cells_deployed += s->num_cell_deployed;
+    }
+    shot = bb_load(p->shot[mode], PACK_BB_BYTES);
+    sd->hits = shot & sd->occupied;
+    sd->misses = shot & ~sd->occupied;
+    g->shots[!mode] = bb_count(shot);
+    for(i = 0; i < SHIP_COUNT; i++)
+      sd->ships[i].is_sunk = sd->ship_mask[i] && !(sd->ship_mask[i] & ~sd->hits);
+  }
+}
+
+// engine_fleet_layout() straight from a record, 0 if the fleet is not all down
+int pack_fleet_layout(const struct game_pack* p, int mode, unsigned char* fleet)
+{
+  int i;
+  uint16_t w;
+  for(i = 0; i < SHIP_COUNT; i++) {
+    w = p->ship[mode][i];
+    if(PACK_CELLS(w) != (1 << ship_lengths[i]) - 1)
+      return 0;
+    fleet[i] = (w & 0x7f) | (w & PACK_DOWN ? FLEET_DOWN : 0);
+  }
+  return 1;
+}
+
+// engine_fleet_deployed() on a record
+int pack_fleet_deployed(const struct game_pack* p, int mode)
+{
+  int i;
+  for(i = 0; i < SHIP_COUNT; i++)
+    if(PACK_CELLS(p->ship[mode][i]) != (1 << ship_lengths[i]) - 1)
+      return 0;
+  return 1;
+}
+
+// engine_attack() on a record: bombard a cell of a player's board, return SHOT_*
+// and, for SHOT_SUNK, set *ship to the ship sunk
+int pack_attack(struct game_pack* p, int mode, int y_i, int x_i, int* ship)
+{
+  unsigned char* shot = p->shot[mode];
+  bitboard bit, m;
+  int c, i;
+  if(!check_border(y_i, x_i))
+    return SHOT_REPEAT;
+  c = CELL(y_i, x_i);
+  if(shot[c / 8] >> c % 8 & 1)
+    return SHOT_REPEAT;
+  shot[c / 8] |= 1 << c % 8;
+  bit = bb_cell(c);
+  for(i = 0; i < SHIP_COUNT; i++) {
+    m = ship_mask(p->ship[mode][i]);
+    if(!(m & bit))
+      continue;
+    if(m & ~bb_load(shot, PACK_BB_BYTES))
+      return SHOT_HIT;
+    *ship = i;
+    return SHOT_SUNK;
+  }
+  return SHOT_MISS;
+}
+
+// engine_win() on a record
+int pack_win(const struct game_pack* p)
+{
+  int p1_all_sunk = fleet_sunk(p, P1);
+  int p2_all_sunk = fleet_sunk(p, P2);
+  if(p1_all_sunk && p2_all_sunk)
+    return 1;
+  else if(p2_all_sunk)
+    return 2;
+  else if(p1_all_sunk)
+    return 3;
+  return 0;
+}
+
+// a ship's cells as a ship word; they lie on one line, within a ship's length of the first
+static uint16_t pack_ship(bitboard m)
+{
+  int first, c, step;
+  uint16_t cells = 0;
+  if(!m)
+    return 0;
+  first = bb_first(m);
+  // a second cell right below the first, or on the first one's row
+  step = (m & ~bb_cell(first)) && bb_first(m & ~bb_cell(first)) - first >= BOARD_SIZE ? BOARD_SIZE : 1;
+  while(m) {
+    c = bb_pop(&m);
+    cells |= 1 << (c - first) / step;
+  }
+  return first | (step == BOARD_SIZE ? PACK_DOWN : 0) | cells << 8;
+}
+
+// and back
+static bitboard ship_mask(uint16_t w)
+{
+  bitboard m = 0;
+  int k, step = w & PACK_DOWN ? BOARD_SIZE : 1;
+  for(k = 0; k < MAX_SHIP_LEN; k++)
+    if(PACK_CELLS(w) >> k & 1)
+      m |= bb_cell((w & 0x7f) + k * step);
+  return m;
+}
+
+// every cell of a deployed fleet shot
+static int fleet_sunk(const struct game_pack* p, int mode)
+{
+  bitboard occupied = 0;
+  int i;
+  for(i = 0; i < SHIP_COUNT; i++)
+    occupied |= ship_mask(p->ship[mode][i]);
+  return occupied && !(occupied & ~bb_load(p->shot[mode], PACK_BB_BYTES));
+}
@@ -0,0 +1,41 @@
+/******************************************************
+ * Description: Packed game records for holding very
+ *   many games at once. A struct game is over a
+ *   kilobyte, mostly ship names and coordinate arrays
+ *   that can be rebuilt; the record keeps only what
+ *   cannot: each ship as its first cell, direction and
+ *   which of its cells are down (2 bytes), and the
+ *   cells shot on each board as 100 bits. Hits, misses,
+ *   sunk ships and shot counts follow from those. A
+ *   shot is resolved on the record itself; anything
+ *   else unpacks the game, applies the move and packs
+ *   it again. Fleets have to be known, as they are on
+ *   the server.
+ ******************************************************/
+
+#ifndef PACK_H
+#define PACK_H
+
+#include <stdint.h>
+
+#include "engine.h"
+
+// bytes of a 100-cell bitboard
+#define PACK_BB_BYTES BB_BYTES(TOT_ATK_CELL)
+// ship word: first cell, down bit, then a bit per cell from the first one that is deployed
+#define PACK_DOWN 0x80
+#define PACK_CELLS(w) ((w) >> 8)
+
+struct game_pack {
+  uint16_t ship[2][SHIP_COUNT];               // 0 for a ship with no cell down
+  unsigned char shot[2][PACK_BB_BYTES];       // cells bombarded on each board
+};
+
+void pack_game(const struct game*, struct game_pack*);
+void unpack_game(const struct game_pack*, struct game*);
+int pack_fleet_layout(const struct game_pack*, int, unsigned char*);
+int pack_fleet_deployed(const struct game_pack*, int);
+int pack_attack(struct game_pack*, int, int, int, int*);
+int pack_win(const struct game_pack*);
+
+#endif
@@ -0,0 +1,98 @@
+/******************************************************
+ * Description: Builds the placement tables once, on
+ *   first use, and answers placement queries on them.
+ ******************************************************/
+
+#include <pthread.h>
+
+#include "place.h"
+
+static void build_tables();
+
+static struct place_table table;
+const struct place_table* const places = &table;
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+// a vertical run of n cells starting at cell 0
+static bitboard column_run[MAX_SHIP_LEN + 1];
+
+
+// build the tables unless some thread already did
+void place_init()
+{
+  pthread_once(&tables_once, build_tables);
+}
+
+// placements of a ship covering every cell of part and none of blocked,
+// return how many and store their numbers in out if given
+int place_find(int ship, bitboard part, bitboard blocked, short* out)
+{
+  const struct place_table* t = places;
+  int i, p, c, n = 0;
+  place_init();
+  if(!part) {
+    for(p = t->ship_first[ship]; p < t->ship_first[ship + 1]; p++) {
+      if(t->place[p].mask & blocked)
+        continue;
+      if(out)
+        out[n] = p;
+      n++;
+    }
+    return n;
+  }
+  // every placement covering part runs through its first cell
+  c = bb_first(part);
+  for(i = 0; i < t->ship_cell_count[ship][c]; i++) {
+    p = t->ship_cell[ship][c][i];
+    if((part & ~t->place[p].mask) || (t->place[p].mask & blocked))
+      continue;
+    if(out)
+      out[n] = p;
+    n++;
+  }
+  return n;
+}
+
+// check if cells form one gapless straight run; a row run may wrap
+// onto the next row, which place_find() then rules out
+int place_is_run(bitboard part)
+{
+  int c, n;
+  if(!part)
+    return 0;
+  c = bb_first(part);
+  n = bb_count(part);
+  if(n > MAX_SHIP_LEN)
+    return 0;
+  return part == BB_FIRST(n) << c || part == column_run[n] << c;
+}
+
+// enumerate every placement of every ship on an empty board
+static void build_tables()
+{
+  int ship, y, x, v, i, len, cell;
+  struct placement* pl;
+  for(i = 1; i <= MAX_SHIP_LEN; i++)
+    column_run[i] = column_run[i - 1] | bb_cell(CELL(i - 1, 0));
+  for(ship = 0; ship < SHIP_COUNT; ship++) {
+    len = ship_lengths[ship];
+    table.ship_first[ship] = table.count;
+    for(v = 0; v < 2; v++) {
+      for(y = 0; y < BOARD_SIZE - (v ? len - 1 : 0); y++) {
+        for(x = 0; x < BOARD_SIZE - (v ? 0 : len - 1); x++) {
+          pl = &table.place[table.count];
+          pl->ship = ship;
+          pl->len = len;
+          pl->mask = 0;
+          for(i = 0; i < len; i++) {
+            cell = pl->cell[i] = v ? CELL(y + i, x) : CELL(y, x + i);
+            pl->mask |= bb_cell(cell);
+            table.cell_place[cell][table.cell_place_count[cell]++] = table.count;
+            table.ship_cell[ship][cell][table.ship_cell_count[ship][cell]++] = table.count;
+          }
+          table.count++;
+        }
+      }
+    }
+  }
+  table.ship_first[SHIP_COUNT] = table.count;
+}
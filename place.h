@@ -0,0 +1,51 @@
+/******************************************************
+ * Description: Precomputed tables of every legal ship
+ *   placement (position + orientation) on the classic
+ *   board, indexed by ship and by cell. Validating a
+ *   deployment, listing the placements a partly placed
+ *   ship still has and finding the placements under a
+ *   shot are table lookups plus mask tests; the rules
+ *   engine, the density shooter and the sampler all
+ *   read the same tables.
+ ******************************************************/
+
+#ifndef PLACE_H
+#define PLACE_H
+
+#include "engine.h"
+
+// placements of one ship on an empty board
+#define SHIP_PLACE_MAX (2 * BOARD_SIZE * BOARD_SIZE)
+// placements of the whole fleet
+#define PLACE_MAX (SHIP_COUNT * SHIP_PLACE_MAX)
+// placements of one ship through one cell
+#define CELL_SHIP_MAX (2 * MAX_SHIP_LEN)
+// placements of the whole fleet through one cell
+#define CELL_PLACE_MAX (2 * TOT_SHIP_CELL)
+
+// one position + orientation of one ship
+struct placement {
+  bitboard mask;
+  unsigned char ship;
+  unsigned char len;
+  unsigned char cell[MAX_SHIP_LEN];   // top/left cell first
+};
+
+struct place_table {
+  struct placement place[PLACE_MAX];
+  int count;
+  int ship_first[SHIP_COUNT + 1];                         // ship i owns [first[i], first[i+1])
+  short cell_place[TOT_ATK_CELL][CELL_PLACE_MAX];         // every placement through a cell
+  unsigned char cell_place_count[TOT_ATK_CELL];
+  short ship_cell[SHIP_COUNT][TOT_ATK_CELL][CELL_SHIP_MAX];   // one ship's placements through a cell
+  unsigned char ship_cell_count[SHIP_COUNT][TOT_ATK_CELL];
+};
+
+// the tables, filled in by the first place_init()
+extern const struct place_table* const places;
+
+void place_init();
+int place_find(int, bitboard, bitboard, short*);
+int place_is_run(bitboard);
+
+#endif
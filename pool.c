@@ -0,0 +1,182 @@
+/******************************************************
+ * Description: Work-stealing thread pool. Deques are
+ *   short mutex-protected ring buffers; tasks are
+ *   coarse (a chunk of games) so the lock is only
+ *   taken once per chunk and never on the hot path.
+ ******************************************************/
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pool.h"
+#include "rng.h"
+
+// per-worker deque, one cache line apart from its neighbours
+struct deque {
+  pthread_mutex_t lock;
+  void** tasks;
+  int head, count, cap;
+} __attribute__((aligned(64)));
+
+struct pool {
+  int n;
+  pool_fn fn;
+  void* ctx;
+  atomic_long pending;        // submitted tasks not finished yet
+  struct deque* q;
+  pthread_t* threads;
+};
+
+struct worker_arg {
+  struct pool* p;
+  int id;
+};
+
+static void* worker_main(void*);
+static void* take_back(struct deque*);
+static void* take_front(struct deque*);
+
+
+// create a pool of n workers running fn(worker, task, ctx)
+struct pool* pool_create(int n, pool_fn fn, void* ctx)
+{
+  struct pool* p;
+  int i;
+  if(n < 1)
+    n = 1;
+  if(!(p = calloc(1, sizeof(*p))))
+    return 0;
+  p->n = n;
+  p->fn = fn;
+  p->ctx = ctx;
+  atomic_init(&p->pending, 0);
+  if(posix_memalign((void**)&p->q, 64, n * sizeof(struct deque)) ||
+     !(p->threads = calloc(n, sizeof(pthread_t)))) {
+    free(p);
+    return 0;
+  }
+  memset(p->q, 0, n * sizeof(struct deque));
+  for(i = 0; i < n; i++)
+    pthread_mutex_init(&p->q[i].lock, 0);
+  return p;
+}
+
+// queue a task on worker w, either before pool_run or from inside a task
+void pool_submit(struct pool* p, int w, void* task)
+{
+  struct deque* d = &p->q[w % p->n];
+  pthread_mutex_lock(&d->lock);
+  if(d->count == d->cap) {
+    // grow and unwrap the ring
+    int i, cap = d->cap ? d->cap * 2 : 64;
+    void** t = malloc(cap * sizeof(void*));
+    if(!t)
+      abort();
+    for(i = 0; i < d->count; i++)
+      t[i] = d->tasks[(d->head + i) % d->cap];
+    free(d->tasks);
+    d->tasks = t;
+    d->head = 0;
+    d->cap = cap;
+  }
+  d->tasks[(d->head + d->count) % d->cap] = task;
+  d->count++;
+  atomic_fetch_add(&p->pending, 1);
+  pthread_mutex_unlock(&d->lock);
+}
+
+// run every submitted task to completion
+void pool_run(struct pool* p)
+{
+  struct worker_arg* args = malloc(p->n * sizeof(*args));
+  int i;
+  if(!args)
+    abort();
+  for(i = 0; i < p->n; i++) {
+    args[i].p = p;
+    args[i].id = i;
+  }
+  for(i = 1; i < p->n; i++)
+    if(pthread_create(&p->threads[i], 0, worker_main, &args[i]))
+      abort();
+  worker_main(&args[0]);
+  for(i = 1; i < p->n; i++)
+    pthread_join(p->threads[i], 0);
+  free(args);
+}
+
+// free the pool and its deques
+void pool_destroy(struct pool* p)
+{
+  int i;
+  for(i = 0; i < p->n; i++) {
+    pthread_mutex_destroy(&p->q[i].lock);
+    free(p->q[i].tasks);
+  }
+  free(p->q);
+  free(p->threads);
+  free(p);
+}
+
+// number of online cores
+int pool_cpus()
+{
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (int)n : 1;
+}
+
+// worker loop: own deque first, then steal, until nothing is pending
+static void* worker_main(void* arg)
+{
+  struct worker_arg* wa = arg;
+  struct pool* p = wa->p;
+  struct rng r;
+  void* task;
+  int i, victim;
+  rng_seed(&r, wa->id);
+  while(atomic_load(&p->pending) > 0) {
+    task = take_back(&p->q[wa->id]);
+    for(i = 1; !task && i < p->n; i++) {
+      victim = (wa->id + 1 + rng_range(&r, p->n - 1)) % p->n;
+      task = take_front(&p->q[victim]);
+    }
+    if(!task) {
+      sched_yield();
+      continue;
+    }
+    p->fn(wa->id, task, p->ctx);
+    atomic_fetch_sub(&p->pending, 1);
+  }
+  return 0;
+}
+
+// owner end of a deque: newest task first
+static void* take_back(struct deque* d)
+{
+  void* task = 0;
+  pthread_mutex_lock(&d->lock);
+  if(d->count) {
+    d->count--;
+    task = d->tasks[(d->head + d->count) % d->cap];
+  }
+  pthread_mutex_unlock(&d->lock);
+  return task;
+}
+
+// thief end of a deque: oldest task first
+static void* take_front(struct deque* d)
+{
+  void* task = 0;
+  pthread_mutex_lock(&d->lock);
+  if(d->count) {
+    task = d->tasks[d->head];
+    d->head = (d->head + 1) % d->cap;
+    d->count--;
+  }
+  pthread_mutex_unlock(&d->lock);
+  return task;
+}
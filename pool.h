@@ -0,0 +1,22 @@
+/******************************************************
+ * Description: Work-stealing thread pool. Every worker
+ *   owns a deque of tasks, pops its own work from the
+ *   back and steals from the front of a random victim
+ *   when it runs dry.
+ ******************************************************/
+
+#ifndef POOL_H
+#define POOL_H
+
+// run one task on worker w with the pool's shared context
+typedef void (*pool_fn)(int, void*, void*);
+
+struct pool;
+
+struct pool* pool_create(int, pool_fn, void*);
+void pool_submit(struct pool*, int, void*);
+void pool_run(struct pool*);
+void pool_destroy(struct pool*);
+int pool_cpus();
+
+#endif
@@ -0,0 +1,453 @@
+/******************************************************
+ * Description: Wire protocol between two players:
+ *   binary frame encoding, the text debug format and a
+ *   framed reader that survives partial and coalesced
+ *   reads on the opponent channel.
+ ******************************************************/
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "engine.h"
+#include "metrics.h"
+#include "proto.h"
+
+// sequence number of text lines, which carry none
+#define SEQ_NONE 0xffffffffu
+
+static int parse_line(const char*, struct msg*);
+
+
+// set up a channel on the given descriptors
+void chan_init(struct channel* ch, int rfd, int wfd, int text)
+{
+  memset(ch, 0, sizeof(*ch));
+  ch->rfd = rfd;
+  ch->wfd = wfd;
+  ch->text = text;
+}
+
+// set up a channel on a shared-memory link, no descriptors involved
+void chan_init_shm(struct channel* ch, struct shm_link* l, int text)
+{
+  chan_init(ch, -1, -1, text);
+  ch->shm = l;
+}
+
+// stamp and send one message, return 0 or -1 with errno set
+int chan_send(struct channel* ch, struct msg* m)
+{
+  char buf[FRAME_MAX];
+  int len, n, done = 0;
+  uint64_t t = metrics_start();
+  m->seq = ch->seq_out++;
+  len = proto_encode(m, ch->text, buf);
+  metrics_count(MC_MSGS_OUT, 1);
+  // the ring takes the frame whole or waits for room
+  if(ch->shm) {
+    if(shm_write(ch->shm, buf, len) < 0)
+      return -1;
+    done = len;
+  }
+  while(done < len) {
+    metrics_count(MC_WRITES, 1);
+    if((n = write(ch->wfd, buf + done, len - done)) < 0) {
+      if(errno == EINTR)
+        continue;
+      if(errno == EAGAIN) {
+        // socket shared with a non-blocking reader, wait for room
+        struct pollfd pfd = { ch->wfd, POLLOUT, 0 };
+        poll(&pfd, 1, -1);
+        continue;
+      }
+      return -1;
+    }
+    done += n;
+  }
+  metrics_count(MC_BYTES_OUT, len);
+  metrics_stop(MT_WRITE, t);
+  return 0;
+}
+
+// stamp and buffer one message for chan_flush, -1 with ENOBUFS if the buffer is full
+int chan_queue(struct channel* ch, struct msg* m)
+{
+  char buf[FRAME_MAX];
+  int len;
+  m->seq = ch->seq_out;
+  len = proto_encode(m, ch->text, buf);
+  if(ch->out_len + len > FRAME_BUF) {
+    errno = ENOBUFS;
+    return -1;
+  }
+  memcpy(ch->out + ch->out_len, buf, len);
+  ch->out_len += len;
+  ch->seq_out++;
+  metrics_count(MC_MSGS_OUT, 1);
+  return 0;
+}
+
+// write out buffered messages: 0 when all sent, 1 if some are left, -1 on error
+int chan_flush(struct channel* ch)
+{
+  int n;
+  uint64_t t;
+  while(ch->out_len) {
+    t = metrics_start();
+    if(ch->shm)
+      n = shm_write(ch->shm, ch->out, ch->out_len);
+    else {
+      metrics_count(MC_WRITES, 1);
+      n = write(ch->wfd, ch->out, ch->out_len);
+    }
+    if(n < 0) {
+      if(errno == EINTR)
+        continue;
+      return errno == EAGAIN ? 1 : -1;
+    }
+    metrics_stop(MT_WRITE, t);
+    metrics_count(MC_BYTES_OUT, n);
+    memmove(ch->out, ch->out + n, ch->out_len - n);
+    ch->out_len -= n;
+  }
+  return 0;
+}
+
+// block until one whole message arrives: 1 on success, 0 on EOF, -1 on error
+int chan_recv(struct channel* ch, struct msg* m)
+{
+  int r;
+  for(;;) {
+    if((r = chan_next(ch, m)) != 0)
+      return r;
+    if((r = chan_fill(ch)) <= 0) {
+      if(r < 0 && errno == EINTR)
+        continue;
+      // the ring never blocks on its own
+      if(r < 0 && errno == EAGAIN && ch->shm) {
+        shm_wait(ch->shm, -1);
+        continue;
+      }
+      return r;
+    }
+  }
+}
+
+// read whatever the kernel or the ring has into the framer, return bytes read
+int chan_fill(struct channel* ch)
+{
+  struct framer* fr = &ch->fr;
+  uint64_t t;
+  int n;
+  // slide unread bytes to the front
+  if(fr->off) {
+    memmove(fr->buf, fr->buf + fr->off, fr->len - fr->off);
+    fr->len -= fr->off;
+    fr->off = 0;
+  }
+  if(fr->len == FRAME_BUF) {
+    // a text line longer than the buffer, throw it away
+    fr->len = 0;
+    errno = EPROTO;
+    return -1;
+  }
+  t = metrics_start();
+  if(ch->shm)
+    n = shm_read(ch->shm, fr->buf + fr->len, FRAME_BUF - fr->len);
+  else {
+    n = read(ch->rfd, fr->buf + fr->len, FRAME_BUF - fr->len);
+    metrics_count(MC_READS, 1);
+  }
+  metrics_stop(MT_READ, t);
+  if(n > 0) {
+    fr->len += n;
+    metrics_count(MC_BYTES_IN, n);
+  }
+  return n;
+}
+
+// take the next buffered message: 1 if there is one, 0 if more bytes are needed, -1 if bad
+int chan_next(struct channel* ch, struct msg* m)
+{
+  uint64_t t = metrics_start();
+  int r = proto_decode(&ch->fr, m);
+  if(r <= 0)
+    return r;
+  metrics_stop(MT_PARSE, t);
+  metrics_count(MC_MSGS_IN, 1);
+  if(m->seq == SEQ_NONE)
+    m->seq = ch->seq_in;
+  if(m->seq != ch->seq_in) {
+    ch->seq_in = m->seq + 1;
+    errno = EPROTO;
+    return -1;
+  }
+  ch->seq_in++;
+  return 1;
+}
+
+// encode a message as a binary frame or a text line, return its size
+int proto_encode(const struct msg* m, int text, char* out)
+{
+  unsigned char* p = (unsigned char*)out;
+  int n;
+  if(text) {
+    if(m->type == MSG_START)
+      return snprintf(out, FRAME_MAX, m->row == START_REFEREE ? "START %d referee\n" : "START %d\n", m->ship);
+    if(m->type == MSG_READY)
+      return snprintf(out, FRAME_MAX, "READY\n");
+    if(m->type == MSG_RESULT || m->type == MSG_INCOMING)
+      return snprintf(out, FRAME_MAX, "%s (%c,%d) %d %c\n", m->type == MSG_RESULT ? "RESULT" : "INCOMING",
+                      row_index2char(m->row), col_index2num(m->col), m->result,
+                      m->ship == NO_SHIP ? '-' : ship_types[m->ship][0]);
+    if(m->type == MSG_RESUME)
+      return snprintf(out, FRAME_MAX, "RESUME %d\n", m->ship);
+    if(m->type == MSG_FLEET) {
+      n = sprintf(out, "FLEET ");
+      n += engine_format_fleet(m->fleet, out + n);
+      out[n++] = '\n';
+      return n;
+    }
+    if(m->type == MSG_DEPLOY)
+      return snprintf(out, FRAME_MAX, "%c (%c,%d)\n", ship_types[m->ship][0],
+                      row_index2char(m->row), col_index2num(m->col));
+    if(m->type == MSG_ERASE)
+      return snprintf(out, FRAME_MAX, "ERASE (%c,%d)\n", row_index2char(m->row), col_index2num(m->col));
+    return snprintf(out, FRAME_MAX, "(%c,%d)\n", row_index2char(m->row), col_index2num(m->col));
+  }
+  p[0] = FRAME_MAGIC;
+  p[2] = m->type;
+  if(m->type == MSG_FLEET) {
+    p[1] = FRAME_FLEET_LEN - FRAME_HDR;
+    memcpy(p + 3, m->fleet, SHIP_COUNT);
+    n = FRAME_FLEET_LEN;
+  }
+  else if(m->type == MSG_RESULT || m->type == MSG_INCOMING) {
+    p[1] = FRAME_RESULT_LEN - FRAME_HDR;
+    p[3] = m->ship;
+    p[4] = m->row;
+    p[5] = m->col;
+    p[6] = m->result;
+    n = FRAME_RESULT_LEN;
+  }
+  else {
+    p[1] = FRAME_MOVE_LEN - FRAME_HDR;
+    p[3] = m->ship;
+    p[4] = m->row;
+    p[5] = m->col;
+    n = FRAME_MOVE_LEN;
+  }
+  p[n - 4] = m->seq & 0xff;
+  p[n - 3] = (m->seq >> 8) & 0xff;
+  p[n - 2] = (m->seq >> 16) & 0xff;
+  p[n - 1] = (m->seq >> 24) & 0xff;
+  return n;
+}
+
+// cut one message off the front of the framer: 1 if found, 0 if incomplete, -1 if bad
+int proto_decode(struct framer* fr, struct msg* m)
+{
+  unsigned char* p;
+  unsigned char* end;
+  char line[FRAME_MAX];
+  int n, i;
+  for(;;) {
+    p = fr->buf + fr->off;
+    n = fr->len - fr->off;
+    // the rest of a frame whose header was bad, its length can't say where it ends
+    while(fr->resync && n && *p != FRAME_MAGIC) {
+      p++;
+      n--;
+      fr->off++;
+    }
+    if(n)
+      fr->resync = 0;
+    // skip terminators left over from text senders
+    while(n && (*p == '\0' || *p == '\n' || *p == '\r')) {
+      p++;
+      n--;
+      fr->off++;
+    }
+    if(!n) {
+      fr->off = fr->len = 0;
+      return 0;
+    }
+    // binary frame, magic byte then the length of the rest
+    if(*p == FRAME_MAGIC) {
+      if(n < FRAME_HDR)
+        return 0;
+      // no frame is this long or this short
+      if(FRAME_HDR + p[1] < FRAME_SHORTEST || FRAME_HDR + p[1] > FRAME_LONGEST) {
+        fr->off++;
+        fr->resync = 1;
+        errno = EPROTO;
+        return -1;
+      }
+      if(n < FRAME_HDR + p[1])
+        return 0;
+      fr->off += FRAME_HDR + p[1];
+      n = FRAME_HDR + p[1];
+      m->type = p[2];
+      m->result = 0;
+      if(m->type == MSG_FLEET && n == FRAME_FLEET_LEN) {
+        memcpy(m->fleet, p + 3, SHIP_COUNT);
+        m->ship = NO_SHIP;
+        m->row = m->col = 0;
+      }
+      else if((m->type == MSG_RESULT || m->type == MSG_INCOMING) && n == FRAME_RESULT_LEN) {
+        m->ship = p[3];
+        m->row = p[4];
+        m->col = p[5];
+        m->result = p[6];
+      }
+      else if(m->type != MSG_FLEET && m->type != MSG_RESULT && m->type != MSG_INCOMING &&
+              n == FRAME_MOVE_LEN) {
+        m->ship = p[3];
+        m->row = p[4];
+        m->col = p[5];
+      }
+      else {
+        errno = EPROTO;
+        return -1;
+      }
+      p += n - 4;
+      m->seq = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+      break;
+    }
+    // neither a frame nor text: a frame with a broken magic byte
+    if((*p < ' ' && *p != '\t') || *p >= 0x7f) {
+      fr->off++;
+      fr->resync = 1;
+      errno = EPROTO;
+      return -1;
+    }
+    // text line, ended by a newline or a NUL
+    for(end = p; end < p + n && *end != '\n' && *end != '\0'; end++)
+      ;
+    if(end == p + n)
+      return 0;
+    n = end - p < FRAME_MAX - 1 ? end - p : FRAME_MAX - 1;
+    memcpy(line, p, n);
+    line[n] = '\0';
+    fr->off += end - p + 1;
+    // comment lines in scripted input
+    if(line[0] == '#')
+      continue;
+    if(parse_line(line, m) < 0) {
+      errno = EPROTO;
+      return -1;
+    }
+    m->seq = SEQ_NONE;
+    break;
+  }
+  // refuse anything off the board
+  if(m->type == MSG_START || m->type == MSG_RESUME || m->type == MSG_READY)
+    return 1;
+  if(m->type == MSG_RESULT || m->type == MSG_INCOMING) {
+    // a sinking names its ship, nothing else does
+    if(!check_border(m->row, m->col) || m->result < SHOT_MISS || m->result > SHOT_SUNK ||
+       (m->result == SHOT_SUNK ? m->ship >= SHIP_COUNT : m->ship != NO_SHIP)) {
+      errno = EPROTO;
+      return -1;
+    }
+    return 1;
+  }
+  if(m->type == MSG_FLEET) {
+    for(i = 0; i < SHIP_COUNT; i++) {
+      if(FLEET_CELL(m->fleet[i]) >= TOT_ATK_CELL) {
+        errno = EPROTO;
+        return -1;
+      }
+    }
+    return 1;
+  }
+  if((m->type != MSG_DEPLOY && m->type != MSG_ATTACK && m->type != MSG_ERASE) ||
+     !check_border(m->row, m->col) || (m->type == MSG_DEPLOY && (m->ship < 0 || m->ship >= SHIP_COUNT))) {
+    errno = EPROTO;
+    return -1;
+  }
+  return 1;
+}
+
+// apply a deploy-phase message to a player's side of a game, the way the player did it:
+// one cell, a cell taken back or the whole fleet; return 1, or 0 if the rules refuse
+// it. A fleet all down stays as it is, the other side may be shooting at it already
+int proto_deploy(struct game* g, int mode, const struct msg* m)
+{
+  if(engine_fleet_deployed(g, mode))
+    return 0;
+  if(m->type == MSG_FLEET)
+    return engine_place_fleet(g, mode, m->fleet);
+  if(m->type == MSG_ERASE)
+    return engine_erase_cell(g, mode, m->row, m->col);
+  if(m->type == MSG_DEPLOY)
+    return engine_deploy_cell(g, mode, ship_types[m->ship][0], m->row, m->col) == DEPLOY_OK;
+  return 0;
+}
+
+// parse "A (B,3)", "(J,0)", "ERASE (B,3)", "START 1", "RESUME 12", "FLEET A A1 h ...",
+// "READY", "RESULT (B,3) 3 A" or "INCOMING (B,3) 1 -"
+static int parse_line(const char* line, struct msg* m)
+{
+  char t, y, word[16];
+  int x, res;
+  m->result = 0;
+  if(sscanf(line, "START %d", &x) == 1) {
+    m->type = MSG_START;
+    m->ship = x;
+    m->row = strstr(line, "referee") ? START_REFEREE : 0;
+    m->col = 0;
+    return 0;
+  }
+  if(!strcmp(line, "READY")) {
+    m->type = MSG_READY;
+    m->ship = NO_SHIP;
+    m->row = m->col = 0;
+    return 0;
+  }
+  if(sscanf(line, "%15s (%c,%d) %d %c", word, &y, &x, &res, &t) == 5 &&
+     (!strcmp(word, "RESULT") || !strcmp(word, "INCOMING"))) {
+    m->type = word[0] == 'R' ? MSG_RESULT : MSG_INCOMING;
+    m->ship = t == '-' ? NO_SHIP : engine_ship_index(t);
+    m->result = res;
+    if(x < 0 || x > 9 || m->ship < 0)
+      return -1;
+    m->row = row_char2index(y);
+    m->col = col_num2index(x);
+    return 0;
+  }
+  if(sscanf(line, "RESUME %d", &x) == 1) {
+    m->type = MSG_RESUME;
+    m->ship = x;
+    m->row = m->col = 0;
+    return 0;
+  }
+  if(!strncmp(line, "FLEET ", 6)) {
+    m->type = MSG_FLEET;
+    m->ship = NO_SHIP;
+    m->row = m->col = 0;
+    return engine_parse_fleet(line + 6, m->fleet);
+  }
+  if(sscanf(line, "(%c,%d)", &y, &x) == 2) {
+    m->type = MSG_ATTACK;
+    m->ship = NO_SHIP;
+  }
+  else if(sscanf(line, "ERASE (%c,%d)", &y, &x) == 2) {
+    m->type = MSG_ERASE;
+    m->ship = NO_SHIP;
+  }
+  else if(sscanf(line, "%c (%c,%d)", &t, &y, &x) == 3) {
+    m->type = MSG_DEPLOY;
+    m->ship = engine_ship_index(t);
+  }
+  else
+    return -1;
+  if(x < 0 || x > 9)
+    return -1;
+  m->row = row_char2index(y);
+  m->col = col_num2index(x);
+  return 0;
+}
@@ -0,0 +1,89 @@
+/******************************************************
+ * Description: Wire protocol between two players. Each
+ *   message is a length-prefixed binary frame; the old
+ *   text lines ("A (B,3)", "(J,0)") are still accepted
+ *   on input and can be sent for debugging. A framed
+ *   reader keeps partial and coalesced reads apart.
+ *   A channel runs over a pair of descriptors or over
+ *   a shared-memory link.
+ ******************************************************/
+
+#ifndef PROTO_H
+#define PROTO_H
+
+#include <stdint.h>
+
+#include "engine.h"
+#include "shm.h"
+
+// message types
+#define MSG_DEPLOY 1    // one deployed cell: ship, row, col
+#define MSG_ATTACK 2    // one shot: row, col
+#define MSG_START  3    // server paired us, ship holds our player number
+#define MSG_FLEET  4    // the whole fleet at once: fleet
+#define MSG_RESUME 5    // ship holds the round our snapshot is at, 0xff for none
+// from a refereeing server, which keeps the fleets to itself
+#define MSG_RESULT 6    // our shot at row, col: result, and the ship it sank or NO_SHIP
+#define MSG_INCOMING 7  // the opponent's shot on our board, the same fields
+#define MSG_READY  8    // the opponent's fleet is down
+#define MSG_ERASE  9    // a deployed cell taken back, to be cleared or overwritten: row, col
+// MSG_START row: the server referees, shots come back as MSG_RESULT and MSG_INCOMING
+#define START_REFEREE 1
+// frame layout: magic, len, type, ship, row, col, seq (4 bytes, little endian)
+// a fleet frame has the SHIP_COUNT fleet bytes in place of ship, row, col
+// a result frame has the result byte after col
+#define FRAME_MAGIC 0xb5
+#define FRAME_HDR 2
+#define FRAME_MOVE_LEN 10
+#define FRAME_FLEET_LEN (FRAME_HDR + 1 + SHIP_COUNT + 4)
+#define FRAME_RESULT_LEN (FRAME_MOVE_LEN + 1)
+// lengths a frame can have, anything else is refused from its header alone
+#define FRAME_SHORTEST FRAME_MOVE_LEN
+#define FRAME_LONGEST FRAME_FLEET_LEN
+#define FRAME_MAX 256
+#define FRAME_BUF 1024
+#define NO_SHIP 0xff
+
+struct msg {
+  int type;
+  int ship;       // ship index or NO_SHIP
+  int row;        // board indexes
+  int col;
+  uint32_t seq;
+  unsigned char fleet[SHIP_COUNT];   // MSG_FLEET layout, as engine_place_fleet()
+  int result;     // SHOT_* of MSG_RESULT and MSG_INCOMING
+};
+
+// bytes received but not yet turned into messages
+struct framer {
+  unsigned char buf[FRAME_BUF];
+  int off;
+  int len;
+  int resync;     // after a bad frame header: skip to the next magic byte
+};
+
+// one direction pair to the opponent
+struct channel {
+  int rfd, wfd;
+  struct shm_link* shm; // shared-memory rings in place of the descriptors, if set
+  int text;             // send debug text lines instead of binary frames
+  uint32_t seq_out;     // next sequence number to send
+  uint32_t seq_in;      // next sequence number expected
+  struct framer fr;
+  unsigned char out[FRAME_BUF];   // encoded frames not written yet
+  int out_len;
+};
+
+void chan_init(struct channel*, int, int, int);
+void chan_init_shm(struct channel*, struct shm_link*, int);
+int chan_send(struct channel*, struct msg*);
+int chan_queue(struct channel*, struct msg*);
+int chan_flush(struct channel*);
+int chan_recv(struct channel*, struct msg*);
+int chan_fill(struct channel*);
+int chan_next(struct channel*, struct msg*);
+int proto_encode(const struct msg*, int, char*);
+int proto_decode(struct framer*, struct msg*);
+int proto_deploy(struct game*, int, const struct msg*);
+
+#endif
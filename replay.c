@@ -0,0 +1,208 @@
+/******************************************************
+ * Description: Replays game logs through the rules
+ *   engine. Each file is memory-mapped and walked one
+ *   record at a time; every deployment and shot is
+ *   applied again, the logged shot results and winner
+ *   are checked against what the engine says, and the
+ *   game statistics are rebuilt from the replayed games.
+ ******************************************************/
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "engine.h"
+#include "gamelog.h"
+#include "timer.h"
+
+// totals over every replayed file
+struct replay_stats {
+  long games;           // games with an end record
+  long bad;             // games that did not replay to the logged outcome
+  long abandoned;       // ended without a winner
+  long truncated;       // no end record
+  long records;
+  long corrupt;         // records of unknown type
+  long wins[4];         // by engine_win() result
+  long win_shots[2];    // shots fired by the winner, summed over its wins
+  long results[4];      // shots by SHOT_* result
+  double millis;        // game time of finished games
+};
+
+// replay state of the game being read
+struct replay {
+  struct game g;
+  int open;             // inside a game
+  int ok;               // everything so far matched
+  long off;             // offset of its start record
+};
+
+void replay_file(const char*, struct replay_stats*, int);
+void apply(struct replay*, struct log_rec*, struct replay_stats*);
+void finish(struct replay*, struct log_rec*, struct replay_stats*, const char*, int);
+void report(struct replay_stats*, double);
+
+
+int main(int argc, char** argv)
+{
+  struct replay_stats st;
+  double start;
+  int opt, verbose = 0;
+
+  while((opt = getopt(argc, argv, "v")) != -1) {
+    switch(opt) {
+      case 'v':
+        // name every game that fails to verify
+        verbose = 1;
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-v] log...\n", argv[0]);
+        return 1;
+    }
+  }
+  if(optind == argc) {
+    fprintf(stderr, "usage: %s [-v] log...\n", argv[0]);
+    return 1;
+  }
+  memset(&st, 0, sizeof(st));
+  start = now();
+  for(; optind < argc; optind++)
+    replay_file(argv[optind], &st, verbose);
+  report(&st, now() - start);
+  return st.bad ? 2 : 0;
+}
+
+// map a log and replay every game in it
+void replay_file(const char* path, struct replay_stats* st, int verbose)
+{
+  struct replay rp;
+  struct log_rec r;
+  struct stat sb;
+  unsigned char* p;
+  long off, len;
+  int fd;
+  if((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &sb) < 0) {
+    perror(path);
+    exit(1);
+  }
+  len = sb.st_size - sb.st_size % LOG_REC;
+  if(!len) {
+    close(fd);
+    return;
+  }
+  if((p = mmap(0, len, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+    perror(path);
+    exit(1);
+  }
+  madvise(p, len, MADV_SEQUENTIAL);
+  close(fd);
+
+  rp.open = 0;
+  for(off = 0; off < len; off += LOG_REC) {
+    gamelog_decode(p + off, &r);
+    st->records++;
+    if(r.type == LOG_GAME) {
+      if(rp.open)
+        finish(&rp, 0, st, path, verbose);
+      engine_init(&rp.g);
+      rp.open = rp.ok = 1;
+      rp.off = off;
+    }
+    else if(r.type == LOG_END) {
+      if(rp.open)
+        finish(&rp, &r, st, path, verbose);
+    }
+    else if(r.type == LOG_DEPLOY || r.type == LOG_SHOT) {
+      if(rp.open && rp.ok)
+        apply(&rp, &r, st);
+    }
+    else
+      st->corrupt++;
+  }
+  if(rp.open)
+    finish(&rp, 0, st, path, verbose);
+  munmap(p, len);
+}
+
+// run one deployment or shot through the engine
+void apply(struct replay* rp, struct log_rec* r, struct replay_stats* st)
+{
+  int y = r->cell / BOARD_SIZE, x = r->cell % BOARD_SIZE, res;
+  if(r->side > P2 || r->cell >= TOT_ATK_CELL) {
+    rp->ok = 0;
+    return;
+  }
+  if(r->type == LOG_DEPLOY) {
+    if(r->arg >= SHIP_COUNT ||
+       engine_deploy_cell(&rp->g, r->side, ship_types[r->arg][0], y, x) != DEPLOY_OK)
+      rp->ok = 0;
+    return;
+  }
+  // shots only once both fleets are down, and they must land as logged
+  if(!engine_fleet_deployed(&rp->g, P1) || !engine_fleet_deployed(&rp->g, P2)) {
+    rp->ok = 0;
+    return;
+  }
+  res = engine_attack(&rp->g, !r->side, y, x);
+  if(res != r->arg)
+    rp->ok = 0;
+  else
+    st->results[res]++;
+}
+
+// check the end of a game, r is 0 if the log stops before its end record
+void finish(struct replay* rp, struct log_rec* r, struct replay_stats* st, const char* path, int verbose)
+{
+  int w = engine_win(&rp->g);
+  rp->open = 0;
+  if(!r) {
+    st->truncated++;
+    return;
+  }
+  st->games++;
+  if(!w && rp->g.shots[P1] == TOT_ATK_CELL && rp->g.shots[P2] == TOT_ATK_CELL)
+    w = 1;
+  if(!r->arg) {
+    // abandoned, the moves up to there must still be legal
+    st->abandoned++;
+    w = 0;
+  }
+  if(!rp->ok || w != r->arg) {
+    st->bad++;
+    if(verbose)
+      printf("%s:%ld: game does not replay (logged %d, engine %d)\n", path, rp->off, r->arg, w);
+    return;
+  }
+  if(!w)
+    return;
+  st->wins[w]++;
+  st->millis += r->time;
+  if(w == 2 || w == 3)
+    st->win_shots[w - 2] += rp->g.shots[w - 2];
+}
+
+// print the rebuilt statistics
+void report(struct replay_stats* st, double secs)
+{
+  long done = st->wins[1] + st->wins[2] + st->wins[3];
+  long shots = st->results[SHOT_MISS] + st->results[SHOT_HIT] + st->results[SHOT_SUNK];
+  printf("games:        %ld (%ld abandoned, %ld truncated)\n", st->games, st->abandoned, st->truncated);
+  printf("verified:     %ld\n", st->games - st->bad);
+  printf("failed:       %ld\n", st->bad);
+  printf("p1 wins:      %ld\n", st->wins[2]);
+  printf("p2 wins:      %ld\n", st->wins[3]);
+  printf("ties:         %ld\n", st->wins[1]);
+  printf("shots-to-win: %.2f (p1) %.2f (p2)\n", st->wins[2] ? (double)st->win_shots[P1] / st->wins[2] : 0.0,
+         st->wins[3] ? (double)st->win_shots[P2] / st->wins[3] : 0.0);
+  printf("hit rate:     %.2f%%\n", shots ? 100.0 * (st->results[SHOT_HIT] + st->results[SHOT_SUNK]) / shots : 0.0);
+  printf("game time:    %.1f ms avg\n", done ? st->millis / done : 0.0);
+  if(st->corrupt)
+    printf("corrupt:      %ld records\n", st->corrupt);
+  printf("records:      %ld\n", st->records);
+  printf("seconds:      %.3f\n", secs);
+  printf("games/sec:    %.0f\n", secs > 0 ? st->games / secs : 0.0);
+}
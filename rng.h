@@ -0,0 +1,40 @@
+/******************************************************
+ * Description: Small xorshift64* random number generator.
+ *   Each caller owns its own struct rng so simulations
+ *   on different threads never share state.
+ ******************************************************/
+
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+struct rng {
+  uint64_t s;
+};
+
+// seed a generator, mixing the seed so small seeds still diverge
+static inline void rng_seed(struct rng* r, uint64_t seed)
+{
+  uint64_t z = seed + 0x9e3779b97f4a7c15ULL;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  r->s = (z ^ (z >> 31)) | 1;
+}
+
+// next 64 random bits
+static inline uint64_t rng_next(struct rng* r)
+{
+  r->s ^= r->s >> 12;
+  r->s ^= r->s << 25;
+  r->s ^= r->s >> 27;
+  return r->s * 0x2545f4914f6cdd1dULL;
+}
+
+// random int in [0, n)
+static inline int rng_range(struct rng* r, int n)
+{
+  return (int)(((rng_next(r) >> 32) * (uint64_t)n) >> 32);
+}
+
+#endif
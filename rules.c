@@ -0,0 +1,121 @@
+/******************************************************
+ * Description: Rules file reader. A rules file is a
+ *   list of lines:
+ *     # comment
+ *     board <rows> <cols>
+ *     ship <name> <letter> <length>
+ *   and is checked so every fleet it describes fits.
+ ******************************************************/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "engine.h"
+#include "rules.h"
+
+static int bad(const char*, int, const char*);
+
+
+// the built-in game: 10x10 and the five classic ships
+void rules_classic(struct rules* r)
+{
+  int i;
+  memset(r, 0, sizeof(*r));
+  r->rows = r->cols = BOARD_SIZE;
+  r->cells = TOT_ATK_CELL;
+  r->ship_count = SHIP_COUNT;
+  r->ship_cells = TOT_SHIP_CELL;
+  for(i = 0; i < SHIP_COUNT; i++) {
+    snprintf(r->ship_name[i], RULES_NAME_LEN, "%s", ship_types[i]);
+    r->ship_ch[i] = ship_types[i][0];
+    r->ship_len[i] = ship_lengths[i];
+  }
+}
+
+// read a rules file, return 0 or -1 after printing what is wrong
+int rules_load(const char* path, struct rules* r)
+{
+  char line[256], name[RULES_NAME_LEN], ch;
+  int n = 0, i, len, rows, cols;
+  FILE* f = fopen(path, "r");
+  if(!f) {
+    perror(path);
+    return -1;
+  }
+  memset(r, 0, sizeof(*r));
+  while(fgets(line, sizeof(line), f)) {
+    n++;
+    if(line[0] == '#' || strspn(line, " \t\r\n") == strlen(line))
+      continue;
+    if(sscanf(line, "board %d %d", &rows, &cols) == 2) {
+      if(rows < RULES_MIN_SIZE || rows > RULES_MAX_SIZE || cols < RULES_MIN_SIZE || cols > RULES_MAX_SIZE)
+        return fclose(f), bad(path, n, "board must be 4x4 to 32x32");
+      r->rows = rows;
+      r->cols = cols;
+      r->cells = rows * cols;
+    }
+    else if(sscanf(line, "ship %24s %c %d", name, &ch, &len) == 3) {
+      if(r->ship_count == RULES_MAX_SHIPS)
+        return fclose(f), bad(path, n, "too many ships");
+      if(len < 1 || len > RULES_MAX_SIZE)
+        return fclose(f), bad(path, n, "bad ship length");
+      for(i = 0; i < r->ship_count; i++)
+        if(r->ship_ch[i] == ch)
+          return fclose(f), bad(path, n, "ship letter used twice");
+      // names are written with underscores for spaces
+      for(i = 0; name[i]; i++)
+        if(name[i] == '_')
+          name[i] = ' ';
+      strcpy(r->ship_name[r->ship_count], name);
+      r->ship_ch[r->ship_count] = ch;
+      r->ship_len[r->ship_count] = len;
+      r->ship_cells += len;
+      r->ship_count++;
+    }
+    else
+      return fclose(f), bad(path, n, "expected board or ship");
+  }
+  fclose(f);
+  if(!r->cells || !r->ship_count)
+    return bad(path, n, "needs a board and at least one ship");
+  for(i = 0; i < r->ship_count; i++)
+    if(r->ship_len[i] > r->rows && r->ship_len[i] > r->cols)
+      return bad(path, n, "ship longer than the board");
+  // random fleets are drawn by trial, keep the board mostly water
+  if(r->ship_cells * 2 > r->cells)
+    return bad(path, n, "fleet covers more than half the board");
+  return 0;
+}
+
+// check if rules are the ones the classic engine is built for
+int rules_is_classic(const struct rules* r)
+{
+  struct rules c;
+  int i;
+  rules_classic(&c);
+  if(r->rows != c.rows || r->cols != c.cols || r->ship_count != c.ship_count)
+    return 0;
+  for(i = 0; i < c.ship_count; i++)
+    if(r->ship_len[i] != c.ship_len[i] || r->ship_ch[i] != c.ship_ch[i])
+      return 0;
+  return 1;
+}
+
+// board letter of a row: A-Z, then a-z
+char rules_row_label(const struct rules* r, int y)
+{
+  return y < 26 ? 'A' + y : 'a' + y - 26;
+}
+
+// board number of a column, the classic board counts 1..9 then 0
+int rules_col_label(const struct rules* r, int x)
+{
+  return r->cols == BOARD_SIZE ? col_index2num(x) : x + 1;
+}
+
+// report a rules file error
+static int bad(const char* path, int line, const char* msg)
+{
+  fprintf(stderr, "%s:%d: %s\n", path, line, msg);
+  return -1;
+}
@@ -0,0 +1,33 @@
+/******************************************************
+ * Description: Game rules read from a rules file: board
+ *   geometry and fleet composition. The classic 10x10
+ *   game with five ships is what engine.h compiles in;
+ *   other rules run on the sized engines in variant.h.
+ ******************************************************/
+
+#ifndef RULES_H
+#define RULES_H
+
+#define RULES_MIN_SIZE 4
+#define RULES_MAX_SIZE 32
+#define RULES_MAX_CELLS (RULES_MAX_SIZE * RULES_MAX_SIZE)
+#define RULES_MAX_SHIPS 16
+#define RULES_NAME_LEN 25
+
+struct rules {
+  int rows, cols;
+  int cells;                            // rows * cols
+  int ship_count;
+  int ship_cells;                       // cells of the whole fleet
+  char ship_name[RULES_MAX_SHIPS][RULES_NAME_LEN];
+  char ship_ch[RULES_MAX_SHIPS];        // board letter
+  int ship_len[RULES_MAX_SHIPS];
+};
+
+void rules_classic(struct rules*);
+int rules_load(const char*, struct rules*);
+int rules_is_classic(const struct rules*);
+char rules_row_label(const struct rules*, int);
+int rules_col_label(const struct rules*, int);
+
+#endif
@@ -0,0 +1,230 @@
+/******************************************************
+ * Description: Monte Carlo fleet sampler. Candidate
+ *   placements are filtered once per position against
+ *   the misses and sunk ships; a randomized search
+ *   finds a first legal layout and a Gibbs chain then
+ *   walks the layouts. Single-ship moves keep every
+ *   other ship fixed; pair moves re-draw two ships
+ *   together so a hit can pass from one to the other.
+ ******************************************************/
+
+#include <string.h>
+
+#include "sampler.h"
+
+// search nodes tried before giving up on a position
+#define SEARCH_BUDGET 1000000
+// sweeps thrown away after the first layout
+#define BURN_IN 16
+
+static int search(struct sampler*, int, bitboard, long*);
+static void sweep(struct sampler*);
+static void move_one(struct sampler*, int);
+static void move_pair(struct sampler*, int, int);
+
+
+// what the player attacking mode's board knows about it
+void sampler_knowledge(const struct game* g, int mode, struct sample_knowledge* k)
+{
+  const struct side* sd = &g->side[mode];
+  int i;
+  k->hits = sd->hits;
+  k->misses = sd->misses;
+  // the shooter saw the ship sink but not which hit did it
+  for(i = 0; i < SHIP_COUNT; i++)
+    k->sunk_at[i] = sd->ships[i].is_sunk ? sd->hits : 0;
+}
+
+// set up a sampler on a position, return 0 if no layout fits it
+int sampler_init(struct sampler* s, const struct sample_knowledge* k, uint64_t seed)
+{
+  const struct place_table* t = places;
+  bitboard m;
+  long budget = SEARCH_BUDGET;
+  int i, p, c, n;
+  place_init();
+  s->k = *k;
+  s->sweeps = 1;
+  rng_seed(&s->r, seed);
+  memset(s->cell_cand_count, 0, sizeof(s->cell_cand_count));
+  for(i = 0; i < SHIP_COUNT; i++) {
+    n = 0;
+    for(p = t->ship_first[i]; p < t->ship_first[i + 1]; p++) {
+      m = t->place[p].mask;
+      if(m & k->misses)
+        continue;
+      // a sunk ship lies on hits only, a ship afloat never does
+      if(k->sunk_at[i] ? ((m & ~k->hits) || !(m & k->sunk_at[i])) : !(m & ~k->hits))
+        continue;
+      s->cand[i][n] = m;
+      while(m) {
+        c = bb_pop(&m);
+        s->cell_cand[i][c][s->cell_cand_count[i][c]++] = n;
+      }
+      n++;
+    }
+    if(!(s->cand_count[i] = n))
+      return 0;
+  }
+  if(!search(s, 0, 0, &budget))
+    return 0;
+  for(i = 0; i < BURN_IN; i++)
+    sweep(s);
+  return 1;
+}
+
+// advance the chain and copy out the next layout, one mask per ship
+void sampler_next(struct sampler* s, bitboard* layout)
+{
+  int i;
+  for(i = 0; i < s->sweeps; i++)
+    sweep(s);
+  if(layout)
+    memcpy(layout, s->ship, sizeof(s->ship));
+}
+
+// occupancy probability of every cell over n layouts
+void sampler_heatmap(struct sampler* s, int n, double* prob)
+{
+  int count[TOT_ATK_CELL];
+  bitboard m;
+  int i, j;
+  memset(count, 0, sizeof(count));
+  for(i = 0; i < n; i++) {
+    sampler_next(s, 0);
+    for(j = 0; j < SHIP_COUNT; j++) {
+      m = s->ship[j];
+      while(m)
+        count[bb_pop(&m)]++;
+    }
+  }
+  for(i = 0; i < TOT_ATK_CELL; i++)
+    prob[i] = n ? (double)count[i] / n : 0.0;
+}
+
+// find a first legal layout, covering the lowest uncovered hit first
+static int search(struct sampler* s, int placed, bitboard occ, long* budget)
+{
+  bitboard need = s->k.hits & ~occ, m;
+  int i, j, k, n, c, start, ship0;
+  if(placed == (1 << SHIP_COUNT) - 1)
+    return !need;
+  if(--*budget < 0)
+    return 0;
+  if(need) {
+    // some unplaced ship has to go through this cell
+    c = bb_first(need);
+    ship0 = rng_range(&s->r, SHIP_COUNT);
+    for(k = 0; k < SHIP_COUNT; k++) {
+      i = (ship0 + k) % SHIP_COUNT;
+      if((placed >> i) & 1 || !(n = s->cell_cand_count[i][c]))
+        continue;
+      start = rng_range(&s->r, n);
+      for(j = 0; j < n; j++) {
+        m = s->cand[i][s->cell_cand[i][c][(start + j) % n]];
+        if(m & occ)
+          continue;
+        s->ship[i] = m;
+        if(search(s, placed | 1 << i, occ | m, budget))
+          return 1;
+      }
+    }
+    return 0;
+  }
+  // every hit is covered, the rest only has to fit; the ship with the fewest
+  // candidates goes first, so a sunk ship pinned to its hits fails at once
+  for(i = -1, k = 0; k < SHIP_COUNT; k++)
+    if(!((placed >> k) & 1) && (i < 0 || s->cand_count[k] < s->cand_count[i]))
+      i = k;
+  n = s->cand_count[i];
+  start = rng_range(&s->r, n);
+  for(j = 0; j < n; j++) {
+    m = s->cand[i][(start + j) % n];
+    if(m & occ)
+      continue;
+    s->ship[i] = m;
+    if(search(s, placed | 1 << i, occ | m, budget))
+      return 1;
+  }
+  return 0;
+}
+
+// re-draw every ship once, then one random pair together
+static void sweep(struct sampler* s)
+{
+  int i, j;
+  for(i = 0; i < SHIP_COUNT; i++)
+    move_one(s, i);
+  i = rng_range(&s->r, SHIP_COUNT);
+  j = (i + 1 + rng_range(&s->r, SHIP_COUNT - 1)) % SHIP_COUNT;
+  move_pair(s, i, j);
+}
+
+// re-draw ship i among the placements that fit around the others
+static void move_one(struct sampler* s, int i)
+{
+  short ok[SHIP_PLACE_MAX];
+  bitboard others = 0, need, m;
+  int j, n = 0, c;
+  for(j = 0; j < SHIP_COUNT; j++)
+    if(j != i)
+      others |= s->ship[j];
+  need = s->k.hits & ~others;
+  if(need) {
+    // it has to cover what the others leave, so it runs through the first such cell
+    c = bb_first(need);
+    for(j = 0; j < s->cell_cand_count[i][c]; j++) {
+      m = s->cand[i][s->cell_cand[i][c][j]];
+      if(!(m & others) && !(need & ~m))
+        ok[n++] = s->cell_cand[i][c][j];
+    }
+  }
+  else {
+    for(j = 0; j < s->cand_count[i]; j++)
+      if(!(s->cand[i][j] & others))
+        ok[n++] = j;
+  }
+  // the current placement is always among them
+  s->ship[i] = s->cand[i][ok[rng_range(&s->r, n)]];
+}
+
+// re-draw ships a and b together when the hits left to them need both
+static void move_pair(struct sampler* s, int a, int b)
+{
+  short pairs[2 * CELL_SHIP_MAX * SHIP_PLACE_MAX][2];
+  bitboard others = 0, need, rest, ma, mb;
+  int j, x, y, n = 0, c, r, side, cnt, cnt2;
+  int ship[2] = { a, b };
+  for(j = 0; j < SHIP_COUNT; j++)
+    if(j != a && j != b)
+      others |= s->ship[j];
+  if(!(need = s->k.hits & ~others))
+    return;
+  // one of the two covers the first cell, never both since they cannot overlap
+  c = bb_first(need);
+  for(side = 0; side < 2; side++) {
+    int p = ship[side], q = ship[!side];
+    cnt = s->cell_cand_count[p][c];
+    for(x = 0; x < cnt; x++) {
+      ma = s->cand[p][s->cell_cand[p][c][x]];
+      if(ma & others)
+        continue;
+      rest = need & ~ma;
+      r = rest ? bb_first(rest) : -1;
+      cnt2 = rest ? s->cell_cand_count[q][r] : s->cand_count[q];
+      for(y = 0; y < cnt2; y++) {
+        int iq = rest ? s->cell_cand[q][r][y] : y;
+        mb = s->cand[q][iq];
+        if((mb & (others | ma)) || (rest & ~mb))
+          continue;
+        pairs[n][side] = s->cell_cand[p][c][x];
+        pairs[n][!side] = iq;
+        n++;
+      }
+    }
+  }
+  j = rng_range(&s->r, n);
+  s->ship[a] = s->cand[a][pairs[j][0]];
+  s->ship[b] = s->cand[b][pairs[j][1]];
+}
+
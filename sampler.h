@@ -0,0 +1,44 @@
+/******************************************************
+ * Description: Monte Carlo fleet sampler. Draws whole
+ *   fleet layouts consistent with what a shooter knows
+ *   about a board (misses, hits, sunk ships) and turns
+ *   them into a per-cell occupancy heatmap. Layouts are
+ *   produced by a Markov chain over precomputed ship
+ *   placements: every step re-draws one or two ships
+ *   uniformly among the placements that keep the whole
+ *   layout legal, so nothing is ever rejected and the
+ *   chain settles on the uniform distribution.
+ ******************************************************/
+
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include "engine.h"
+#include "place.h"
+#include "rng.h"
+
+// what the shooter knows about the target board
+struct sample_knowledge {
+  bitboard hits;
+  bitboard misses;
+  bitboard sunk_at[SHIP_COUNT];   // 0 if afloat, else the cells one of which sank it
+};
+
+struct sampler {
+  struct sample_knowledge k;
+  struct rng r;
+  int sweeps;                                     // chain sweeps per sample
+  bitboard ship[SHIP_COUNT];                      // current layout
+  // placements allowed by the knowledge alone
+  bitboard cand[SHIP_COUNT][SHIP_PLACE_MAX];
+  short cand_count[SHIP_COUNT];
+  short cell_cand[SHIP_COUNT][TOT_ATK_CELL][CELL_SHIP_MAX];
+  unsigned char cell_cand_count[SHIP_COUNT][TOT_ATK_CELL];
+};
+
+void sampler_knowledge(const struct game*, int, struct sample_knowledge*);
+int sampler_init(struct sampler*, const struct sample_knowledge*, uint64_t);
+void sampler_next(struct sampler*, bitboard*);
+void sampler_heatmap(struct sampler*, int, double*);
+
+#endif
@@ -0,0 +1,589 @@
+/******************************************************
+ * Description: Game server. Accepts players on any
+ *   number of TCP and unix socket listeners, pairs them
+ *   in arrival order and referees each match with the
+ *   headless engine: deployments and shots are checked
+ *   against the rules before they are relayed to the
+ *   opponent. With -r the server is the only referee:
+ *   fleets stay with it and each shot is resolved here
+ *   once, the shooter and the target get the result.
+ *   One thread and one epoll set carry every
+ *   game; all sockets are non-blocking and output that
+ *   cannot be written yet waits in the channel buffer.
+ *   Spectators connect on their own listeners and get
+ *   every game's events from one shared ring; a viewer
+ *   that cannot keep up is resynced, never waited for.
+ *   Matches keep their game packed and come, like the
+ *   connections, from slabs, so a server with very many
+ *   games open holds little more than their sockets.
+ ******************************************************/
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "engine.h"
+#include "metrics.h"
+#include "net.h"
+#include "pack.h"
+#include "proto.h"
+#include "slab.h"
+#include "watch.h"
+
+#define MAX_LISTEN 16
+#define MAX_EVENTS 256
+#define MAX_VIEWERS 4096
+// objects per slab chunk
+#define MATCH_CHUNK 4096
+#define CONN_CHUNK 1024
+
+struct match;
+
+// one socket: a listener or a player
+struct conn {
+  int fd;
+  int listener;         // accept on it instead of reading
+  int viewer;           // spectator, or a listener for them
+  int slot;             // index in viewers[]
+  int side;             // P1 or P2 in the match
+  int fired;            // shots relayed for this player
+  int out_armed;        // EPOLLOUT requested
+  int queued;           // on the list to flush after this event batch
+  struct match* m;
+  struct conn* next;    // waiting list, then the list of closed players
+  struct conn* next_out;  // players with output queued in this event batch
+  struct channel ch;
+  struct watch_cursor* view;   // spectators only
+};
+
+struct match {
+  struct game_pack g;   // unpacked only while a move is applied
+  uint32_t id;
+  int over;             // EV_END published
+  struct conn* p[2];
+  struct match* next;   // list of finished matches
+};
+
+// totals printed on exit
+struct server_stats {
+  long conns, games, finished, moves, rejected, dropped;
+  long viewers, events, resyncs;
+};
+
+void accept_all(struct conn*);
+void add_viewer(struct conn*);
+void pump_viewer(struct conn*);
+void broadcast();
+void publish(struct match*, int, int, int, int, int, int);
+void pair_up(struct conn*);
+void read_conn(struct conn*);
+int handle_move(struct conn*, struct msg*);
+int send_result(struct match*, int, struct msg*, int, int);
+int relay(struct conn*, struct msg*);
+void flush_conn(struct conn*);
+void flush_queued();
+void close_conn(struct conn*);
+void end_match(struct match*);
+void reap();
+void on_signal(int);
+void print_memory();
+
+
+// global vars
+int epfd;
+struct conn* waiting;           // players with no opponent yet
+struct conn* dead_conns;        // closed, freed once the event batch is done
+struct conn* out_conns;         // output queued in this event batch, written at its end
+struct match* dead_matches;
+struct watch_ring ring;
+struct conn* viewers[MAX_VIEWERS];
+int nviewers;
+uint64_t sent_head;             // ring head when the viewers were last pumped
+struct server_stats stats;
+struct slab match_slab, conn_slab;
+int referee;                    // keep the fleets, send shot results instead of relaying moves
+volatile sig_atomic_t stop;
+
+
+int main(int argc, char** argv)
+{
+  struct conn listeners[MAX_LISTEN];
+  struct epoll_event ev, events[MAX_EVENTS];
+  struct rlimit rl;
+  int opt, i, n, nlisten = 0;
+
+  memset(listeners, 0, sizeof(listeners));
+  if((epfd = epoll_create1(0)) < 0) {
+    perror("epoll_create1");
+    return 1;
+  }
+  while((opt = getopt(argc, argv, "l:w:r")) != -1) {
+    switch(opt) {
+      case 'r':
+        referee = 1;
+        break;
+      case 'l':
+      case 'w':
+        if(nlisten == MAX_LISTEN) {
+          fprintf(stderr, "too many listeners\n");
+          return 1;
+        }
+        if((listeners[nlisten].fd = net_listen(optarg)) < 0) {
+          perror(optarg);
+          return 1;
+        }
+        listeners[nlisten].listener = 1;
+        listeners[nlisten].viewer = opt == 'w';
+        ev.events = EPOLLIN;
+        ev.data.ptr = &listeners[nlisten];
+        epoll_ctl(epfd, EPOLL_CTL_ADD, listeners[nlisten].fd, &ev);
+        printf("%s on %s\n", opt == 'w' ? "spectators" : "listening", optarg);
+        nlisten++;
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-r] -l addr [-l addr ...] [-w addr ...]\n"
+                "  addr is unix:/path, tcp:host:port or host:port\n"
+                "  -w takes spectators, -r hides the fleets and sends shot results\n", argv[0]);
+        return 1;
+    }
+  }
+  if(!nlisten) {
+    fprintf(stderr, "usage: %s [-r] -l addr [-l addr ...] [-w addr ...]\n", argv[0]);
+    return 1;
+  }
+  fflush(stdout);
+
+  // two descriptors per game, so take every descriptor we are allowed
+  if(!getrlimit(RLIMIT_NOFILE, &rl) && rl.rlim_cur < rl.rlim_max) {
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+  }
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+  metrics_init("battleship-server");
+  slab_init(&match_slab, sizeof(struct match), MATCH_CHUNK);
+  slab_init(&conn_slab, sizeof(struct conn), CONN_CHUNK);
+
+  while(!stop) {
+    metrics_check();
+    if((n = epoll_wait(epfd, events, MAX_EVENTS, -1)) < 0) {
+      if(errno == EINTR)
+        continue;
+      perror("epoll_wait");
+      return 1;
+    }
+    for(i = 0; i < n; i++) {
+      struct conn* c = events[i].data.ptr;
+      if(c->fd < 0)
+        continue;
+      if(c->listener)
+        accept_all(c);
+      else if(events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+        read_conn(c);
+      else if(events[i].events & EPOLLOUT)
+        c->viewer ? pump_viewer(c) : flush_conn(c);
+    }
+    flush_queued();
+    broadcast();
+    reap();
+  }
+
+  printf("connections:  %ld\n", stats.conns);
+  printf("games:        %ld started, %ld finished\n", stats.games, stats.finished);
+  printf("moves:        %ld relayed, %ld rejected\n", stats.moves, stats.rejected);
+  printf("dropped:      %ld slow clients\n", stats.dropped);
+  printf("spectators:   %ld, %ld events, %ld resyncs\n", stats.viewers, stats.events, stats.resyncs);
+  print_memory();
+  metrics_dump("exit");
+  for(i = 0; i < nlisten; i++)
+    close(listeners[i].fd);
+  return 0;
+}
+
+// take every pending connection on a listener
+void accept_all(struct conn* l)
+{
+  struct epoll_event ev;
+  struct conn* c;
+  int fd;
+  while((fd = accept(l->fd, 0, 0)) >= 0) {
+    if(net_nonblock(fd) < 0 || !(c = slab_alloc(&conn_slab))) {
+      close(fd);
+      continue;
+    }
+    memset(c, 0, sizeof(*c));
+    c->fd = fd;
+    c->viewer = l->viewer;
+    chan_init(&c->ch, fd, fd, 0);
+    ev.events = EPOLLIN;
+    ev.data.ptr = c;
+    if(epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+      close(fd);
+      slab_free(&conn_slab, c);
+      continue;
+    }
+    if(c->viewer)
+      add_viewer(c);
+    else {
+      stats.conns++;
+      pair_up(c);
+    }
+  }
+  if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+    perror("accept");
+}
+
+// match a new player with the one waiting longest, or make it wait
+void pair_up(struct conn* c)
+{
+  struct match* m;
+  struct msg start = { MSG_START, 0, referee ? START_REFEREE : 0, 0, 0 };
+  int side;
+  if(!waiting) {
+    waiting = c;
+    return;
+  }
+  if(!(m = slab_alloc(&match_slab))) {
+    close_conn(c);
+    return;
+  }
+  // the record of an empty game is all zeroes
+  memset(&m->g, 0, sizeof(m->g));
+  m->id = stats.games;
+  m->over = 0;
+  m->p[P1] = waiting;
+  m->p[P2] = c;
+  waiting = waiting->next;
+  m->p[P1]->next = 0;
+  stats.games++;
+  m->next = 0;
+  for(side = P1; side <= P2; side++) {
+    m->p[side]->m = m;
+    m->p[side]->side = side;
+  }
+  publish(m, EV_START, 0, 0, 0, 0, NO_SHIP);
+  for(side = P1; side <= P2 && c->fd >= 0; side++) {
+    start.ship = side + 1;
+    relay(m->p[side], &start);
+  }
+}
+
+// start a spectator at the newest event
+void add_viewer(struct conn* c)
+{
+  if(nviewers == MAX_VIEWERS || !(c->view = malloc(sizeof(*c->view)))) {
+    close(c->fd);
+    slab_free(&conn_slab, c);
+    return;
+  }
+  watch_join(&ring, c->view);
+  c->slot = nviewers;
+  viewers[nviewers++] = c;
+  stats.viewers++;
+}
+
+// write a spectator as much of the stream as it takes without blocking
+void pump_viewer(struct conn* c)
+{
+  struct epoll_event ev;
+  struct watch_cursor* v = c->view;
+  uint64_t missed = v->missed;
+  int n, blocked = 0;
+  while((n = watch_pull(&ring, v)) > 0) {
+    if((n = write(c->fd, v->out + v->off, n)) < 0) {
+      if(errno == EINTR)
+        continue;
+      if(errno == EAGAIN || errno == EWOULDBLOCK)
+        blocked = 1;
+      else
+        close_conn(c);
+      break;
+    }
+    v->off += n;
+  }
+  if(v->missed != missed)
+    stats.resyncs++;
+  if(c->fd >= 0 && blocked != c->out_armed) {
+    c->out_armed = blocked;
+    ev.events = EPOLLIN | (blocked ? EPOLLOUT : 0);
+    ev.data.ptr = c;
+    epoll_ctl(epfd, EPOLL_CTL_MOD, c->fd, &ev);
+  }
+}
+
+// hand new events to every spectator not already waiting for room
+void broadcast()
+{
+  int i;
+  if(ring.head == sent_head)
+    return;
+  sent_head = ring.head;
+  // close_conn() moves the last viewer into a closed one's slot
+  for(i = nviewers - 1; i >= 0; i--)
+    if(!viewers[i]->out_armed)
+      pump_viewer(viewers[i]);
+}
+
+// put one event of a match in the spectator ring
+void publish(struct match* m, int type, int player, int row, int col, int result, int ship)
+{
+  struct event e;
+  int i;
+  // a referee keeps the fleets from spectators, who may be players too, until the end
+  if(type == EV_FLEET && referee && !m->over)
+    return;
+  e.type = type;
+  e.game = m->id;
+  e.player = player;
+  e.row = row;
+  e.col = col;
+  e.result = result;
+  e.ship = ship;
+  if(type == EV_FLEET)
+    pack_fleet_layout(&m->g, player, e.fleet);
+  else if(type == EV_END) {
+    m->over = 1;
+    if(referee)
+      for(i = P1; i <= P2; i++)
+        if(pack_fleet_deployed(&m->g, i))
+          publish(m, EV_FLEET, i, 0, 0, 0, NO_SHIP);
+  }
+  watch_publish(&ring, &e);
+  stats.events++;
+}
+
+// read from a player and act on every whole message
+void read_conn(struct conn* c)
+{
+  struct msg m;
+  char junk[256];
+  int r;
+  // spectators have nothing to say, reading only notices them leave
+  if(c->viewer) {
+    while((r = read(c->fd, junk, sizeof(junk))) > 0 || (r < 0 && errno == EINTR))
+      ;
+    if(!r || (errno != EAGAIN && errno != EWOULDBLOCK))
+      close_conn(c);
+    return;
+  }
+  while((r = chan_fill(&c->ch)) != 0) {
+    if(r < 0) {
+      if(errno == EAGAIN || errno == EWOULDBLOCK)
+        break;
+      if(errno == EINTR || errno == EPROTO)
+        continue;
+      close_conn(c);
+      return;
+    }
+    while((r = chan_next(&c->ch, &m)) != 0) {
+      if(r < 0 || handle_move(c, &m) < 0)
+        stats.rejected++;
+      if(c->fd < 0)
+        return;
+    }
+  }
+  if(!r)
+    close_conn(c);
+}
+
+// check one move against the rules and pass it on, -1 if refused
+int handle_move(struct conn* c, struct msg* m)
+{
+  struct match* mt = c->m;
+  struct conn* opp;
+  struct game g;
+  int s = c->side, res, ship = NO_SHIP;
+  if(!mt)
+    return -1;
+  opp = mt->p[!s];
+  if(m->type == MSG_DEPLOY || m->type == MSG_ERASE || m->type == MSG_FLEET) {
+    unpack_game(&mt->g, &g);
+    if(!proto_deploy(&g, s, m))
+      return -1;
+    pack_game(&g, &mt->g);
+    if(engine_fleet_deployed(&g, s))
+      publish(mt, EV_FLEET, s, 0, 0, 0, NO_SHIP);
+    else if(referee) {
+      stats.moves++;
+      return 0;
+    }
+  }
+  else if(m->type == MSG_ATTACK) {
+    // both fleets down, at most one shot ahead and the game still on
+    if(!pack_fleet_deployed(&mt->g, P1) || !pack_fleet_deployed(&mt->g, P2) ||
+       c->fired > opp->fired || (c->fired == opp->fired && pack_win(&mt->g)) ||
+       (res = pack_attack(&mt->g, !s, m->row, m->col, &ship)) == SHOT_REPEAT)
+      return -1;
+    publish(mt, EV_SHOT, s, m->row, m->col, res, ship);
+    c->fired++;
+    if(c->fired == opp->fired && (pack_win(&mt->g) || c->fired == TOT_ATK_CELL)) {
+      stats.finished++;
+      publish(mt, EV_END, 0, 0, 0, pack_win(&mt->g), NO_SHIP);
+    }
+    if(referee) {
+      stats.moves++;
+      return send_result(mt, s, m, res, ship);
+    }
+  }
+  else
+    return -1;
+  stats.moves++;
+  if(referee) {
+    // the opponent only learns that the fleet is down
+    struct msg ready = { MSG_READY, NO_SHIP, 0, 0, 0 };
+    return relay(opp, &ready);
+  }
+  return relay(opp, m);
+}
+
+// tell the shooter and the target how a shot of side s went
+int send_result(struct match* mt, int s, struct msg* m, int res, int ship)
+{
+  struct msg out = { MSG_RESULT, ship, m->row, m->col, 0 };
+  out.result = res;
+  relay(mt->p[s], &out);
+  // the shooter may have been dropped, which ends the match
+  if(mt->p[!s]->fd < 0)
+    return 0;
+  out.type = MSG_INCOMING;
+  return relay(mt->p[!s], &out);
+}
+
+// queue a message for a player, sent with everything else it gets in this event batch
+int relay(struct conn* c, struct msg* m)
+{
+  struct msg out = *m;
+  if(chan_queue(&c->ch, &out) < 0) {
+    // a client that stopped reading is not worth the memory
+    stats.dropped++;
+    close_conn(c);
+    return 0;
+  }
+  if(!c->queued && !c->out_armed) {
+    c->queued = 1;
+    c->next_out = out_conns;
+    out_conns = c;
+  }
+  return 0;
+}
+
+// one write per player for all the moves and results of the event batch
+void flush_queued()
+{
+  struct conn* c;
+  while(out_conns) {
+    c = out_conns;
+    out_conns = c->next_out;
+    c->queued = 0;
+    if(c->fd >= 0)
+      flush_conn(c);
+  }
+}
+
+// write buffered output, watching for room only while some is left
+void flush_conn(struct conn* c)
+{
+  struct epoll_event ev;
+  int r = chan_flush(&c->ch);
+  if(r < 0) {
+    close_conn(c);
+    return;
+  }
+  if(r != c->out_armed) {
+    c->out_armed = r;
+    ev.events = EPOLLIN | (r ? EPOLLOUT : 0);
+    ev.data.ptr = c;
+    epoll_ctl(epfd, EPOLL_CTL_MOD, c->fd, &ev);
+  }
+}
+
+// drop a player, which ends its match, or a spectator
+void close_conn(struct conn* c)
+{
+  struct conn** w;
+  if(c->fd < 0)
+    return;
+  if(c->viewer) {
+    viewers[c->slot] = viewers[--nviewers];
+    viewers[c->slot]->slot = c->slot;
+  }
+  if(c->m) {
+    end_match(c->m);
+    return;
+  }
+  for(w = &waiting; *w; w = &(*w)->next) {
+    if(*w == c) {
+      *w = c->next;
+      break;
+    }
+  }
+  close(c->fd);
+  c->fd = -1;
+  c->next = dead_conns;
+  dead_conns = c;
+}
+
+// hang up on both players of a match
+void end_match(struct match* m)
+{
+  int side;
+  if(!m->over)
+    publish(m, EV_END, 0, 0, 0, 0, NO_SHIP);
+  for(side = P1; side <= P2; side++) {
+    struct conn* c = m->p[side];
+    // last chance for the final shot to go out
+    chan_flush(&c->ch);
+    close(c->fd);
+    c->fd = -1;
+    c->m = 0;
+    c->next = dead_conns;
+    dead_conns = c;
+  }
+  m->next = dead_matches;
+  dead_matches = m;
+}
+
+// free what was closed, now that no event can point at it
+void reap()
+{
+  struct conn* c;
+  void* p;
+  while(dead_conns) {
+    c = dead_conns;
+    dead_conns = dead_conns->next;
+    free(c->view);
+    slab_free(&conn_slab, c);
+  }
+  while(dead_matches) {
+    p = dead_matches;
+    dead_matches = dead_matches->next;
+    slab_free(&match_slab, p);
+  }
+}
+
+// what the open games cost: the game record, the match around it, its two players
+void print_memory()
+{
+  printf("live games:   %ld now, %ld at peak\n", match_slab.live, match_slab.peak);
+  printf("per game:     %zu B game record (%zu unpacked), %zu B match, %zu B per player\n",
+         sizeof(struct game_pack), sizeof(struct game), match_slab.size, conn_slab.size);
+  // what live objects hold, not the chunks around them
+  if(match_slab.live)
+    printf("in use:       %.0f B per live game\n",
+           (double)(match_slab.live * match_slab.size + conn_slab.live * conn_slab.size) / match_slab.live);
+  printf("slabs:        %zu KB matches, %zu KB players reserved\n",
+         slab_bytes(&match_slab) / 1024, slab_bytes(&conn_slab) / 1024);
+}
+
+// let the event loop finish and print its totals
+void on_signal(int sig)
+{
+  stop = 1;
+}
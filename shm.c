@@ -0,0 +1,252 @@
+/******************************************************
+ * Description: Shared-memory transport: mapping the
+ *   region, the ring copy in and out, and the futex
+ *   handshake. A sleeper raises its flag, then looks at
+ *   the ring once more before it waits on its bell; the
+ *   other side moves its index, then looks at the flag.
+ *   Both are sequentially consistent, so one of them
+ *   always sees the other, and a bell rung in between
+ *   makes the futex wait return at once.
+ ******************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "shm.h"
+
+// how often the second player looks for the first one's region, and how often either
+// asks whether to give up waiting
+#define JOIN_POLL_MS 50
+
+static void ring(_Atomic uint32_t*, _Atomic uint32_t*);
+static void sleep_on(_Atomic uint32_t*, uint32_t, int);
+static void copy_in(struct shm_ring*, uint32_t, const unsigned char*, int);
+static void copy_out(const struct shm_ring*, uint32_t, unsigned char*, int);
+static void nap(int);
+
+
+// meet the other player in the named region: side 0 makes it and waits, side 1 joins;
+// while waiting, give_up (if set) is asked every JOIN_POLL_MS and ends the wait when it
+// says so; return 0 or -1 with errno set (ECANCELED for giving up)
+int shm_link_open(struct shm_link* l, const char* name, int side, int (*give_up)())
+{
+  struct stat st;
+  int fd;
+  if(side == 0) {
+    // whatever an earlier run left behind is stale now
+    shm_unlink(name);
+    if((fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600)) < 0)
+      return -1;
+    if(ftruncate(fd, sizeof(struct shm_region)) < 0 || shm_link_attach(l, fd, 0) < 0) {
+      close(fd);
+      shm_unlink(name);
+      return -1;
+    }
+    close(fd);
+    while(!atomic_load(&l->r->joined)) {
+      if(give_up && give_up()) {
+        // take the seat ourselves so nobody joins late, and hang up on anyone just in
+        atomic_store(&l->r->joined, 1);
+        shm_link_close(l);
+        shm_unlink(name);
+        errno = ECANCELED;
+        return -1;
+      }
+      sleep_on(&l->r->joined, 0, JOIN_POLL_MS);
+    }
+    // both are mapped, nobody else may find it
+    shm_unlink(name);
+    return 0;
+  }
+  for(;;) {
+    if(give_up && give_up()) {
+      errno = ECANCELED;
+      return -1;
+    }
+    if((fd = shm_open(name, O_RDWR, 0)) < 0) {
+      if(errno != ENOENT)
+        return -1;
+      nap(JOIN_POLL_MS);
+      continue;
+    }
+    // made but not sized or set up yet, or already taken
+    if(fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(struct shm_region) ||
+       shm_link_attach(l, fd, 1) < 0) {
+      close(fd);
+      nap(JOIN_POLL_MS);
+      continue;
+    }
+    close(fd);
+    if(!atomic_exchange(&l->r->joined, 1))
+      break;
+    munmap(l->r, sizeof(struct shm_region));
+    nap(JOIN_POLL_MS);
+  }
+  syscall(SYS_futex, &l->r->joined, FUTEX_WAKE, 1, 0, 0, 0);
+  return 0;
+}
+
+// map a region from a descriptor of at least its size; side 0 sets it up, side 1 needs
+// it set up already; return 0 or -1 with errno set
+int shm_link_attach(struct shm_link* l, int fd, int side)
+{
+  void* p = mmap(0, sizeof(struct shm_region), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if(p == MAP_FAILED)
+    return -1;
+  l->r = p;
+  l->side = side;
+  l->kicked = 0;
+  l->out = &l->r->ring[side];
+  l->in = &l->r->ring[!side];
+  if(side == 0)
+    // a fresh descriptor reads as zeroes, everything else starts there too
+    atomic_store(&l->r->magic, SHM_MAGIC);
+  else if(atomic_load(&l->r->magic) != SHM_MAGIC) {
+    munmap(p, sizeof(struct shm_region));
+    errno = EAGAIN;
+    return -1;
+  }
+  return 0;
+}
+
+// hang up both directions, waking whoever sleeps on them, and unmap
+void shm_link_close(struct shm_link* l)
+{
+  int i;
+  if(!l->r)
+    return;
+  for(i = 0; i < 2; i++) {
+    atomic_store(&l->r->ring[i].closed, 1);
+    atomic_fetch_add(&l->r->ring[i].rbell, 1);
+    atomic_fetch_add(&l->r->ring[i].wbell, 1);
+    syscall(SYS_futex, &l->r->ring[i].rbell, FUTEX_WAKE, 1, 0, 0, 0);
+    syscall(SYS_futex, &l->r->ring[i].wbell, FUTEX_WAKE, 1, 0, 0, 0);
+  }
+  munmap(l->r, sizeof(struct shm_region));
+  l->r = 0;
+}
+
+// put n bytes on the outgoing ring as one piece, waiting for room;
+// return n or -1 with errno set (EPIPE once the link is closed)
+int shm_write(struct shm_link* l, const void* buf, int n)
+{
+  struct shm_ring* o = l->out;
+  uint32_t head = atomic_load_explicit(&o->head, memory_order_relaxed), tail, bell;
+  if(n > SHM_RING) {
+    errno = EMSGSIZE;
+    return -1;
+  }
+  for(;;) {
+    if(atomic_load_explicit(&o->closed, memory_order_relaxed)) {
+      errno = EPIPE;
+      return -1;
+    }
+    tail = atomic_load_explicit(&o->tail, memory_order_acquire);
+    if(SHM_RING - (head - tail) >= (uint32_t)n)
+      break;
+    // full: ask the reader for a wake, then make sure it did not just make room
+    bell = atomic_load(&o->wbell);
+    atomic_store(&o->wsleep, 1);
+    if(atomic_load(&o->tail) == tail && !atomic_load(&o->closed))
+      sleep_on(&o->wbell, bell, -1);
+    atomic_store_explicit(&o->wsleep, 0, memory_order_relaxed);
+  }
+  copy_in(o, head, buf, n);
+  atomic_store(&o->head, head + n);
+  if(atomic_load(&o->rsleep))
+    ring(&o->rbell, &o->rsleep);
+  return n;
+}
+
+// take up to n bytes off the incoming ring without waiting;
+// return the count, 0 once the link is closed and drained, or -1 with EAGAIN
+int shm_read(struct shm_link* l, void* buf, int n)
+{
+  struct shm_ring* in = l->in;
+  uint32_t tail = atomic_load_explicit(&in->tail, memory_order_relaxed);
+  uint32_t head = atomic_load_explicit(&in->head, memory_order_acquire);
+  if(head == tail) {
+    if(atomic_load_explicit(&in->closed, memory_order_relaxed))
+      return 0;
+    errno = EAGAIN;
+    return -1;
+  }
+  if((uint32_t)n > head - tail)
+    n = head - tail;
+  copy_out(in, tail, buf, n);
+  atomic_store(&in->tail, tail + n);
+  if(atomic_load(&in->wsleep))
+    ring(&in->wbell, &in->wsleep);
+  return n;
+}
+
+// whether shm_read has something to say: bytes, or the end
+int shm_ready(const struct shm_link* l)
+{
+  return atomic_load(&l->in->head) != atomic_load_explicit(&l->in->tail, memory_order_relaxed) ||
+         atomic_load(&l->in->closed);
+}
+
+// sleep until the incoming ring has something or ms pass (-1 for no limit); return shm_ready()
+int shm_wait(struct shm_link* l, int ms)
+{
+  struct shm_ring* in = l->in;
+  uint32_t bell = atomic_load(&in->rbell);
+  atomic_store(&in->rsleep, 1);
+  if(!shm_ready(l) && !atomic_exchange(&l->kicked, 0))
+    sleep_on(&in->rbell, bell, ms);
+  atomic_store_explicit(&in->rsleep, 0, memory_order_relaxed);
+  return shm_ready(l);
+}
+
+// cut short this side's shm_wait() from another thread, as if something came in
+void shm_kick(struct shm_link* l)
+{
+  atomic_store(&l->kicked, 1);
+  ring(&l->in->rbell, &l->in->rsleep);
+}
+
+// wake the side sleeping on a bell, once
+static void ring(_Atomic uint32_t* bell, _Atomic uint32_t* sleeping)
+{
+  atomic_store_explicit(sleeping, 0, memory_order_relaxed);
+  atomic_fetch_add(bell, 1);
+  syscall(SYS_futex, bell, FUTEX_WAKE, 1, 0, 0, 0);
+}
+
+// futex wait while *word is still val; the region is shared between processes, so not private
+static void sleep_on(_Atomic uint32_t* word, uint32_t val, int ms)
+{
+  struct timespec ts = { ms / 1000, ms % 1000 * 1000000L };
+  syscall(SYS_futex, word, FUTEX_WAIT, val, ms < 0 ? 0 : &ts, 0, 0);
+}
+
+// copy into the ring at a free running offset, wrapping at the end
+static void copy_in(struct shm_ring* o, uint32_t at, const unsigned char* p, int n)
+{
+  uint32_t off = at & (SHM_RING - 1);
+  int k = SHM_RING - off < (uint32_t)n ? SHM_RING - off : n;
+  memcpy(o->data + off, p, k);
+  memcpy(o->data, p + k, n - k);
+}
+
+static void copy_out(const struct shm_ring* in, uint32_t at, unsigned char* p, int n)
+{
+  uint32_t off = at & (SHM_RING - 1);
+  int k = SHM_RING - off < (uint32_t)n ? SHM_RING - off : n;
+  memcpy(p, in->data + off, k);
+  memcpy(p + k, in->data, n - k);
+}
+
+static void nap(int ms)
+{
+  struct timespec ts = { ms / 1000, ms % 1000 * 1000000L };
+  nanosleep(&ts, 0);
+}
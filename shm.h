@@ -0,0 +1,63 @@
+/******************************************************
+ * Description: Shared-memory transport between two
+ *   players on one host. A region holds one ring per
+ *   direction; each ring has a single writer and a
+ *   single reader that only move their own index, so a
+ *   message is a copy and a store, with no lock and no
+ *   system call. A side that has to sleep, the reader
+ *   on an empty ring or the writer on a full one, says
+ *   so in the ring and waits on a futex; the other side
+ *   only makes the wake call when it sees that flag up.
+ *   The region is a named POSIX shared memory object
+ *   for two separately started players, or any mapped
+ *   descriptor (a memfd) shared across a fork.
+ ******************************************************/
+
+#ifndef SHM_H
+#define SHM_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+// bytes per ring, a power of two
+#define SHM_RING 4096
+#define SHM_MAGIC 0x6d687362u     // "bshm"
+
+// one direction; the writer's and the reader's words keep to their own cache lines
+struct shm_ring {
+  _Atomic uint32_t head __attribute__((aligned(64)));   // bytes written, free running
+  _Atomic uint32_t rbell;       // bumped to wake the reader
+  _Atomic uint32_t rsleep;      // the reader is about to sleep on rbell
+  _Atomic uint32_t closed;      // either end is gone
+  _Atomic uint32_t tail __attribute__((aligned(64)));   // bytes read
+  _Atomic uint32_t wbell;       // bumped to wake the writer
+  _Atomic uint32_t wsleep;      // the writer is about to sleep on wbell
+  unsigned char data[SHM_RING] __attribute__((aligned(64)));
+};
+
+// the mapped region
+struct shm_region {
+  _Atomic uint32_t magic;
+  _Atomic uint32_t joined;      // the second side is attached
+  struct shm_ring ring[2];      // ring[i] carries side i's messages
+};
+
+// one side's view
+struct shm_link {
+  struct shm_region* r;
+  struct shm_ring* in;
+  struct shm_ring* out;
+  int side;
+  _Atomic int kicked;           // shm_kick() since the last shm_wait()
+};
+
+int shm_link_open(struct shm_link*, const char*, int, int (*)());
+int shm_link_attach(struct shm_link*, int, int);
+void shm_link_close(struct shm_link*);
+int shm_write(struct shm_link*, const void*, int);
+int shm_read(struct shm_link*, void*, int);
+int shm_ready(const struct shm_link*);
+int shm_wait(struct shm_link*, int);
+void shm_kick(struct shm_link*);
+
+#endif
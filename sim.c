@@ -0,0 +1,185 @@
+/******************************************************
+ * Description: Headless batch simulation driver. Plays
+ *   N games between two strategies on the rules engine
+ *   and reports throughput in games/sec. With a rules
+ *   file other than the classic one the games run on
+ *   the sized engine for that board instead.
+ ******************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "engine.h"
+#include "gamelog.h"
+#include "rng.h"
+#include "rules.h"
+#include "strategy.h"
+#include "timer.h"
+#include "variant.h"
+
+int play_variant(const struct rules*, long, unsigned long, const char**, int);
+void print_variant(const struct variant*, const void*, const struct rules*);
+
+
+int main(int argc, char** argv)
+{
+  int opt, w, p;
+  long i, games = 100000, shots[2] = {0, 0}, wins[4] = {0, 0, 0, 0};
+  unsigned long seed = 1;
+  double start, secs;
+  const struct strategy* st[2] = { &strategy_random, &strategy_random };
+  void* state[2];
+  struct game g;
+  struct rng r;
+  struct gamelog log, *lp = 0;
+  struct rules rules;
+  const char* names[2] = { "random", "random" };
+  int generic = 0, show = 0;
+
+  rules_classic(&rules);
+  while((opt = getopt(argc, argv, "n:s:a:b:l:r:gp")) != -1) {
+    switch(opt) {
+      case 'n':
+        games = atol(optarg);
+        break;
+      case 's':
+        seed = strtoul(optarg, 0, 10);
+        break;
+      case 'a':
+      case 'b':
+        // checked once the rules say which engine plays
+        names[opt == 'a' ? P1 : P2] = optarg;
+        break;
+      case 'l':
+        // append every game to a log for battleship-replay
+        if(gamelog_open(&log, optarg) < 0) {
+          perror(optarg);
+          return 1;
+        }
+        lp = &log;
+        break;
+      case 'r':
+        if(rules_load(optarg, &rules) < 0)
+          return 1;
+        break;
+      case 'g':
+        // run the classic rules on the sized engine too, to compare
+        generic = 1;
+        break;
+      case 'p':
+        // print both boards of the last game
+        show = 1;
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-n games] [-s seed] [-a strategy] [-b strategy] [-l log] [-r rules] [-g] [-p]\n",
+                argv[0]);
+        return 1;
+    }
+  }
+  if(generic || !rules_is_classic(&rules)) {
+    if(lp) {
+      fprintf(stderr, "game logs only record the classic rules\n");
+      return 1;
+    }
+    return play_variant(&rules, games, seed, names, show);
+  }
+  for(p = 0; p < 2; p++) {
+    if(!(st[p] = strategy_find(names[p]))) {
+      fprintf(stderr, "unknown strategy: %s\n", names[p]);
+      return 1;
+    }
+  }
+  rng_seed(&r, seed);
+  for(p = 0; p < 2; p++)
+    if(!(state[p] = malloc(st[p]->size)))
+      return 1;
+
+  start = now();
+  for(i = 0; i < games; i++) {
+    w = strategy_play(&g, &r, st, state, lp);
+    wins[w]++;
+    shots[P1] += g.shots[P1];
+    shots[P2] += g.shots[P2];
+  }
+  secs = now() - start;
+
+  printf("games:        %ld\n", games);
+  printf("p1 wins:      %ld (%s)\n", wins[2], st[P1]->name);
+  printf("p2 wins:      %ld (%s)\n", wins[3], st[P2]->name);
+  printf("ties:         %ld\n", wins[1] + wins[0]);
+  printf("p1 shots:     %.2f/game\n", games ? (double)shots[P1] / games : 0.0);
+  printf("p2 shots:     %.2f/game\n", games ? (double)shots[P2] / games : 0.0);
+  printf("seconds:      %.3f\n", secs);
+  printf("games/sec:    %.0f\n", secs > 0 ? games / secs : 0.0);
+  printf("usec/shot:    %.3f\n", shots[P1] + shots[P2] ? secs * 1e6 / (shots[P1] + shots[P2]) : 0.0);
+  if(lp)
+    gamelog_close(lp);
+  free(state[P1]);
+  free(state[P2]);
+  return 0;
+}
+
+// run the games on the sized engine for the rules
+int play_variant(const struct rules* ru, long games, unsigned long seed, const char** names, int show)
+{
+  const struct variant* v = variant_for(ru);
+  long i, shots[2] = {0, 0}, wins[4] = {0, 0, 0, 0};
+  int kind[2], p;
+  double start, secs;
+  struct rng r;
+  void* g;
+
+  for(p = 0; p < 2; p++) {
+    if((kind[p] = variant_shooter(names[p])) < 0) {
+      fprintf(stderr, "strategy %s only plays the classic rules (random, hunt)\n", names[p]);
+      return 1;
+    }
+  }
+  if(!(g = malloc(v->size)))
+    return 1;
+  v->init(g, ru);
+  rng_seed(&r, seed);
+
+  start = now();
+  for(i = 0; i < games; i++) {
+    wins[v->play(g, &r, kind)]++;
+    shots[P1] += v->shots(g, P1);
+    shots[P2] += v->shots(g, P2);
+  }
+  secs = now() - start;
+
+  printf("rules:        %dx%d, %d ships, %d cells (%d-bit boards)\n", ru->rows, ru->cols, ru->ship_count,
+         ru->ship_cells, 64 * v->words);
+  printf("games:        %ld\n", games);
+  printf("p1 wins:      %ld (%s)\n", wins[2], names[P1]);
+  printf("p2 wins:      %ld (%s)\n", wins[3], names[P2]);
+  printf("ties:         %ld\n", wins[1] + wins[0]);
+  printf("p1 shots:     %.2f/game\n", games ? (double)shots[P1] / games : 0.0);
+  printf("p2 shots:     %.2f/game\n", games ? (double)shots[P2] / games : 0.0);
+  printf("seconds:      %.3f\n", secs);
+  printf("games/sec:    %.0f\n", secs > 0 ? games / secs : 0.0);
+  printf("usec/shot:    %.3f\n", shots[P1] + shots[P2] ? secs * 1e6 / (shots[P1] + shots[P2]) : 0.0);
+  if(show && games)
+    print_variant(v, g, ru);
+  free(g);
+  return 0;
+}
+
+// print both boards of a finished game with their row and column labels
+void print_variant(const struct variant* v, const void* g, const struct rules* ru)
+{
+  int mode, y, x;
+  for(mode = P1; mode <= P2; mode++) {
+    printf("\nplayer %d\n   ", mode + 1);
+    for(x = 0; x < ru->cols; x++)
+      printf("%3d", rules_col_label(ru, x));
+    printf("\n");
+    for(y = 0; y < ru->rows; y++) {
+      printf("%c  ", rules_row_label(ru, y));
+      for(x = 0; x < ru->cols; x++)
+        printf("  %c", v->board_ch(g, mode, y, x));
+      printf("\n");
+    }
+  }
+}
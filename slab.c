@@ -0,0 +1,84 @@
+/******************************************************
+ * Description: Slab allocator: chunk carving and the
+ *   free list. Objects are 16-byte aligned, enough for
+ *   the bitboards inside a struct game.
+ ******************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "slab.h"
+
+#define SLAB_ALIGN 16
+
+static int grow(struct slab*);
+
+
+// an empty slab of objects of the given size, chunks of per_chunk of them
+void slab_init(struct slab* s, size_t size, int per_chunk)
+{
+  memset(s, 0, sizeof(*s));
+  if(size < sizeof(void*))
+    size = sizeof(void*);
+  s->size = (size + SLAB_ALIGN - 1) & ~(size_t)(SLAB_ALIGN - 1);
+  s->per_chunk = per_chunk > 0 ? per_chunk : 1;
+}
+
+// one object, the most recently freed if any, 0 if out of memory
+void* slab_alloc(struct slab* s)
+{
+  void* p;
+  if(!s->free && grow(s) < 0)
+    return 0;
+  p = s->free;
+  s->free = *(void**)p;
+  if(++s->live > s->peak)
+    s->peak = s->live;
+  return p;
+}
+
+// give an object back for reuse
+void slab_free(struct slab* s, void* p)
+{
+  if(!p)
+    return;
+  *(void**)p = s->free;
+  s->free = p;
+  s->live--;
+}
+
+// bytes taken from the heap
+size_t slab_bytes(const struct slab* s)
+{
+  return s->nchunks * (SLAB_ALIGN + s->per_chunk * s->size);
+}
+
+// return every chunk, whatever is still live in them
+void slab_destroy(struct slab* s)
+{
+  void* c;
+  while((c = s->chunks)) {
+    s->chunks = *(void**)c;
+    free(c);
+  }
+  s->free = 0;
+  s->live = s->nchunks = 0;
+}
+
+// add a chunk and put all its objects on the free list, in address order
+static int grow(struct slab* s)
+{
+  char* c;
+  int i;
+  if(!(c = aligned_alloc(SLAB_ALIGN, SLAB_ALIGN + s->per_chunk * s->size)))
+    return -1;
+  *(void**)c = s->chunks;
+  s->chunks = c;
+  s->nchunks++;
+  c += SLAB_ALIGN;
+  for(i = s->per_chunk - 1; i >= 0; i--) {
+    *(void**)(c + i * s->size) = s->free;
+    s->free = c + i * s->size;
+  }
+  return 0;
+}
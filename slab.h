@@ -0,0 +1,31 @@
+/******************************************************
+ * Description: Slab allocator for many objects of one
+ *   size. Objects are carved out of large chunks and a
+ *   freed one goes on a free list, threaded through
+ *   its own first bytes, to be handed out next; chunks
+ *   are only returned when the whole slab is. It keeps
+ *   count of what is live and what it holds, for the
+ *   memory reports.
+ ******************************************************/
+
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stddef.h>
+
+struct slab {
+  size_t size;          // bytes per object, rounded up for alignment
+  int per_chunk;
+  void* free;           // free objects, each pointing at the next
+  void* chunks;         // chunks, each pointing at the next
+  long live, peak;      // objects handed out, now and at most
+  long nchunks;
+};
+
+void slab_init(struct slab*, size_t, int);
+void* slab_alloc(struct slab*);
+void slab_free(struct slab*, void*);
+size_t slab_bytes(const struct slab*);
+void slab_destroy(struct slab*);
+
+#endif
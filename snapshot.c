@@ -0,0 +1,133 @@
+/******************************************************
+ * Description: Game snapshots: taking and restoring
+ *   the 64-byte record and keeping the last two in a
+ *   file, one pwrite per round.
+ ******************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "snapshot.h"
+
+static uint32_t crc32(const void*, size_t);
+static void build_crc_table();
+
+static uint32_t crc_table[256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+
+// record a game between rounds, return 0 if the fleets are not both down or the rounds differ
+int snapshot_take(struct snapshot* s, const struct game* g, int player_id, int ai)
+{
+  bitboard shot;
+  int mode;
+  memset(s, 0, sizeof(*s));
+  s->magic = SNAP_MAGIC;
+  s->version = SNAP_VERSION;
+  s->player_id = player_id;
+  s->ai = ai;
+  for(mode = P1; mode <= P2; mode++) {
+    if(!engine_fleet_layout(g, mode, s->fleet[mode]))
+      return 0;
+    shot = g->side[mode].hits | g->side[mode].misses;
+    s->shot[mode][0] = (uint64_t)shot;
+    s->shot[mode][1] = (uint64_t)(shot >> 64);
+  }
+  if(g->shots[P1] != g->shots[P2])
+    return 0;
+  s->round = g->shots[P1];
+  s->crc = crc32(s, offsetof(struct snapshot, crc));
+  return 1;
+}
+
+// rebuild a game from a snapshot, 0 if it does not hold together
+int snapshot_restore(const struct snapshot* s, struct game* g)
+{
+  struct side* sd;
+  bitboard shot;
+  int mode, i;
+  engine_init(g);
+  for(mode = P1; mode <= P2; mode++) {
+    if(!engine_place_fleet(g, mode, s->fleet[mode]))
+      return 0;
+    // hits, misses and sunk ships all follow from the fleet and the cells shot
+    sd = &g->side[mode];
+    shot = ((bitboard)s->shot[mode][1] << 64 | s->shot[mode][0]) & BB_BOARD;
+    sd->hits = shot & sd->occupied;
+    sd->misses = shot & ~sd->occupied;
+    g->shots[!mode] = bb_count(shot);
+    for(i = 0; i < SHIP_COUNT; i++)
+      sd->ships[i].is_sunk = !(sd->ship_mask[i] & ~sd->hits);
+  }
+  return g->shots[P1] == s->round && g->shots[P2] == s->round;
+}
+
+// 1 if a record is a whole snapshot this build can read
+int snapshot_check(const struct snapshot* s)
+{
+  return s->magic == SNAP_MAGIC && s->version == SNAP_VERSION &&
+         s->crc == crc32(s, offsetof(struct snapshot, crc));
+}
+
+// open or create a snapshot file, return the descriptor or -1 with errno set
+int snapshot_open(const char* path)
+{
+  return open(path, O_RDWR | O_CREAT, 0666);
+}
+
+// write a snapshot to the slot of its round, return 0 or -1 with errno set
+int snapshot_save(int fd, const struct snapshot* s)
+{
+  off_t at = (off_t)(s->round & 1) * sizeof(*s);
+  ssize_t n;
+  while((n = pwrite(fd, s, sizeof(*s), at)) < 0 && errno == EINTR)
+    ;
+  if(n >= 0 && n != sizeof(*s))
+    errno = EIO;
+  return n == sizeof(*s) ? 0 : -1;
+}
+
+// read the snapshot of a round, or the newest with round < 0; return its round or -1
+int snapshot_load(int fd, int round, struct snapshot* s)
+{
+  struct snapshot slot[2];
+  int i, best = -1;
+  for(i = 0; i < 2; i++) {
+    if(pread(fd, &slot[i], sizeof(slot[i]), (off_t)i * sizeof(slot[i])) != sizeof(slot[i]) ||
+       !snapshot_check(&slot[i]) || (slot[i].round & 1) != i)
+      continue;
+    if(round < 0 ? best < 0 || slot[i].round > slot[best].round : slot[i].round == round)
+      best = i;
+  }
+  if(best < 0)
+    return -1;
+  *s = slot[best];
+  return s->round;
+}
+
+// CRC-32 (IEEE), a byte at a time
+static uint32_t crc32(const void* p, size_t n)
+{
+  const unsigned char* b = p;
+  uint32_t c = 0xffffffffu;
+  pthread_once(&crc_once, build_crc_table);
+  while(n--)
+    c = crc_table[(c ^ *b++) & 0xff] ^ c >> 8;
+  return ~c;
+}
+
+// remainder of every byte value
+static void build_crc_table()
+{
+  uint32_t c;
+  int i, k;
+  for(i = 0; i < 256; i++) {
+    for(c = i, k = 0; k < 8; k++)
+      c = c >> 1 ^ (0xedb88320u & -(c & 1));
+    crc_table[i] = c;
+  }
+}
@@ -0,0 +1,45 @@
+/******************************************************
+ * Description: Game snapshots for resuming a match
+ *   after a crash. A snapshot is one fixed 64-byte,
+ *   checksummed record holding both fleets and the
+ *   cells bombarded on each board, taken whenever both
+ *   sides have fired the same number of shots; the
+ *   rest of the game state follows from those. A file
+ *   keeps the last two rounds in alternate slots, so a
+ *   write cut short never loses both, and a side that
+ *   got one round ahead of its opponent can step back.
+ ******************************************************/
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+
+#include "engine.h"
+
+#define SNAP_MAGIC 0x70616e73u    // "snap"
+#define SNAP_VERSION 1
+#define SNAP_NONE 0xff            // no round to resume from
+
+// layout is fixed, the struct is written and read as it is
+struct snapshot {
+  uint32_t magic;
+  uint8_t version;
+  uint8_t player_id;              // 1 or 2
+  uint8_t ai;                     // computer's index in strategies[] + 1, 0 for a human
+  uint8_t round;                  // shots each side has fired
+  uint8_t fleet[2][SHIP_COUNT];   // P1 is this player, as engine_fleet_layout()
+  uint8_t pad[6];
+  uint64_t shot[2][2];            // cells bombarded on each board, low word first
+  uint32_t crc;                   // of everything before it
+  uint32_t pad2;
+};
+
+int snapshot_take(struct snapshot*, const struct game*, int, int);
+int snapshot_restore(const struct snapshot*, struct game*);
+int snapshot_check(const struct snapshot*);
+int snapshot_open(const char*);
+int snapshot_save(int, const struct snapshot*);
+int snapshot_load(int, int, struct snapshot*);
+
+#endif
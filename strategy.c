@@ -0,0 +1,133 @@
+/******************************************************
+ * Description: Strategy registry, the random shooter
+ *   and the glue that fires a strategy's shot through
+ *   the rules engine.
+ ******************************************************/
+
+#include <string.h>
+
+#include "strategy.h"
+
+// random shooter state
+struct random_state {
+  struct rng r;
+  bitboard left;      // cells not fired at yet
+};
+
+static void random_reset(void*, struct rng*);
+static int random_shoot(void*);
+static void random_result(void*, int, int, int);
+
+const struct strategy strategy_random = {
+  "random", sizeof(struct random_state), random_reset, random_shoot, random_result
+};
+
+const struct strategy* strategies[] = {
+  &strategy_random,
+  &strategy_density,
+  &strategy_hunt,
+  &strategy_endgame,
+  0
+};
+
+
+// look up a registered strategy by name
+const struct strategy* strategy_find(const char* name)
+{
+  int i;
+  for(i = 0; strategies[i]; i++)
+    if(!strcmp(strategies[i]->name, name))
+      return strategies[i];
+  return 0;
+}
+
+// let a strategy bomb the target player's board, return the SHOT_* result
+int strategy_fire(const struct strategy* st, void* state, struct game* g, int target, int* fired)
+{
+  int cell = st->shoot(state);
+  int y_i = cell / BOARD_SIZE, x_i = cell % BOARD_SIZE;
+  int res = engine_attack(g, target, y_i, x_i), ship = -1;
+  if(fired)
+    *fired = cell;
+  if(res == SHOT_REPEAT)
+    return res;
+  if(res == SHOT_SUNK)
+    ship = engine_ship_at(g, target, y_i, x_i) - g->side[target].ships;
+  st->result(state, cell, res, ship);
+  return res;
+}
+
+// tell a strategy fresh from reset() about the shots already on the target's board
+void strategy_replay(const struct strategy* st, void* state, const struct game* g, int target)
+{
+  const struct side* sd = &g->side[target];
+  bitboard shot = sd->hits | sd->misses, seen = 0, bit;
+  int cell, i;
+  // the order they were fired in is gone, a ship counts as sunk at its last cell
+  while(shot) {
+    cell = bb_pop(&shot);
+    bit = bb_cell(cell);
+    seen |= bit;
+    if(!(sd->hits & bit)) {
+      st->result(state, cell, SHOT_MISS, -1);
+      continue;
+    }
+    for(i = 0; !(sd->ship_mask[i] & bit); i++)
+      ;
+    if(sd->ship_mask[i] & ~(sd->hits & seen))
+      st->result(state, cell, SHOT_HIT, -1);
+    else
+      st->result(state, cell, SHOT_SUNK, i);
+  }
+}
+
+// play one game between two strategies on random fleets, return engine_win() result
+int strategy_play(struct game* g, struct rng* r, const struct strategy** st, void** state,
+                  struct gamelog* log)
+{
+  int turn, side, res, cell, w = 0;
+  engine_init(g);
+  engine_random_fleet(g, P1, r);
+  engine_random_fleet(g, P2, r);
+  st[P1]->reset(state[P1], r);
+  st[P2]->reset(state[P2], r);
+  if(log) {
+    gamelog_begin(log);
+    gamelog_fleet(log, g, P1, P1);
+    gamelog_fleet(log, g, P2, P2);
+  }
+  // P1 shoots at P2 and the other way around, one shot each per turn
+  for(turn = 0; turn < TOT_ATK_CELL && !w; turn++) {
+    for(side = P1; side <= P2; side++) {
+      res = strategy_fire(st[side], state[side], g, !side, &cell);
+      if(log)
+        gamelog_shot(log, side, cell, res);
+    }
+    w = engine_win(g);
+  }
+  if(log)
+    gamelog_end(log, w);
+  return w;
+}
+
+// start a random shooter with every cell available
+static void random_reset(void* state, struct rng* r)
+{
+  struct random_state* rs = state;
+  rng_seed(&rs->r, rng_next(r));
+  rs->left = BB_BOARD;
+}
+
+// pick any cell not fired at yet
+static int random_shoot(void* state)
+{
+  struct random_state* rs = state;
+  return bb_select(rs->left, rng_range(&rs->r, bb_count(rs->left)));
+}
+
+// forget the cell that was fired at
+static void random_result(void* state, int cell, int res, int ship)
+{
+  struct random_state* rs = state;
+  rs->left &= ~bb_cell(cell);
+}
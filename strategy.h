@@ -0,0 +1,36 @@
+/******************************************************
+ * Description: Pluggable targeting strategies. A
+ *   strategy keeps its own per-game state in a buffer
+ *   owned by the caller, picks the next cell to bomb
+ *   and is told the outcome of every shot.
+ ******************************************************/
+
+#ifndef STRATEGY_H
+#define STRATEGY_H
+
+#include <stddef.h>
+
+#include "engine.h"
+#include "gamelog.h"
+#include "rng.h"
+
+struct strategy {
+  const char* name;
+  size_t size;                                    // bytes of per-game state
+  void (*reset)(void*, struct rng*);              // start a new game
+  int (*shoot)(void*);                            // next cell to bomb
+  void (*result)(void*, int, int, int);           // cell, SHOT_* result, sunk ship or -1
+};
+
+extern const struct strategy strategy_random;
+extern const struct strategy strategy_density;
+extern const struct strategy strategy_hunt;
+extern const struct strategy strategy_endgame;
+extern const struct strategy* strategies[];
+
+const struct strategy* strategy_find(const char*);
+int strategy_fire(const struct strategy*, void*, struct game*, int, int*);
+void strategy_replay(const struct strategy*, void*, const struct game*, int);
+int strategy_play(struct game*, struct rng*, const struct strategy**, void**, struct gamelog*);
+
+#endif
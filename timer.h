@@ -0,0 +1,28 @@
+/******************************************************
+ * Description: Monotonic clock helper shared by the
+ *   headless drivers.
+ ******************************************************/
+
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+#include <time.h>
+
+// monotonic clock in seconds
+static inline double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// monotonic clock in nanoseconds
+static inline uint64_t now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#endif
@@ -0,0 +1,212 @@
+/******************************************************
+ * Description: Round-robin tournament between all
+ *   registered strategies. Matches are cut into chunks
+ *   of games and spread over a work-stealing pool;
+ *   each worker owns its game, RNG, strategy states
+ *   and result counters, so nothing is shared while
+ *   games are being played.
+ ******************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "engine.h"
+#include "pool.h"
+#include "rng.h"
+#include "strategy.h"
+#include "timer.h"
+
+// games played by one task
+#define CHUNK 256
+
+// one chunk of games of one match
+struct task {
+  int match;
+  int games;
+  uint64_t seed;
+};
+
+// counters for one ordered pairing, P1 moves first
+struct match_stats {
+  long games;
+  long wins[2];
+  long ties;
+  long win_shots[2];    // shots fired by the winner, summed over its wins
+};
+
+// everything a worker touches while playing
+struct worker {
+  struct game g;
+  struct rng r;
+  void** state;                 // one state buffer per strategy and side
+  struct match_stats* stats;    // one entry per match
+} __attribute__((aligned(64)));
+
+struct tournament {
+  int nstrat;
+  int nmatch;
+  int (*pairs)[2];              // strategy index of P1 and P2 for each match
+  struct worker* workers;
+};
+
+void run_chunk(int, void*, void*);
+void report(struct tournament*, int, long, double);
+
+
+int main(int argc, char** argv)
+{
+  int opt, i, j, m, w, threads = pool_cpus();
+  long games = 10000, total = 0, left;
+  unsigned long seed = 1;
+  double start, secs;
+  struct tournament t;
+  struct task* tasks;
+  struct pool* pool;
+  int ntask = 0;
+
+  while((opt = getopt(argc, argv, "g:s:t:")) != -1) {
+    switch(opt) {
+      case 'g':
+        games = atol(optarg);
+        break;
+      case 's':
+        seed = strtoul(optarg, 0, 10);
+        break;
+      case 't':
+        threads = atoi(optarg);
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-g games per match] [-s seed] [-t threads]\n", argv[0]);
+        return 1;
+    }
+  }
+  if(threads < 1)
+    threads = 1;
+
+  // every ordered pair of distinct strategies plays one match
+  for(t.nstrat = 0; strategies[t.nstrat]; t.nstrat++)
+    ;
+  t.nmatch = t.nstrat * (t.nstrat - 1);
+  t.pairs = malloc(t.nmatch * sizeof(*t.pairs));
+  for(i = 0, m = 0; i < t.nstrat; i++) {
+    for(j = 0; j < t.nstrat; j++) {
+      if(i != j) {
+        t.pairs[m][P1] = i;
+        t.pairs[m][P2] = j;
+        m++;
+      }
+    }
+  }
+
+  // per-worker state, allocated up front
+  if(posix_memalign((void**)&t.workers, 64, threads * sizeof(struct worker)))
+    return 1;
+  for(w = 0; w < threads; w++) {
+    struct worker* wk = &t.workers[w];
+    wk->state = malloc(2 * t.nstrat * sizeof(void*));
+    for(i = 0; i < 2 * t.nstrat; i++)
+      wk->state[i] = malloc(strategies[i % t.nstrat]->size);
+    wk->stats = calloc(t.nmatch, sizeof(struct match_stats));
+  }
+
+  // cut matches into chunks, dealt round-robin to the workers
+  tasks = malloc((t.nmatch * (games / CHUNK + 1)) * sizeof(struct task));
+  pool = pool_create(threads, run_chunk, &t);
+  if(!tasks || !pool)
+    return 1;
+  for(m = 0; m < t.nmatch; m++) {
+    for(left = games; left > 0; left -= CHUNK) {
+      tasks[ntask].match = m;
+      tasks[ntask].games = left < CHUNK ? left : CHUNK;
+      tasks[ntask].seed = seed * 0x100000001b3ULL + ntask;
+      pool_submit(pool, ntask, &tasks[ntask]);
+      ntask++;
+    }
+  }
+
+  start = now();
+  pool_run(pool);
+  secs = now() - start;
+
+  total = games * t.nmatch;
+  report(&t, threads, total, secs);
+  pool_destroy(pool);
+  free(tasks);
+  return 0;
+}
+
+// play one chunk of games on worker w
+void run_chunk(int w, void* arg, void* ctx)
+{
+  struct task* tk = arg;
+  struct tournament* t = ctx;
+  struct worker* wk = &t->workers[w];
+  struct match_stats* ms = &wk->stats[tk->match];
+  const struct strategy* st[2];
+  void* state[2];
+  int i, res, side;
+  for(side = P1; side <= P2; side++) {
+    st[side] = strategies[t->pairs[tk->match][side]];
+    state[side] = wk->state[side * t->nstrat + t->pairs[tk->match][side]];
+  }
+  // seeding per task keeps results independent of the thread count
+  rng_seed(&wk->r, tk->seed);
+  for(i = 0; i < tk->games; i++) {
+    res = strategy_play(&wk->g, &wk->r, st, state, 0);
+    ms->games++;
+    if(res == 2 || res == 3) {
+      side = (res == 2) ? P1 : P2;
+      ms->wins[side]++;
+      ms->win_shots[side] += wk->g.shots[side];
+    }
+    else
+      ms->ties++;
+  }
+}
+
+// merge the per-worker counters and print the standings
+void report(struct tournament* t, int threads, long total, double secs)
+{
+  struct match_stats* sum = calloc(t->nmatch, sizeof(*sum));
+  long played, won, shots;
+  int w, m, i, side;
+  for(w = 0; w < threads; w++) {
+    for(m = 0; m < t->nmatch; m++) {
+      struct match_stats* ms = &t->workers[w].stats[m];
+      sum[m].games += ms->games;
+      sum[m].ties += ms->ties;
+      for(side = P1; side <= P2; side++) {
+        sum[m].wins[side] += ms->wins[side];
+        sum[m].win_shots[side] += ms->win_shots[side];
+      }
+    }
+  }
+
+  printf("%-10s %10s %10s %8s %14s\n", "strategy", "games", "wins", "win%", "shots-to-win");
+  for(i = 0; i < t->nstrat; i++) {
+    played = won = shots = 0;
+    for(m = 0; m < t->nmatch; m++) {
+      for(side = P1; side <= P2; side++) {
+        if(t->pairs[m][side] == i) {
+          played += sum[m].games;
+          won += sum[m].wins[side];
+          shots += sum[m].win_shots[side];
+        }
+      }
+    }
+    printf("%-10s %10ld %10ld %7.2f%% %8.2f/%d\n", strategies[i]->name, played, won,
+           played ? 100.0 * won / played : 0.0, won ? (double)shots / won : 0.0, TOT_ATK_CELL);
+  }
+  printf("\n");
+  for(m = 0; m < t->nmatch; m++) {
+    printf("%-10s vs %-10s  %ld-%ld-%ld\n", strategies[t->pairs[m][P1]]->name,
+           strategies[t->pairs[m][P2]]->name, sum[m].wins[P1], sum[m].wins[P2], sum[m].ties);
+  }
+  printf("\nthreads:      %d\n", threads);
+  printf("games:        %ld\n", total);
+  printf("seconds:      %.3f\n", secs);
+  printf("games/sec:    %.0f\n", secs > 0 ? total / secs : 0.0);
+  free(sum);
+}
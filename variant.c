@@ -0,0 +1,51 @@
+/******************************************************
+ * Description: The sized rules engines, one per board
+ *   size, all built from variant_tmpl.h.
+ ******************************************************/
+
+#include <stdint.h>
+#include <string.h>
+
+#include "engine.h"
+#include "variant.h"
+
+#define VW 1
+#include "variant_tmpl.h"
+#undef VW
+#define VW 2
+#include "variant_tmpl.h"
+#undef VW
+#define VW 4
+#include "variant_tmpl.h"
+#undef VW
+#define VW 8
+#include "variant_tmpl.h"
+#undef VW
+#define VW 16
+#include "variant_tmpl.h"
+#undef VW
+
+static const struct variant* sized[] = {
+  &variant_w1, &variant_w2, &variant_w4, &variant_w8, &variant_w16, 0
+};
+
+
+// smallest engine whose bitboards hold the board
+const struct variant* variant_for(const struct rules* r)
+{
+  int i;
+  for(i = 0; sized[i]; i++)
+    if(r->cells <= 64 * sized[i]->words)
+      return sized[i];
+  return 0;
+}
+
+// look up a shooter by name, -1 if unknown
+int variant_shooter(const char* name)
+{
+  if(!strcmp(name, "random"))
+    return VSHOOT_RANDOM;
+  if(!strcmp(name, "hunt"))
+    return VSHOOT_HUNT;
+  return -1;
+}
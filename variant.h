@@ -0,0 +1,35 @@
+/******************************************************
+ * Description: Rules engine for any board and fleet a
+ *   rules file describes. It comes in one build per
+ *   board size (64, 128, 256, 512 and 1024 cells) and
+ *   variant_for() picks the smallest one that fits, so
+ *   an 8x8 game runs on single-word bitboards and a
+ *   32x32 one on sixteen-word ones. The classic game
+ *   keeps its own engine in engine.c.
+ ******************************************************/
+
+#ifndef VARIANT_H
+#define VARIANT_H
+
+#include <stddef.h>
+
+#include "rng.h"
+#include "rules.h"
+
+// shooters of the sized engine
+#define VSHOOT_RANDOM 0
+#define VSHOOT_HUNT   1
+
+struct variant {
+  int words;                                          // 64-bit words per bitboard
+  size_t size;                                        // bytes of game state
+  void (*init)(void*, const struct rules*);           // bind a state to the rules
+  int (*play)(void*, struct rng*, const int*);        // one game, VSHOOT_* per side, engine_win() result
+  int (*shots)(const void*, int);                     // shots fired by a player
+  char (*board_ch)(const void*, int, int, int);       // mode, y, x
+};
+
+const struct variant* variant_for(const struct rules*);
+int variant_shooter(const char*);
+
+#endif
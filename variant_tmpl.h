@@ -0,0 +1,276 @@
+/******************************************************
+ * Description: Rules engine for boards read from a
+ *   rules file, written once and compiled per board
+ *   size. Before each include VW is set to the number
+ *   of 64-bit words a board needs; every bitboard loop
+ *   then runs a fixed number of times and the compiler
+ *   unrolls it, so the sink and win tests stay a few
+ *   AND and OR ops however the board is configured.
+ *   Only variant.c includes this file.
+ ******************************************************/
+
+#define VPASTE2(a, b) a##b
+#define VPASTE(a, b) VPASTE2(a, b)
+#define VN(name) VPASTE(name, VW)
+
+// fixed-size bitboard, cell c is bit c % 64 of word c / 64
+typedef struct {
+  uint64_t w[VW];
+} VN(vbits);
+
+// one player's half of the game
+struct VN(vside) {
+  VN(vbits) ship_mask[RULES_MAX_SHIPS];
+  VN(vbits) occupied;
+  VN(vbits) hits;
+  VN(vbits) misses;
+  int sunk;                                   // ships sunk so far
+};
+
+// a shooter for the sized engine
+struct VN(vshooter) {
+  int kind;                                   // VSHOOT_*
+  int pending;                                // hit cells of ships still afloat
+  VN(vbits) left;                             // cells not fired at yet
+  VN(vbits) todo;                             // next to cells that hit
+  struct rng r;
+};
+
+struct VN(vgame) {
+  const struct rules* rules;
+  VN(vbits) board;                            // every cell
+  VN(vbits) parity;                           // cells with (y + x) even
+  struct VN(vside) side[2];
+  struct VN(vshooter) shooter[2];
+  int shots[2];
+};
+
+static inline void VN(vb_set)(VN(vbits)* b, int c)
+{
+  b->w[c >> 6] |= 1ULL << (c & 63);
+}
+
+static inline int VN(vb_test)(const VN(vbits)* b, int c)
+{
+  return (int)((b->w[c >> 6] >> (c & 63)) & 1);
+}
+
+// check if a and b share a cell
+static inline int VN(vb_meet)(const VN(vbits)* a, const VN(vbits)* b)
+{
+  uint64_t m = 0;
+  int i;
+  for(i = 0; i < VW; i++)
+    m |= a->w[i] & b->w[i];
+  return m != 0;
+}
+
+// check if a has a cell outside b
+static inline int VN(vb_outside)(const VN(vbits)* a, const VN(vbits)* b)
+{
+  uint64_t m = 0;
+  int i;
+  for(i = 0; i < VW; i++)
+    m |= a->w[i] & ~b->w[i];
+  return m != 0;
+}
+
+static inline int VN(vb_count)(const VN(vbits)* b)
+{
+  int i, n = 0;
+  for(i = 0; i < VW; i++)
+    n += __builtin_popcountll(b->w[i]);
+  return n;
+}
+
+// index of the n-th (from 0) set cell of b
+static inline int VN(vb_select)(const VN(vbits)* b, int n)
+{
+  uint64_t w;
+  int i, c;
+  for(i = 0; i < VW; i++) {
+    c = __builtin_popcountll(b->w[i]);
+    if(n < c)
+      break;
+    n -= c;
+  }
+  for(w = b->w[i]; n--; )
+    w &= w - 1;
+  return i * 64 + __builtin_ctzll(w);
+}
+
+// clear both sides and work out the board masks
+static void VN(vinit)(void* state, const struct rules* r)
+{
+  struct VN(vgame)* g = state;
+  int c;
+  memset(g, 0, sizeof(*g));
+  g->rules = r;
+  for(c = 0; c < r->cells; c++) {
+    VN(vb_set)(&g->board, c);
+    if((c / r->cols + c % r->cols) % 2 == 0)
+      VN(vb_set)(&g->parity, c);
+  }
+}
+
+// deploy every ship of one side at random, without overlaps
+static void VN(vrandom_fleet)(struct VN(vgame)* g, int mode, struct rng* r)
+{
+  const struct rules* ru = g->rules;
+  struct VN(vside)* sd = &g->side[mode];
+  VN(vbits) m;
+  int i, j, k, len, vertical, y, x;
+  for(i = 0; i < ru->ship_count; i++) {
+    len = ru->ship_len[i];
+    do {
+      // only the directions the ship fits in
+      vertical = len > ru->cols ? 1 : len > ru->rows ? 0 : rng_range(r, 2);
+      y = rng_range(r, ru->rows - (vertical ? len - 1 : 0));
+      x = rng_range(r, ru->cols - (vertical ? 0 : len - 1));
+      memset(&m, 0, sizeof(m));
+      for(j = 0; j < len; j++)
+        VN(vb_set)(&m, vertical ? (y + j) * ru->cols + x : y * ru->cols + x + j);
+    } while(VN(vb_meet)(&m, &sd->occupied));
+    sd->ship_mask[i] = m;
+    for(k = 0; k < VW; k++)
+      sd->occupied.w[k] |= m.w[k];
+  }
+}
+
+// bomb a cell of the given player's board, return the SHOT_* result and set *ship on a sink
+static int VN(vattack)(struct VN(vgame)* g, int mode, int c, int* ship)
+{
+  struct VN(vside)* sd = &g->side[mode];
+  int i;
+  if(c < 0 || c >= g->rules->cells || VN(vb_test)(&sd->hits, c) || VN(vb_test)(&sd->misses, c))
+    return SHOT_REPEAT;
+  g->shots[!mode]++;
+  if(!VN(vb_test)(&sd->occupied, c)) {
+    VN(vb_set)(&sd->misses, c);
+    return SHOT_MISS;
+  }
+  VN(vb_set)(&sd->hits, c);
+  for(i = 0; !VN(vb_test)(&sd->ship_mask[i], c); i++)
+    ;
+  if(VN(vb_outside)(&sd->ship_mask[i], &sd->hits))
+    return SHOT_HIT;
+  sd->sunk++;
+  *ship = i;
+  return SHOT_SUNK;
+}
+
+// 0 no winner yet, 1 tie, 2 P1 wins, 3 P2 wins, as engine_win()
+static int VN(vwin)(const struct VN(vgame)* g)
+{
+  int n = g->rules->ship_count;
+  int p1 = g->side[P2].sunk == n, p2 = g->side[P1].sunk == n;
+  return p1 && p2 ? 1 : p1 ? 2 : p2 ? 3 : 0;
+}
+
+// queue the unshot cells next to a hit
+static void VN(vshooter_around)(struct VN(vgame)* g, struct VN(vshooter)* s, int c)
+{
+  int cols = g->rules->cols, y = c / cols, x = c % cols;
+  int n[4] = { y > 0 ? c - cols : -1, y < g->rules->rows - 1 ? c + cols : -1,
+               x > 0 ? c - 1 : -1, x < cols - 1 ? c + 1 : -1 };
+  int i;
+  for(i = 0; i < 4; i++)
+    if(n[i] >= 0 && VN(vb_test)(&s->left, n[i]))
+      VN(vb_set)(&s->todo, n[i]);
+}
+
+// next cell for a shooter
+static int VN(vshoot)(struct VN(vgame)* g, struct VN(vshooter)* s)
+{
+  VN(vbits) m;
+  int i, n;
+  if(s->kind == VSHOOT_HUNT) {
+    // finish off what was hit, else sweep the even cells
+    if((n = VN(vb_count)(&s->todo)))
+      return VN(vb_select)(&s->todo, rng_range(&s->r, n));
+    for(i = 0; i < VW; i++)
+      m.w[i] = s->left.w[i] & g->parity.w[i];
+    if((n = VN(vb_count)(&m)))
+      return VN(vb_select)(&m, rng_range(&s->r, n));
+  }
+  return VN(vb_select)(&s->left, rng_range(&s->r, VN(vb_count)(&s->left)));
+}
+
+// tell a shooter how its shot landed
+static void VN(vshooter_result)(struct VN(vgame)* g, struct VN(vshooter)* s, int c, int res, int ship)
+{
+  s->left.w[c >> 6] &= ~(1ULL << (c & 63));
+  s->todo.w[c >> 6] &= ~(1ULL << (c & 63));
+  if(res == SHOT_HIT || res == SHOT_SUNK) {
+    s->pending++;
+    VN(vshooter_around)(g, s, c);
+  }
+  if(res == SHOT_SUNK) {
+    // every hit so far is accounted for, go back to hunting
+    s->pending -= g->rules->ship_len[ship];
+    if(s->pending <= 0)
+      memset(&s->todo, 0, sizeof(s->todo));
+  }
+}
+
+// play one game between two shooters on random fleets, return the vwin() result
+static int VN(vplay)(void* state, struct rng* r, const int* kind)
+{
+  struct VN(vgame)* g = state;
+  struct VN(vshooter)* s;
+  int p, turn, c, res, ship, w = 0;
+  for(p = P1; p <= P2; p++) {
+    memset(&g->side[p], 0, sizeof(g->side[p]));
+    VN(vrandom_fleet)(g, p, r);
+    s = &g->shooter[p];
+    memset(s, 0, sizeof(*s));
+    s->kind = kind[p];
+    s->left = g->board;
+    rng_seed(&s->r, rng_next(r));
+  }
+  g->shots[P1] = g->shots[P2] = 0;
+  // P1 shoots at P2 and the other way around, one shot each per turn
+  for(turn = 0; turn < g->rules->cells && !w; turn++) {
+    for(p = P1; p <= P2; p++) {
+      s = &g->shooter[p];
+      c = VN(vshoot)(g, s);
+      ship = -1;
+      res = VN(vattack)(g, !p, c, &ship);
+      VN(vshooter_result)(g, s, c, res, ship);
+    }
+    w = VN(vwin)(g);
+  }
+  return w;
+}
+
+// shots fired by a player
+static int VN(vshots)(const void* state, int mode)
+{
+  const struct VN(vgame)* g = state;
+  return g->shots[mode];
+}
+
+// board letter of a cell: ship letter, 'X' hit, 'O' miss or '.'
+static char VN(vboard_ch)(const void* state, int mode, int y, int x)
+{
+  const struct VN(vgame)* g = state;
+  const struct VN(vside)* sd = &g->side[mode];
+  int c = y * g->rules->cols + x, i;
+  if(VN(vb_test)(&sd->hits, c))
+    return 'X';
+  if(VN(vb_test)(&sd->misses, c))
+    return 'O';
+  if(!VN(vb_test)(&sd->occupied, c))
+    return '.';
+  for(i = 0; !VN(vb_test)(&sd->ship_mask[i], c); i++)
+    ;
+  return g->rules->ship_ch[i];
+}
+
+static const struct variant VN(variant_w) = {
+  VW, sizeof(struct VN(vgame)), VN(vinit), VN(vplay), VN(vshots), VN(vboard_ch)
+};
+
+#undef VN
+#undef VPASTE
+#undef VPASTE2
@@ -0,0 +1,177 @@
+/******************************************************
+ * Description: Spectator for battleship-server. Connects
+ *   to a -w listener and prints the games as they are
+ *   played, one line per event, or follows one game
+ *   with -g. With -n it opens that many viewers on one
+ *   epoll set and only counts what they get, to load
+ *   the server's fan-out.
+ ******************************************************/
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "engine.h"
+#include "net.h"
+#include "timer.h"
+#include "watch.h"
+
+#define MAX_EVENTS 256
+
+// one spectator connection
+struct viewer {
+  int fd;
+  unsigned char buf[WATCH_BATCH * WATCH_REC];
+  int len;
+};
+
+int view_read(struct viewer*);
+void print_event(const struct event*);
+
+
+// global vars
+long follow = -1;       // game to print, -1 for all
+int quiet;              // count events, print nothing
+long events, resyncs, missed, bad;
+
+
+int main(int argc, char** argv)
+{
+  struct epoll_event ev, events_out[MAX_EVENTS];
+  struct viewer* v;
+  struct rlimit rl;
+  int opt, i, epfd, nview = 1;
+  double secs = 0, start, t;
+
+  while((opt = getopt(argc, argv, "g:n:d:q")) != -1) {
+    switch(opt) {
+      case 'g':
+        follow = atol(optarg);
+        break;
+      case 'n':
+        nview = atoi(optarg);
+        quiet = 1;
+        break;
+      case 'd':
+        secs = atof(optarg);
+        break;
+      case 'q':
+        quiet = 1;
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-g game] [-n viewers] [-d seconds] [-q] addr\n", argv[0]);
+        return 1;
+    }
+  }
+  if(optind != argc - 1 || nview < 1) {
+    fprintf(stderr, "usage: %s [-g game] [-n viewers] [-d seconds] [-q] addr\n", argv[0]);
+    return 1;
+  }
+
+  if(!getrlimit(RLIMIT_NOFILE, &rl) && rl.rlim_cur < rl.rlim_max) {
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+  }
+  signal(SIGPIPE, SIG_IGN);
+  if((epfd = epoll_create1(0)) < 0 || !(v = calloc(nview, sizeof(*v)))) {
+    perror("setup");
+    return 1;
+  }
+  for(i = 0; i < nview; i++) {
+    if((v[i].fd = net_connect(argv[optind])) < 0) {
+      perror(argv[optind]);
+      return 1;
+    }
+    ev.events = EPOLLIN;
+    ev.data.ptr = &v[i];
+    epoll_ctl(epfd, EPOLL_CTL_ADD, v[i].fd, &ev);
+  }
+
+  start = t = now();
+  while(nview && (!secs || (t = now()) < start + secs)) {
+    if((i = epoll_wait(epfd, events_out, MAX_EVENTS, secs ? (int)((start + secs - t) * 1000) + 1 : -1)) < 0) {
+      if(errno == EINTR)
+        continue;
+      perror("epoll_wait");
+      return 1;
+    }
+    while(i--) {
+      if(view_read(events_out[i].data.ptr) < 0) {
+        close(((struct viewer*)events_out[i].data.ptr)->fd);
+        nview--;
+      }
+    }
+  }
+  secs = now() - start;
+
+  if(quiet) {
+    printf("seconds:      %.3f\n", secs);
+    printf("events:       %ld, %.0f/sec\n", events, events / secs);
+    printf("resyncs:      %ld, %ld events missed\n", resyncs, missed);
+    printf("bad records:  %ld\n", bad);
+  }
+  return 0;
+}
+
+// take whatever the server sent, -1 once it hangs up
+int view_read(struct viewer* v)
+{
+  struct event e;
+  int n, off;
+  if((n = read(v->fd, v->buf + v->len, sizeof(v->buf) - v->len)) <= 0)
+    return n < 0 && errno == EINTR ? 0 : -1;
+  v->len += n;
+  for(off = 0; off + WATCH_REC <= v->len; off += WATCH_REC) {
+    if(watch_decode(v->buf + off, &e) < 0) {
+      bad++;
+      continue;
+    }
+    events++;
+    if(e.type == EV_RESYNC) {
+      resyncs++;
+      missed += e.game;
+    }
+    if(!quiet && (follow < 0 || e.game == follow || e.type == EV_RESYNC))
+      print_event(&e);
+  }
+  if(!quiet)
+    fflush(stdout);
+  // keep a record cut in two for the next read
+  memmove(v->buf, v->buf + off, v->len - off);
+  v->len -= off;
+  return 0;
+}
+
+// one line for an event
+void print_event(const struct event* e)
+{
+  static const char* results[] = { "", "tie", "player 1 wins", "player 2 wins" };
+  char fleet[FLEET_TEXT_MAX];
+  switch(e->type) {
+    case EV_START:
+      printf("game %u: started\n", e->game);
+      break;
+    case EV_FLEET:
+      engine_format_fleet(e->fleet, fleet);
+      printf("game %u: player %d deployed %s\n", e->game, e->player + 1, fleet);
+      break;
+    case EV_SHOT:
+      printf("game %u: player %d fires at (%c,%d) and %s", e->game, e->player + 1,
+             row_index2char(e->row), col_index2num(e->col),
+             e->result == SHOT_SUNK ? "sinks the " : e->result == SHOT_HIT ? "hits\n" : "misses\n");
+      if(e->result == SHOT_SUNK)
+        printf("%s\n", e->ship < SHIP_COUNT ? ship_types[e->ship] : "?");
+      break;
+    case EV_END:
+      printf("game %u: %s\n", e->game, e->result >= 1 && e->result <= 3 ? results[e->result] : "abandoned");
+      break;
+    case EV_RESYNC:
+      printf("-- fell behind, %u events missed --\n", e->game);
+      break;
+  }
+}
@@ -0,0 +1,103 @@
+/******************************************************
+ * Description: Spectator ring and event records. The
+ *   ring is only written by the publisher and read by
+ *   the viewers' cursors, all on the server thread, so
+ *   nothing here locks.
+ ******************************************************/
+
+#include <string.h>
+
+#include "watch.h"
+
+
+// add an event to the ring, overwriting the oldest once it is full
+void watch_publish(struct watch_ring* w, const struct event* e)
+{
+  watch_encode(e, w->buf + (w->head & (WATCH_RING - 1)) * WATCH_REC);
+  w->head++;
+}
+
+// start a new viewer at the next event published
+void watch_join(const struct watch_ring* w, struct watch_cursor* c)
+{
+  c->next = w->head;
+  c->missed = 0;
+  c->off = c->len = 0;
+}
+
+// refill a viewer's output once it is all written, return the bytes left to write
+int watch_pull(const struct watch_ring* w, struct watch_cursor* c)
+{
+  struct event e;
+  uint64_t n, at;
+  int i;
+  if(c->off < c->len)
+    return c->len - c->off;
+  c->off = c->len = 0;
+  // the events it was due have been overwritten, jump to the newest
+  if(w->head - c->next > WATCH_RING) {
+    memset(&e, 0, sizeof(e));
+    e.type = EV_RESYNC;
+    n = w->head - c->next;
+    e.game = n > UINT32_MAX ? UINT32_MAX : n;
+    e.ship = NO_SHIP;
+    watch_encode(&e, c->out);
+    c->len = WATCH_REC;
+    c->missed += n;
+    c->next = w->head;
+    return c->len;
+  }
+  // whole records only, so a write cut short never splits the stream
+  n = w->head - c->next;
+  if(n > WATCH_BATCH)
+    n = WATCH_BATCH;
+  for(i = 0; i < n; i++) {
+    at = (c->next + i) & (WATCH_RING - 1);
+    memcpy(c->out + i * WATCH_REC, w->buf + at * WATCH_REC, WATCH_REC);
+  }
+  c->next += n;
+  c->len = n * WATCH_REC;
+  return c->len;
+}
+
+// write one event as a WATCH_REC record
+void watch_encode(const struct event* e, unsigned char* p)
+{
+  p[0] = WATCH_MAGIC;
+  p[1] = e->type;
+  p[2] = e->game & 0xff;
+  p[3] = (e->game >> 8) & 0xff;
+  p[4] = (e->game >> 16) & 0xff;
+  p[5] = (e->game >> 24) & 0xff;
+  p[6] = e->player;
+  if(e->type == EV_FLEET) {
+    memcpy(p + 7, e->fleet, SHIP_COUNT);
+    return;
+  }
+  p[7] = e->row;
+  p[8] = e->col;
+  p[9] = e->result;
+  p[10] = e->ship;
+  p[11] = 0;
+}
+
+// read a WATCH_REC record, -1 if it is not one
+int watch_decode(const unsigned char* p, struct event* e)
+{
+  if(p[0] != WATCH_MAGIC || p[1] < EV_START || p[1] > EV_RESYNC)
+    return -1;
+  memset(e, 0, sizeof(*e));
+  e->type = p[1];
+  e->game = p[2] | (p[3] << 8) | (p[4] << 16) | ((uint32_t)p[5] << 24);
+  e->player = p[6];
+  if(e->type == EV_FLEET) {
+    memcpy(e->fleet, p + 7, SHIP_COUNT);
+    e->ship = NO_SHIP;
+    return 0;
+  }
+  e->row = p[7];
+  e->col = p[8];
+  e->result = p[9];
+  e->ship = p[10];
+  return 0;
+}
@@ -0,0 +1,65 @@
+/******************************************************
+ * Description: Spectator stream. The server publishes
+ *   what happens in its games (pairings, fleets, shots,
+ *   results) as fixed-size event records into one ring
+ *   shared by every viewer. Each viewer only keeps a
+ *   cursor into the ring, so publishing costs the same
+ *   however many are watching; a viewer that falls a
+ *   whole ring behind skips ahead to the newest event
+ *   and is told how many it missed.
+ ******************************************************/
+
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <stdint.h>
+
+#include "proto.h"
+
+// event types
+#define EV_START  1   // game paired
+#define EV_FLEET  2   // a player's fleet is down: fleet
+#define EV_SHOT   3   // player shot at row, col: result, ship sunk or NO_SHIP
+#define EV_END    4   // game over: result as engine_win(), 0 if abandoned
+#define EV_RESYNC 5   // viewer fell behind: game holds the events skipped
+// record layout: magic, type, game (4 bytes, little endian), player,
+// row, col, result, ship, pad; a fleet record has the SHIP_COUNT fleet
+// bytes from row on
+#define WATCH_MAGIC 0xb6
+#define WATCH_REC 12
+// events the ring holds, a power of two
+#define WATCH_RING (1 << 16)
+// records a viewer copies out of the ring at a time
+#define WATCH_BATCH 64
+
+struct event {
+  int type;
+  uint32_t game;
+  int player;
+  int row, col;
+  int result;
+  int ship;
+  unsigned char fleet[SHIP_COUNT];
+};
+
+// the newest WATCH_RING events, encoded
+struct watch_ring {
+  unsigned char buf[WATCH_RING * WATCH_REC];
+  uint64_t head;        // events published so far
+};
+
+// one viewer's place in the stream
+struct watch_cursor {
+  uint64_t next;        // next event to send
+  uint64_t missed;      // events skipped over
+  unsigned char out[WATCH_BATCH * WATCH_REC];   // copied out, not written yet
+  int off, len;
+};
+
+void watch_publish(struct watch_ring*, const struct event*);
+void watch_join(const struct watch_ring*, struct watch_cursor*);
+int watch_pull(const struct watch_ring*, struct watch_cursor*);
+void watch_encode(const struct event*, unsigned char*);
+int watch_decode(const unsigned char*, struct event*);
+
+#endif